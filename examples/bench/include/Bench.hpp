@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hcnet/host.hpp"
+#include "hcnet/client.hpp"
+#include "hcnet/derive.hpp"
+
+#include "fmt/core.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using fmt::println;
+
+constexpr u16 PORT = 9280;
+constexpr i16 HOST_ID = 0;
+
+inline i64 now_ns() noexcept {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// positional numeric argument, `fallback` if missing or malformed
+inline i64 arg_or(int argc, char** argv, int index, i64 fallback) noexcept {
+	if (index >= argc) {
+		return fallback;
+	}
+
+	i64 value = fallback;
+	std::from_chars(argv[index], argv[index] + std::strlen(argv[index]), value);
+
+	return value;
+}
+
+struct bench_t {
+	enum event : i16 {
+		join,     // client -> host, cinfo
+		accepted, // host -> client, hinfo
+		stamp,    // either way, a timestamped message
+		blob      // either way, a timestamp and a payload of any size
+	};
+};
+
+// every bench message is a timestamp, so latency can be measured anywhere it arrives
+template <bench_t::event E>
+struct stamp_msg {
+	stamp_msg() noexcept {}
+	stamp_msg(const i64 sent_ns, const u64 seq = 0) noexcept : sent_ns(sent_ns), seq(seq) {}
+
+	i64 sent_ns = 0;
+	u64 seq = 0;
+};
+
+template <bench_t::event E>
+struct net::vectorize_msg<stamp_msg<E>> {
+
+	static constexpr auto identifier = E;
+
+	template <bool IncludeHeaderBuf, typename Buf>
+	static std::vector<Buf> vectorize(stamp_msg<E> const& obj) noexcept {
+		return net::build_custom_buf_seq<IncludeHeaderBuf, Buf>(
+			Buf((void*)&obj, sizeof(obj))
+		);
+	}
+};
+
+struct blob_msg {
+	i64 sent_ns = 0;
+	std::vector<u8> payload;
+};
+
+template <>
+struct net::vectorize_msg<blob_msg> : net::derive_vectorize<blob_msg, bench_t::blob> {};
+
+#include "hcnet/msg.hpp"
+
+using join_msg = stamp_msg<bench_t::join>;
+using accepted_msg = stamp_msg<bench_t::accepted>;
+using tick_msg = stamp_msg<bench_t::stamp>;
+
+struct latency_stats {
+	std::vector<i64> samples_ns;
+	std::mutex mutex;
+
+	void add(const i64 ns) noexcept {
+		std::scoped_lock lock{ mutex };
+		samples_ns.push_back(ns);
+	}
+
+	void clear() noexcept {
+		std::scoped_lock lock{ mutex };
+		samples_ns.clear();
+	}
+
+	void report(const char* name) noexcept {
+		std::scoped_lock lock{ mutex };
+
+		if (samples_ns.empty()) {
+			println("{:>24}: no samples", name);
+			return;
+		}
+
+		std::ranges::sort(samples_ns);
+
+		auto at = [&](const double q) {
+			return samples_ns[static_cast<size_t>(q * static_cast<double>(samples_ns.size() - 1))] / 1000.0;
+		};
+
+		println("{:>24}: n={:<8} p50={:>9.1f}us p99={:>9.1f}us p99.9={:>9.1f}us max={:>9.1f}us",
+			name, samples_ns.size(), at(0.5), at(0.99), at(0.999), samples_ns.back() / 1000.0);
+	}
+};
+
+// the process' cpu time, peak memory and threads so far
+struct resource_usage {
+	double cpu_s = 0;
+	i64 max_rss_kb = -1;
+	i64 threads = -1;
+
+	static resource_usage now() noexcept {
+		resource_usage r;
+#ifdef _WIN32
+		FILETIME created, exited, kernel, user;
+
+		if (::GetProcessTimes(::GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+			auto to_s = [](FILETIME const& t) {
+				return ((static_cast<u64>(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 1e7;
+			};
+
+			r.cpu_s = to_s(kernel) + to_s(user);
+		}
+#else
+		rusage usage;
+
+		if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+			r.cpu_s = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+			r.max_rss_kb = usage.ru_maxrss;
+		}
+
+		std::ifstream status("/proc/self/status");
+
+		for (std::string line; std::getline(status, line);) {
+			if (line.starts_with("Threads:")) {
+				r.threads = std::strtoll(line.c_str() + 8, nullptr, 10);
+			}
+		}
+#endif
+		return r;
+	}
+};
+
+// Accepts everyone, counts what it receives, echoes `stamp` messages when `echo` is set,
+// and forwards them to `on_stamp` (set it before Start(), it runs on the io thread)
+class BenchHoster : public net::Host<BenchHoster> {
+public:
+	BenchHoster(const u16 port, net::host_config const& config = {}) :
+		net::Host<BenchHoster>(port, HOST_ID, this, config)
+	{}
+
+	std::atomic<i16> next_id{ HOST_ID + 1 };
+
+	std::atomic<u64> received_tcp{ 0 };
+	std::atomic<u64> received_udp{ 0 };
+
+	bool echo = false;
+
+	std::function<void(tick_msg const&, i16 from_id)> on_stamp;
+
+public:
+
+	void on_error(net::error_info const& err) noexcept {
+		err.ec.map_or_else(
+			[](std::error_code const& ec) { println("[host] error: {}", ec.message()); },
+			[]() { println("[host] error"); });
+	}
+
+	void on_close_connection(const i16, gef::option<net::error_info const&>) noexcept {}
+
+	auto new_client(net::any_msg& m) noexcept -> std::expected<WIRE::allowed, WIRE::not_allowed> {
+		join_msg const& join = m.as<join_msg>().inner;
+
+		return WIRE::allowed{
+			gef::unique_ref<PacketTCP>::make(
+				gef::unique_ref<net::msg<accepted_msg>>::make( join.sent_ns )
+			),
+			gef::unique_ref<PacketTCP>::make(
+				gef::unique_ref<net::msg<join_msg>>::make( join )
+			),
+			next_id++
+		};
+	}
+
+	static gef::option<gef::unique_ref<net::any_msg>> builder_TCP(net::header_client_TCP const& h) noexcept {
+		switch (h.msg_type) {
+		case bench_t::join:
+			return gef::unique_ref<net::msg<join_msg>>::make();
+		case bench_t::stamp:
+			return gef::unique_ref<net::msg<tick_msg>>::make();
+		case bench_t::blob:
+			return net::build_msg<blob_msg>(h.size);
+		default:
+			return gef::nullopt;
+		}
+	}
+
+	void new_packet_TCP(gef::unique_ref<PacketTCPclient> p, const i16 from_id) noexcept {
+		received_tcp.fetch_add(1, std::memory_order_relaxed);
+
+		if (on_stamp && p->h.msg_type == bench_t::stamp) {
+			p->m.inspect(
+				[&](gef::unique_ref<net::any_msg> const& m) {
+					on_stamp(m->as<tick_msg>().inner, from_id);
+				});
+		}
+
+		if (echo) {
+			p->m.map_or_else(
+				[&](gef::unique_ref<net::any_msg>& m) {
+					Send(gef::unique_ref<PacketTCP>::make(std::move(m)), from_id);
+				},
+				[]() {});
+		}
+	}
+
+	static gef::unique_ref<net::any_msg> builder_UDP(size_t) noexcept {
+		return gef::unique_ref<net::msg<tick_msg>>::make();
+	}
+
+	bool new_packet_UDP(gef::unique_ref<PacketUDPclient> p, const i16 from_id) noexcept {
+		received_udp.fetch_add(1, std::memory_order_relaxed);
+
+		if (on_stamp) {
+			on_stamp(p->m->as<tick_msg>().inner, from_id);
+		}
+
+		if (echo) {
+			Send(gef::unique_ref<PacketUDP>::make(std::move(p->m)), from_id);
+		}
+
+		return true;
+	}
+};
+
+// Records when its handshake finished, forwards received stamps to `on_stamp`
+class BenchClienter : public net::Client<BenchClienter> {
+public:
+	BenchClienter(net::client_config const& config = {}) :
+		net::Client<BenchClienter>(config)
+	{}
+
+	// on a context shared with other clients, see net::Client
+	BenchClienter(asio::io_context& shared, net::client_config const& config = {}) :
+		net::Client<BenchClienter>(shared, config)
+	{}
+
+	i64 started_ns = 0;
+	std::atomic<i64> joined_ns{ 0 };
+
+	std::function<void(tick_msg const&, i16 from_id)> on_stamp;
+
+	void Join(std::string const& ip, const u16 port) noexcept {
+		started_ns = now_ns();
+
+		Start(ip, port,
+			gef::unique_ref<PacketTCP>::make(
+				gef::unique_ref<net::msg<join_msg>>::make( started_ns )
+			));
+	}
+
+	constexpr bool joined() const noexcept {
+		return joined_ns.load(std::memory_order_relaxed) != 0;
+	}
+
+public:
+
+	void on_error(net::error_info const& err) noexcept {
+		err.ec.map_or_else(
+			[](std::error_code const& ec) { println("[client] error: {}", ec.message()); },
+			[]() { println("[client] error"); });
+	}
+
+	void on_close_connection(gef::option<net::error_info const&>) noexcept {}
+
+	static gef::option<gef::unique_ref<net::any_msg>> connection_result_builder(net::header_server_TCP const& h) noexcept {
+		if (h.msg_type == bench_t::accepted) {
+			return gef::unique_ref<net::msg<accepted_msg>>::make();
+		}
+
+		return gef::nullopt;
+	}
+
+	bool connection_result(gef::unique_ref<PacketTCPserver> p) noexcept {
+		joined_ns = now_ns();
+		return p->h.msg_type == bench_t::accepted;
+	}
+
+	static gef::option<gef::unique_ref<net::any_msg>> builder_TCP(net::header_server_TCP const& h) noexcept {
+		switch (h.msg_type) {
+		case bench_t::join:
+			return gef::unique_ref<net::msg<join_msg>>::make();
+		case bench_t::stamp:
+			return gef::unique_ref<net::msg<tick_msg>>::make();
+		case bench_t::blob:
+			return net::build_msg<blob_msg>(h.size);
+		default:
+			return gef::nullopt;
+		}
+	}
+
+	void new_packet_TCP(gef::unique_ref<PacketTCPserver> p) noexcept {
+		if (on_stamp && p->h.msg_type == bench_t::stamp) {
+			p->m.inspect(
+				[&](gef::unique_ref<net::any_msg> const& m) {
+					on_stamp(m->as<tick_msg>().inner, p->h.from_id);
+				});
+		}
+	}
+
+	static gef::unique_ref<net::any_msg> builder_UDP(size_t) noexcept {
+		return gef::unique_ref<net::msg<tick_msg>>::make();
+	}
+
+	bool new_packet_UDP(gef::unique_ref<PacketUDPserver> p) noexcept {
+		if (on_stamp) {
+			on_stamp(p->m->as<tick_msg>().inner, p->h.from_id);
+		}
+
+		return true;
+	}
+};
+
+// waits until `done()` or `timeout`, returns whether `done()`
+template <typename Pred>
+bool wait_for(Pred&& done, const std::chrono::milliseconds timeout) noexcept {
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+	while (not done()) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			return false;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "Bench.hpp"
+#include "hcnet/replay.hpp"
+
+// Capture and replay.
+// A few clients stamp a relaying host over TCP and UDP, first without a capture then with one,
+// reports what the capture costs in latency, then replays the host's trace into a host that isn't started,
+// and reports how fast its handlers ran through it.
+//
+// usage: capture_replay [trace=capture.hctrace] [stamps=5000] [speed=0]
+
+constexpr int CLIENTS = 4;
+
+latency_stats run_session(BenchHoster& host, const i64 stamps) noexcept {
+	latency_stats latency;
+
+	std::vector<std::unique_ptr<BenchClienter>> clients;
+
+	for (int i = 0; i < CLIENTS; i++) {
+		auto& c = clients.emplace_back(std::make_unique<BenchClienter>());
+
+		c->on_stamp = [&](tick_msg const& s, i16) { latency.add(now_ns() - s.sent_ns); };
+		c->Join("127.0.0.1", PORT);
+	}
+
+	if (not wait_for([&]() { return std::ranges::all_of(clients, [](auto const& c) { return c->joined(); }); }, std::chrono::seconds(5))) {
+		println("clients failed to join");
+		return latency;
+	}
+
+	for (i64 seq = 0; seq < stamps; seq++) {
+		auto& c = clients[seq % CLIENTS];
+
+		if (seq % 2 == 0) {
+			c->Send(
+				gef::unique_ref<BenchClienter::PacketTCP>::make(
+					gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), static_cast<u64>(seq) )
+				));
+		}
+		else {
+			c->Send(
+				gef::unique_ref<BenchClienter::PacketUDP>::make(
+					gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), static_cast<u64>(seq) )
+				));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	return latency;
+}
+
+int main(int argc, char** argv) {
+
+	const std::string trace_path = argc > 1 ? argv[1] : "capture.hctrace";
+	const i64 stamps = arg_or(argc, argv, 2, 5000);
+	const double speed = static_cast<double>(arg_or(argc, argv, 3, 0));
+
+	println("capture and replay: {} stamps into {}, replayed at {}", stamps, trace_path, speed == 0 ? "full speed" : fmt::format("{}x", speed));
+
+	{
+		BenchHoster host(PORT);
+		host.echo = true;
+		host.Start();
+
+		run_session(host, stamps).report("latency (no capture)");
+
+		if (std::error_code ec = host.StartCapture(trace_path)) {
+			println("failed to start the capture: {}", ec.message());
+			return 1;
+		}
+
+		run_session(host, stamps).report("latency (capture)");
+
+		host.StopCapture();
+		host.Stop();
+	} // the trace is complete once the host is gone
+
+	net::CaptureReader trace;
+
+	if (std::error_code ec = trace.Open(trace_path)) {
+		println("failed to open the trace: {}", ec.message());
+		return 1;
+	}
+
+	BenchHoster replayed(PORT);
+
+	const net::replay_stats stats = net::Replay(replayed, trace, speed);
+
+	println("replayed {} packets ({} skipped) in {:.1f}ms, {:.0f} packets/s, the handlers saw {} TCP and {} UDP",
+		stats.packets, stats.skipped, stats.elapsed_ns / 1e6, stats.packets / (stats.elapsed_ns / 1e9),
+		replayed.received_tcp.load(), replayed.received_udp.load());
+}
\ No newline at end of file
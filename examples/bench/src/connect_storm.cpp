@@ -0,0 +1,108 @@
+#include "Bench.hpp"
+
+// Connect storm.
+// `clients` connect at once while a few resident clients receive a 1 kHz stamp from the host,
+// reports how long the joiners wait for their handshake, and how much the residents' delivery is delayed meanwhile.
+//
+// usage: connect_storm [clients=300] [acceptors=1] [accept_threads=0] [outstanding_accepts=1]
+
+constexpr int RESIDENTS = 4;
+
+int main(int argc, char** argv) {
+
+	const i64 clients = arg_or(argc, argv, 1, 300);
+
+	net::host_config config{};
+	config.accept.acceptors = static_cast<u8>(arg_or(argc, argv, 2, 1));
+	config.accept.threads = static_cast<u8>(arg_or(argc, argv, 3, 0));
+	config.accept.outstanding_accepts = static_cast<u8>(arg_or(argc, argv, 4, 1));
+
+	println("connect storm: {} clients, {} acceptor(s), {} accept thread(s), {} outstanding accept(s)",
+		clients, config.accept.acceptors, config.accept.threads, config.accept.outstanding_accepts);
+
+	BenchHoster host(PORT, config);
+	host.Start();
+
+	latency_stats resident_delay;
+
+	std::vector<std::unique_ptr<BenchClienter>> residents;
+
+	for (int i = 0; i < RESIDENTS; i++) {
+		auto& c = residents.emplace_back(std::make_unique<BenchClienter>());
+
+		c->on_stamp = [&](tick_msg const& s, i16) { resident_delay.add(now_ns() - s.sent_ns); };
+		c->Join("127.0.0.1", PORT);
+	}
+
+	if (not wait_for([&]() { return std::ranges::all_of(residents, [](auto const& c) { return c->joined(); }); }, std::chrono::seconds(5))) {
+		println("residents failed to join");
+		return 1;
+	}
+
+	std::atomic<bool> ticking = true;
+
+	std::thread ticker(
+		[&]() {
+			u64 seq = 0;
+
+			while (ticking) {
+				host.Send(
+					gef::unique_ref<BenchHoster::PacketTCP>::make(
+						gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), seq++ )
+					), HOST_ID);
+
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		});
+
+	// baseline
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	resident_delay.report("resident delay (idle)");
+	resident_delay.clear();
+
+	// storm
+	std::vector<std::unique_ptr<BenchClienter>> joiners;
+	joiners.reserve(clients);
+
+	for (i64 i = 0; i < clients; i++) {
+		joiners.emplace_back(std::make_unique<BenchClienter>());
+	}
+
+	const i64 storm_start = now_ns();
+
+	for (auto& c : joiners) {
+		c->Join("127.0.0.1", PORT);
+	}
+
+	const bool all_joined = wait_for(
+		[&]() { return std::ranges::all_of(joiners, [](auto const& c) { return c->joined(); }); },
+		std::chrono::seconds(30));
+
+	const i64 storm_ns = now_ns() - storm_start;
+
+	ticking = false;
+	ticker.join();
+
+	latency_stats join_latency;
+	size_t failed = 0;
+
+	for (auto const& c : joiners) {
+		if (c->joined()) {
+			join_latency.add(c->joined_ns - c->started_ns);
+		}
+		else {
+			failed++;
+		}
+	}
+
+	println("storm: {:.1f}ms, {} joined, {} failed{}",
+		storm_ns / 1e6, clients - failed, failed, all_joined ? "" : " (timed out)");
+
+	join_latency.report("join latency");
+	resident_delay.report("resident delay (storm)");
+
+	joiners.clear();
+	residents.clear();
+
+	host.Stop();
+}
\ No newline at end of file
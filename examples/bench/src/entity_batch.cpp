@@ -0,0 +1,73 @@
+#include "Bench.hpp"
+#include "hcnet/entity_batch.hpp"
+#include <random>
+
+// Entity batch encoding.
+// Encodes and decodes `entities` moving entities every tick with every SIMD level this machine has,
+// reports the time per batch and its size against the raw struct-of-arrays bytes.
+//
+// usage: entity_batch [entities=1000] [ticks=2000]
+
+constexpr float PRECISION = 0.01f;
+
+int main(int argc, char** argv) {
+
+	const i64 count = std::max<i64>(arg_or(argc, argv, 1, 1000), 1);
+	const i64 ticks = std::max<i64>(arg_or(argc, argv, 2, 2000), 1);
+
+	println("entity batch: {} entities, {} ticks, detected level {}", count, ticks, static_cast<int>(net::detail::best_simd()));
+
+	std::mt19937 rng{ 22 };
+	std::uniform_real_distribution<float> spawn(-1000.f, 1000.f);
+	std::uniform_real_distribution<float> step(-0.2f, 0.2f);
+
+	for (int l = 0; l <= static_cast<int>(net::detail::best_simd()); l++) {
+		const auto level = static_cast<net::simd_level>(l);
+
+		net::entity_soa world;
+		world.resize(count);
+
+		for (i64 i = 0; i < count; i++) {
+			world.x[i] = spawn(rng);
+			world.y[i] = spawn(rng);
+			world.z[i] = spawn(rng);
+			world.flags[i] = static_cast<u32>(i);
+		}
+
+		net::EntityEncoder encoder(PRECISION, 0, level);
+		net::EntityDecoder decoder(PRECISION, level);
+
+		std::vector<u8> batch;
+		net::entity_soa received;
+
+		i64 encode_ns = 0;
+		i64 decode_ns = 0;
+		size_t bytes = 0;
+
+		for (i64 t = 0; t < ticks; t++) {
+			for (i64 i = 0; i < count; i++) {
+				world.x[i] += step(rng);
+				world.z[i] += step(rng);
+			}
+
+			batch.clear();
+
+			const i64 start_ns = now_ns();
+			encoder.Encode(world, batch);
+			const i64 encoded_ns = now_ns();
+
+			if (not decoder.Decode(batch, received)) {
+				println("batch {} failed to decode", t);
+				return 1;
+			}
+
+			encode_ns += encoded_ns - start_ns;
+			decode_ns += now_ns() - encoded_ns;
+			bytes += batch.size();
+		}
+
+		println("level {}: encode {:>7.2f}us, decode {:>7.2f}us, {:>7.0f} bytes per batch ({:.1f}x smaller than raw)",
+			l, encode_ns / 1e3 / ticks, decode_ns / 1e3 / ticks, static_cast<double>(bytes) / ticks,
+			static_cast<double>(count * 16 * ticks) / static_cast<double>(bytes));
+	}
+}
\ No newline at end of file
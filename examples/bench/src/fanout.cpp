@@ -0,0 +1,133 @@
+#include "Bench.hpp"
+
+// Fan-out.
+// `clients` (on `io_threads` shared threads) join a host that broadcasts a stamp to all of them `rate_hz` times a second,
+// over UDP, or TCP with tcp=1. Reports the deliveries per second, the receivers' latency and the cpu it took.
+// Build it with and without HCNET_IO_URING to compare the io_uring and epoll backends.
+//
+// io_writes - 1 writes from the host's io thread (the io_uring build's default), 0 from a writer thread per wire
+// spin_us   - busy polls the host's io thread with this spin budget and reports its spin / work split, 0 doesn't
+// workers   - the host's fan-out workers, shards from 64 wires (0 = half the hardware threads, 1 = never shard)
+//
+// usage: fanout [clients=200] [io_threads=4] [seconds=5] [rate_hz=60] [tcp=0] [io_writes=backend default] [spin_us=0] [workers=0]
+
+int main(int argc, char** argv) {
+
+	const i64 clients = arg_or(argc, argv, 1, 200);
+	const i64 io_threads = std::max<i64>(arg_or(argc, argv, 2, 4), 1);
+	const i64 seconds = arg_or(argc, argv, 3, 5);
+	const i64 rate_hz = std::max<i64>(arg_or(argc, argv, 4, 60), 1);
+	const bool tcp = arg_or(argc, argv, 5, 0) != 0;
+
+	net::host_config host_config{};
+	host_config.io_writes = arg_or(argc, argv, 6, net::io_uring_backend) != 0;
+
+	const i64 spin_us = std::max<i64>(arg_or(argc, argv, 7, 0), 0);
+	host_config.busy_poll.enabled = spin_us != 0;
+	host_config.busy_poll.spin_us = static_cast<u32>(spin_us);
+
+	host_config.fanout.workers = static_cast<u8>(std::clamp<i64>(arg_or(argc, argv, 8, 0), 0, 255));
+
+	println("fan-out: {} clients on {} io thread(s), {}s of {} Hz {} broadcasts, {} backend, host writes from {}, {} fan-out worker(s)",
+		clients, io_threads, seconds, rate_hz, tcp ? "TCP" : "UDP",
+		net::io_uring_backend ? "io_uring" : "epoll", host_config.io_writes ? "the io thread" : "writer threads",
+		host_config.fanout.workers != 0 ? std::to_string(host_config.fanout.workers) : "auto");
+
+	BenchHoster host(PORT, host_config);
+	host.Start();
+
+	std::vector<std::unique_ptr<asio::io_context>> contexts;
+	std::vector<asio::executor_work_guard<asio::io_context::executor_type>> guards;
+	std::vector<std::thread> threads;
+
+	for (i64 i = 0; i < io_threads; i++) {
+		auto& ctx = contexts.emplace_back(std::make_unique<asio::io_context>(1));
+
+		guards.push_back(asio::make_work_guard(*ctx));
+		threads.emplace_back([ctx = ctx.get()]() { ctx->run(); });
+	}
+
+	latency_stats latency;
+	std::atomic<u64> delivered{ 0 };
+
+	std::vector<std::unique_ptr<BenchClienter>> receivers;
+
+	for (i64 i = 0; i < clients; i++) {
+		auto& c = receivers.emplace_back(std::make_unique<BenchClienter>(*contexts[i % io_threads]));
+
+		c->on_stamp = [&](tick_msg const& s, i16) {
+			latency.add(now_ns() - s.sent_ns);
+			delivered.fetch_add(1, std::memory_order_relaxed);
+		};
+		c->Join("127.0.0.1", PORT);
+	}
+
+	if (not wait_for([&]() { return std::ranges::all_of(receivers, [](auto const& c) { return c->joined(); }); }, std::chrono::seconds(30))) {
+		println("clients failed to join");
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	const resource_usage before = resource_usage::now();
+	const i64 start_ns = now_ns();
+
+	const auto period = std::chrono::nanoseconds(1'000'000'000 / rate_hz);
+	auto next = std::chrono::steady_clock::now();
+
+	for (i64 seq = 0; seq < seconds * rate_hz; seq++) {
+		if (tcp) {
+			host.Send(
+				gef::unique_ref<BenchHoster::PacketTCP>::make(
+					gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), static_cast<u64>(seq) )
+				), HOST_ID);
+		}
+		else {
+			host.Send(
+				gef::unique_ref<BenchHoster::PacketUDP>::make(
+					gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), static_cast<u64>(seq) )
+				), HOST_ID);
+		}
+
+		next += period;
+		std::this_thread::sleep_until(next);
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	const double elapsed_s = (now_ns() - start_ns) / 1e9;
+	const resource_usage after = resource_usage::now();
+
+	println("delivered {} of {} ({:.0f}/s)", delivered.load(), clients * seconds * rate_hz, delivered / elapsed_s);
+
+	latency.report("broadcast latency");
+
+	println("cpu {:.2f}s ({:.0f}% of one core), {} threads",
+		after.cpu_s - before.cpu_s, (after.cpu_s - before.cpu_s) / elapsed_s * 100, after.threads);
+
+	if (host_config.busy_poll.enabled) {
+		const net::busy_poll_stats s = host.poll_stats();
+
+		println("host io thread: {:.2f}s work, {:.2f}s spinning, {:.2f}s parked, {} handlers, {} parks",
+			s.work_ns / 1e9, s.spin_ns / 1e9, s.parked_ns / 1e9, s.handlers, s.parks);
+	}
+
+	for (auto& c : receivers) {
+		c->Stop();
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	guards.clear();
+
+	for (auto& ctx : contexts) {
+		ctx->stop();
+	}
+
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	receivers.clear();
+
+	host.Stop();
+}
\ No newline at end of file
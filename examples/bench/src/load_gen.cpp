@@ -0,0 +1,173 @@
+#include "Bench.hpp"
+#include <random>
+
+// Load generator.
+// `bots` lightweight clients share `io_threads` threads (see net::Client's shared context constructor) and play a scripted profile
+// against an echoing host on loopback: a staggered join, a 60 Hz UDP state stamp, a TCP chat stamp every `chat_s` seconds,
+// and `churn` bots leaving for fresh ones every second.
+// Reports the host's throughput, the host-side (one way) and the bots' (round trip) latency, and the process' resource use.
+//
+// compact - 1 negotiates `net::framing::compact` headers
+//
+// usage: load_gen [bots=500] [io_threads=4] [seconds=10] [chat_s=2] [churn=5] [compact=0]
+
+constexpr int STATE_HZ = 60;
+constexpr int JOINS_PER_MS = 2;
+
+int main(int argc, char** argv) {
+
+	const i64 bot_count = arg_or(argc, argv, 1, 500);
+	const i64 io_threads = std::max<i64>(arg_or(argc, argv, 2, 4), 1);
+	const i64 seconds = arg_or(argc, argv, 3, 10);
+	const i64 chat_s = std::max<i64>(arg_or(argc, argv, 4, 2), 1);
+	const i64 churn = arg_or(argc, argv, 5, 5);
+	const net::framing header_framing = arg_or(argc, argv, 6, 0) != 0 ? net::framing::compact : net::framing::fixed;
+
+	println("load generator: {} bots on {} io thread(s), {}s, chat every {}s, {} leave and join every second, {} headers",
+		bot_count, io_threads, seconds, chat_s, churn, header_framing == net::framing::compact ? "compact" : "fixed");
+
+	net::host_config host_config{};
+	host_config.header_framing = header_framing;
+
+	net::client_config client_config{};
+	client_config.header_framing = header_framing;
+
+	latency_stats host_latency;
+	latency_stats round_trip;
+
+	BenchHoster host(PORT, host_config);
+	host.echo = true;
+	host.on_stamp = [&](tick_msg const& s, i16) { host_latency.add(now_ns() - s.sent_ns); };
+	host.Start();
+
+	std::vector<std::unique_ptr<asio::io_context>> contexts;
+	std::vector<asio::executor_work_guard<asio::io_context::executor_type>> guards;
+	std::vector<std::thread> threads;
+
+	for (i64 i = 0; i < io_threads; i++) {
+		auto& ctx = contexts.emplace_back(std::make_unique<asio::io_context>(1));
+
+		guards.push_back(asio::make_work_guard(*ctx));
+		threads.emplace_back([ctx = ctx.get()]() { ctx->run(); });
+	}
+
+	// destroyed before the contexts, and only once they stopped
+	std::vector<std::unique_ptr<BenchClienter>> bots;
+	std::vector<std::unique_ptr<BenchClienter>> left;
+
+	i64 spawned = 0;
+
+	auto spawn = [&]() {
+		auto c = std::make_unique<BenchClienter>(*contexts[spawned++ % io_threads], client_config);
+
+		c->on_stamp = [&](tick_msg const& s, i16) { round_trip.add(now_ns() - s.sent_ns); };
+		c->Join("127.0.0.1", PORT);
+
+		return c;
+	};
+
+	const resource_usage before = resource_usage::now();
+	const i64 join_start_ns = now_ns();
+
+	for (i64 i = 0; i < bot_count; i++) {
+		bots.push_back(spawn());
+
+		if (i % JOINS_PER_MS == JOINS_PER_MS - 1) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	if (not wait_for([&]() { return std::ranges::all_of(bots, [](auto const& c) { return c->joined(); }); }, std::chrono::seconds(30))) {
+		println("bots failed to join");
+	}
+
+	println("{} bots joined in {:.1f}ms", bot_count, (now_ns() - join_start_ns) / 1e6);
+
+	host_latency.clear();
+	round_trip.clear();
+
+	const u64 tcp_before = host.received_tcp;
+	const u64 udp_before = host.received_udp;
+	const i64 run_start_ns = now_ns();
+
+	std::mt19937 rng{ 22 };
+
+	const auto period = std::chrono::nanoseconds(1'000'000'000 / STATE_HZ);
+	auto next_tick = std::chrono::steady_clock::now();
+
+	u64 seq = 0;
+
+	for (i64 tick = 0; tick < seconds * STATE_HZ; tick++) {
+
+		for (size_t i = 0; i < bots.size(); i++) {
+			auto& c = bots[i];
+
+			if (not c->is_connected()) {
+				continue;
+			}
+
+			c->Send(
+				gef::unique_ref<BenchClienter::PacketUDP>::make(
+					gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), seq++ )
+				));
+
+			if ((tick + static_cast<i64>(i)) % (chat_s * STATE_HZ) == 0) {
+				c->Send(
+					gef::unique_ref<BenchClienter::PacketTCP>::make(
+						gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), seq++ )
+					));
+			}
+		}
+
+		if (tick % STATE_HZ == STATE_HZ - 1) {
+			for (i64 n = 0; n < churn && not bots.empty(); n++) {
+				auto& c = bots[rng() % bots.size()];
+
+				c->Stop();
+
+				left.push_back(std::move(c)); // its handlers may still be queued on its context
+				c = spawn();
+			}
+		}
+
+		next_tick += period;
+		std::this_thread::sleep_until(next_tick);
+	}
+
+	const double elapsed_s = (now_ns() - run_start_ns) / 1e9;
+
+	const u64 tcp = host.received_tcp - tcp_before;
+	const u64 udp = host.received_udp - udp_before;
+
+	const resource_usage after = resource_usage::now();
+
+	println("host received {} TCP ({:.0f}/s) and {} UDP ({:.0f}/s) packets",
+		tcp, tcp / elapsed_s, udp, udp / elapsed_s);
+
+	host_latency.report("host-side latency");
+	round_trip.report("bot round trip");
+
+	println("cpu {:.2f}s ({:.0f}% of one core), max rss {}KB, {} threads",
+		after.cpu_s - before.cpu_s, (after.cpu_s - before.cpu_s) / elapsed_s * 100, after.max_rss_kb, after.threads);
+
+	for (auto& c : bots) {
+		c->Stop();
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	guards.clear();
+
+	for (auto& ctx : contexts) {
+		ctx->stop();
+	}
+
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	bots.clear();
+	left.clear();
+
+	host.Stop();
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "Bench.hpp"
+
+// Mesh loopback.
+// `clients` join a relaying host, one of them sends a 1 kHz UDP stamp to everyone else,
+// reports the receivers' latency, and how many stamps the host still had to relay.
+// With the mesh the stamps take the direct paths, without it every stamp goes through the host.
+//
+// usage: mesh_loopback [clients=4] [mesh=1] [stamps=2000]
+
+int main(int argc, char** argv) {
+
+	const i64 clients = std::max<i64>(arg_or(argc, argv, 1, 4), 2);
+	const bool mesh = arg_or(argc, argv, 2, 1) != 0;
+	const i64 stamps = arg_or(argc, argv, 3, 2000);
+
+	println("mesh loopback: {} clients, mesh {}, {} stamps", clients, mesh ? "on" : "off", stamps);
+
+	net::host_config host_config{};
+	host_config.mesh.enabled = mesh;
+
+	BenchHoster host(PORT, host_config);
+	host.echo = true; // relays every stamp like an application would
+	host.Start();
+
+	net::client_config client_config{};
+	client_config.mesh.enabled = mesh;
+
+	latency_stats latency;
+	std::atomic<u64> received{ 0 };
+
+	std::vector<std::unique_ptr<BenchClienter>> peers;
+
+	for (i64 i = 0; i < clients; i++) {
+		auto& c = peers.emplace_back(std::make_unique<BenchClienter>(client_config));
+
+		if (i != 0) {
+			c->on_stamp = [&](tick_msg const& s, i16) {
+				latency.add(now_ns() - s.sent_ns);
+				received.fetch_add(1, std::memory_order_relaxed);
+			};
+		}
+
+		c->Join("127.0.0.1", PORT);
+	}
+
+	if (not wait_for([&]() { return std::ranges::all_of(peers, [](auto const& c) { return c->joined(); }); }, std::chrono::seconds(5))) {
+		println("clients failed to join");
+		return 1;
+	}
+
+	if (mesh) {
+		const bool meshed = wait_for(
+			[&]() {
+				return std::ranges::all_of(peers,
+					[&](auto const& c) { return c->direct_peers() == static_cast<size_t>(clients - 1); });
+			},
+			std::chrono::seconds(5));
+
+		if (not meshed) {
+			println("mesh incomplete, the host relays to the missing paths");
+		}
+	}
+
+	const u64 host_received_before = host.received_udp;
+
+	for (i64 seq = 0; seq < stamps; seq++) {
+		peers[0]->Send(
+			gef::unique_ref<BenchClienter::PacketUDP>::make(
+				gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), static_cast<u64>(seq) )
+			));
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	const u64 expected = static_cast<u64>(stamps * (clients - 1));
+
+	println("received {} of {} ({} duplicated or lost), the host received {}",
+		received.load(), expected, static_cast<i64>(received.load()) - static_cast<i64>(expected), host.received_udp - host_received_before);
+
+	latency.report("stamp latency");
+
+	peers.clear();
+
+	host.Stop();
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "Bench.hpp"
+
+// Relay tree.
+// `clients` join a meshed host, the host broadcasts a 1 kHz UDP stamp,
+// reports how many wires the host sends each broadcast to, the receivers' latency, and whether anyone got a stamp twice.
+//
+// usage: relay_tree [clients=32] [fanout=4] [capacity=8] [stamps=2000]
+
+int main(int argc, char** argv) {
+
+	const i64 clients = arg_or(argc, argv, 1, 32);
+	const i64 stamps = arg_or(argc, argv, 4, 2000);
+
+	net::host_config host_config{};
+	host_config.mesh.enabled = true;
+	host_config.mesh.relay_fanout = static_cast<u8>(arg_or(argc, argv, 2, 4));
+
+	net::client_config client_config{};
+	client_config.mesh.enabled = true;
+	client_config.mesh.relay_capacity = static_cast<u8>(arg_or(argc, argv, 3, 8));
+
+	println("relay tree: {} clients, fanout {}, capacity {}, {} stamps",
+		clients, host_config.mesh.relay_fanout, client_config.mesh.relay_capacity, stamps);
+
+	BenchHoster host(PORT, host_config);
+	host.Start();
+
+	latency_stats latency;
+	std::atomic<u64> received{ 0 };
+
+	std::vector<std::unique_ptr<BenchClienter>> peers;
+	std::vector<std::vector<u8>> seen(clients, std::vector<u8>(stamps, 0)); // written by each client's own io thread
+
+	std::atomic<u64> duplicates{ 0 };
+
+	for (i64 i = 0; i < clients; i++) {
+		auto& c = peers.emplace_back(std::make_unique<BenchClienter>(client_config));
+
+		c->on_stamp = [&, i](tick_msg const& s, i16) {
+			latency.add(now_ns() - s.sent_ns);
+			received.fetch_add(1, std::memory_order_relaxed);
+
+			if (s.seq < static_cast<u64>(stamps) && seen[i][s.seq]++ != 0) {
+				duplicates.fetch_add(1, std::memory_order_relaxed);
+			}
+		};
+
+		c->Join("127.0.0.1", PORT);
+	}
+
+	if (not wait_for([&]() { return std::ranges::all_of(peers, [](auto const& c) { return c->joined(); }); }, std::chrono::seconds(10))) {
+		println("clients failed to join");
+		return 1;
+	}
+
+	wait_for(
+		[&]() {
+			return std::ranges::all_of(peers,
+				[&](auto const& c) { return c->direct_peers() == static_cast<size_t>(clients - 1); });
+		},
+		std::chrono::seconds(10));
+
+	// let the last rebuild land
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	println("the host sends each broadcast to {} of {} wires", host.broadcast_fanout(), clients);
+
+	for (i64 seq = 0; seq < stamps; seq++) {
+		host.Send(
+			gef::unique_ref<BenchHoster::PacketUDP>::make(
+				gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), static_cast<u64>(seq) )
+			), HOST_ID);
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	println("received {} of {}, {} duplicates", received.load(), stamps * clients, duplicates.load());
+
+	latency.report("stamp latency");
+
+	peers.clear();
+
+	host.Stop();
+}
\ No newline at end of file
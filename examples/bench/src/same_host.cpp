@@ -0,0 +1,84 @@
+#include "Bench.hpp"
+
+// Same-host round trips, over the loopback sockets and over shared memory (see `net::shm_config`).
+// A client pings the host on this machine `count` times with a stamp, one at a time, the host echoes it back,
+// the round trip is measured when the echo arrives. The first `count / 10` pings warm up (and let the link switch over).
+//
+// usage: same_host [count=20000] [spin_us=50]
+
+// the round trips of one run
+void run(const u16 port, const bool shm, const i64 count, const u32 spin_us) noexcept {
+	net::host_config host_config{};
+	host_config.shm.enabled = shm;
+	host_config.shm.spin_us = spin_us;
+
+	BenchHoster host(port, host_config);
+	host.echo = true;
+	host.Start();
+
+	net::client_config config{};
+	config.shm.enabled = shm;
+	config.shm.spin_us = spin_us;
+
+	BenchClienter c(config);
+
+	std::atomic<u64> echoed{ 0 };
+	latency_stats rtt;
+	const i64 warmup = count / 10;
+
+	c.on_stamp = [&](tick_msg const& t, i16) {
+		if (static_cast<i64>(t.seq) >= warmup) {
+			rtt.add(now_ns() - t.sent_ns);
+		}
+
+		echoed.fetch_add(1, std::memory_order_release);
+	};
+
+	c.Join("127.0.0.1", port);
+
+	if (not wait_for([&]() { return c.joined(); }, std::chrono::seconds(5))) {
+		println("the client failed to join");
+		return;
+	}
+
+	for (i64 i = 0; i < warmup + count; i++) {
+		c.Send(gef::unique_ref<BenchClienter::PacketTCP>::make(
+			gef::unique_ref<net::msg<tick_msg>>::make( now_ns(), static_cast<u64>(i) )
+		));
+
+		// wait_for() sleeps between its checks, the next ping goes out as soon as the echo is in
+		const i64 deadline_ns = now_ns() + 5'000'000'000;
+
+		while (echoed.load(std::memory_order_acquire) <= static_cast<u64>(i) && now_ns() < deadline_ns) {
+			std::this_thread::yield();
+		}
+
+		if (echoed.load(std::memory_order_acquire) <= static_cast<u64>(i)) {
+			println("no echo for ping {}", i);
+			break;
+		}
+	}
+
+	rtt.report(shm ? "shared memory" : "loopback sockets");
+
+	c.Stop();
+	host.Stop();
+}
+
+int main(int argc, char** argv) {
+
+	const i64 count = arg_or(argc, argv, 1, 20000);
+	const u32 spin_us = static_cast<u32>(arg_or(argc, argv, 2, 50));
+
+	println("same host round trips: {} pings per run, readers spin {}us", count, spin_us);
+
+	if constexpr (not net::shm_supported) {
+		println("shared memory isn't supported here, loopback only");
+	}
+
+	run(PORT, false, count, spin_us);
+
+	if constexpr (net::shm_supported) {
+		run(PORT + 1, true, count, spin_us);
+	}
+}
\ No newline at end of file
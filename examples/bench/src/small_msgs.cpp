@@ -0,0 +1,68 @@
+#include "Bench.hpp"
+
+// Small message linearization.
+// A client streams `count` blobs of every payload size over TCP to a host, once for every `send_queue_limits::linearize_bytes`,
+// and reports how fast the host received them. A blob is three buffers, the header, the timestamp and the payload,
+// gathered by the writer unless it's linearized into one.
+// Pick the threshold at the largest payload where linearizing still wins.
+//
+// usage: small_msgs [count=200000]
+
+constexpr size_t PAYLOADS[] = { 16, 64, 256, 1024, 2000 };
+constexpr size_t THRESHOLDS[] = { 0, 256, 1024, net::detail::linearize_bytes_max };
+
+// packets per second the host received
+double run(const u16 port, const size_t payload, const size_t threshold, const i64 count) noexcept {
+	BenchHoster host(port);
+	host.Start();
+
+	net::client_config config{};
+	config.tcp_queue.linearize_bytes = threshold;
+
+	BenchClienter c(config);
+	c.Join("127.0.0.1", port);
+
+	if (not wait_for([&]() { return c.joined(); }, std::chrono::seconds(5))) {
+		println("the client failed to join");
+		return 0;
+	}
+
+	const u64 received_before = host.received_tcp;
+	const i64 start_ns = now_ns();
+
+	for (i64 i = 0; i < count; i++) {
+		auto m = net::build_msg<blob_msg>(sizeof(i64) + payload);
+		m->inner.sent_ns = now_ns();
+
+		c.Send(gef::unique_ref<BenchClienter::PacketTCP>::make(std::move(m)));
+	}
+
+	if (not wait_for([&]() { return host.received_tcp - received_before >= static_cast<u64>(count); }, std::chrono::seconds(30))) {
+		println("the host received {} of {} blobs", host.received_tcp - received_before, count);
+	}
+
+	const double elapsed_s = (now_ns() - start_ns) / 1e9;
+
+	c.Stop();
+	host.Stop();
+
+	return count / elapsed_s;
+}
+
+int main(int argc, char** argv) {
+
+	const i64 count = arg_or(argc, argv, 1, 200000);
+
+	println("small message linearization: {} blobs per run", count);
+
+	u16 port = PORT;
+
+	for (const size_t payload : PAYLOADS) {
+		for (const size_t threshold : THRESHOLDS) {
+			const double rate = run(port++, payload, threshold, count);
+
+			println("payload {:>5}B, linearize_bytes {:>5}: {:>10.0f} packets/s ({})",
+				payload, threshold, rate, payload + sizeof(i64) + sizeof(net::header_client_TCP) <= threshold ? "linearized" : "gathered");
+		}
+	}
+}
\ No newline at end of file
@@ -104,10 +104,20 @@ static void display_error(net::error_info const& err) noexcept {
 				return "Failed to start the server";
 			case net_error::failed_to_connect:
 				return "A request to establish connection has failed";
+			case net_error::failed_to_listen:
+				return "Failed to listen for connections";
 			case net_error::failed_to_read:
 				return "Failed to read or handle an incoming message";
 			case net_error::failed_to_write:
 				return "Failed to send a message";
+			case net_error::slow_consumer:
+				return "The connection couldn't keep up with out-going messages";
+			case net_error::timed_out:
+				return "The connection went silent";
+			case net_error::file_transfer:
+				return "A streamed file couldn't be opened or written";
+			case net_error::message_too_large:
+				return "Recieved a message larger than allowed";
 			default:
 				return "Unspecified";
 			}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "hcnet/canyon.hpp"
+#include "hcnet/derive.hpp"
 #include "gef/byte_buffer.hpp"
 
 
@@ -24,26 +25,11 @@ struct msg_t {
 static constexpr u64 MAX_NAME_SIZE = 64;
 
 struct client_info {
-	client_info() noexcept {}
-	client_info(std::string const& s) noexcept : name(s) {}
-	client_info(const u64 struct_size) noexcept { name.resize(struct_size); }
-
-public:
 	std::string name;
 };
 
 template <>
-struct net::vectorize_msg<client_info> {
-
-	static constexpr auto identifier = msg_t::new_client;
-
-	template <bool IncludeHeaderBuf, typename Buf>
-	static std::vector<Buf> vectorize(client_info const& obj) noexcept {
-		return net::build_custom_buf_seq<IncludeHeaderBuf, Buf>(
-			Buf((void*)obj.name.data(), obj.name.size())
-		);
-	}
-};
+struct net::vectorize_msg<client_info> : net::derive_vectorize<client_info, msg_t::new_client> {};
 
 
 struct host_info {
@@ -63,31 +49,16 @@ struct host_info {
 		i64 clients_count;
 	};
 
-	void serialize(gef::sparse_array<client_info>& clients) noexcept {
-
-		data_buf.reserve(clients.size() * (sizeof(host_info::client) + MAX_NAME_SIZE));
-
-		info.max_clients_allowed = clients.capacity();
-		info.clients_count = clients.size();
-
-		clients.for_each(
-			[&](client_info& ci, size_t& index) {
-				std::string const& name = ci.name;
-
-				data_buf.construct_back<client>(name.size(), index);
-
-				data_buf.copy_back(name.data(), name.size());
-			});
-	}
-
+	// the host sends a `net::JoinSnapshot<data_info>`, each entry is a `client` followed by the name
 	void deserialize(gef::sparse_array<client_info>& clients) noexcept {
 		clients.resize(info.max_clients_allowed);
 
 		while (info.clients_count-- > 0) {
 			auto cdata = data_buf.make_front<client>();
 
-			auto& ci = clients.emplace_at(cdata.id, cdata.size);
+			auto& ci = clients.emplace_at(cdata.id);
 
+			ci.name.resize(cdata.size);
 			data_buf.load_front(ci.name.data(), cdata.size);
 		}
 	}
@@ -121,29 +92,11 @@ struct chat_msg {
 		command
 	};
 
-	chat_msg() noexcept {}
-
-	chat_msg(const u64 struct_size) noexcept
-	{
-		text.resize(struct_size - sizeof(t));
-	}
-
-	std::string text;
 	type t;
+	std::string text;
 };
 
 template <>
-struct net::vectorize_msg<chat_msg> {
-
-	static constexpr auto identifier = msg_t::chat_msg;
-
-	template <bool IncludeHeaderBuf, typename Buf>
-	static std::vector<Buf> vectorize(chat_msg const& obj) noexcept {
-		return net::build_custom_buf_seq<IncludeHeaderBuf, Buf>(
-			Buf((void*)&obj.t, sizeof(obj.t)),
-			Buf((void*)obj.text.data(), obj.text.size())
-		);
-	}
-};
+struct net::vectorize_msg<chat_msg> : net::derive_vectorize<chat_msg, msg_t::chat_msg> {};
 
 #include "hcnet/msg.hpp"
\ No newline at end of file
@@ -80,9 +80,9 @@ public:
 	static gef::option<gef::unique_ref<net::any_msg>> builder_TCP(net::header_server_TCP const& h) noexcept {
 		switch (static_cast<msg_t::event>(h.msg_type)) {
 		case msg_t::new_client:
-			return gef::unique_ref<net::msg<client_info>>::make( h.size );
+			return net::build_msg<client_info>( h.size );
 		case msg_t::chat_msg:
-			return gef::unique_ref<net::msg<chat_msg>>::make( h.size );
+			return net::build_msg<chat_msg>( h.size );
 		default:
 			return gef::nullopt;
 		}
@@ -129,7 +129,7 @@ public:
 	}
 
 	static gef::unique_ref<net::any_msg> builder_UDP(size_t size) noexcept {
-		return gef::unique_ref<net::msg<chat_msg>>::make(size);
+		return net::build_msg<chat_msg>( size - net::header_server_UDP::header_size );
 	}
 
 	bool new_packet_UDP(gef::unique_ref<PacketUDPserver> p) noexcept {
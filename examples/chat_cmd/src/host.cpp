@@ -1,5 +1,6 @@
 #include "Common.hpp"
 #include "hcnet/upnp.hpp"
+#include "hcnet/snapshot.hpp"
 
 class Hoster;
 
@@ -15,6 +16,31 @@ public:
 	gef::sparse_array<client_info> clients;
 	std::shared_mutex mutex_mutate_clients;
 
+	// what `host_info::deserialize` reads, patched on every join / leave
+	net::JoinSnapshot<host_info::data_info> snapshot;
+
+	// call with `mutex_mutate_clients` held
+	void snapshot_insert(const size_t index) noexcept {
+		client_info const& ci = clients[index];
+
+		const host_info::client entry{ ci.name.size(), index };
+
+		snapshot.upsert(static_cast<i16>(index), {
+			net::const_buf(&entry, sizeof(entry)),
+			net::const_buf(ci.name.data(), ci.name.size())
+		});
+
+		snapshot_count();
+	}
+
+	// call with `mutex_mutate_clients` held
+	void snapshot_count() noexcept {
+		snapshot.set_preamble({
+			static_cast<i64>(clients.capacity()),
+			static_cast<i64>(clients.size())
+		});
+	}
+
 public:
 
 	void on_error(net::error_info const& err) noexcept {
@@ -32,6 +58,9 @@ public:
 		{
 			std::scoped_lock lock{ mutex_mutate_clients };
 			clients.erase_at(from_id);
+
+			snapshot.erase(from_id);
+			snapshot_count();
 		}
 	}
 
@@ -57,13 +86,13 @@ public:
 							));
 				}
 
-				auto hinfo_msg = gef::unique_ref<net::msg<host_info>>::make();
-
-				// serialize first
-				hinfo_msg->inner.serialize(clients);
+				// the session as it is before this client, sent by reference
+				auto hinfo_msg = snapshot.make_msg<msg_t::connection_request::new_host>();
 
 				// then add client
 				cinfo = clients.emplace_at(index, std::move(cinfo));
+				snapshot_insert(index);
+
 				println("({}) joined the session.", cinfo.name);
 
 				return WIRE::allowed{
@@ -87,9 +116,9 @@ public:
 	static gef::option<gef::unique_ref<net::any_msg>> builder_TCP(net::header_client_TCP const& h) noexcept {
 		switch (static_cast<msg_t::event>(h.msg_type)) {
 		case msg_t::new_client:
-			return gef::unique_ref<net::msg<client_info>>::make( h.size );
+			return net::build_msg<client_info>( h.size );
 		case msg_t::chat_msg:
-			return gef::unique_ref<net::msg<chat_msg>>::make( h.size );
+			return net::build_msg<chat_msg>( h.size );
 		default:
 			return gef::nullopt;
 		}
@@ -116,7 +145,7 @@ public:
 	}
 
 	static gef::unique_ref<net::any_msg> builder_UDP(size_t size) noexcept {
-		return gef::unique_ref<net::msg<chat_msg>>::make( size );
+		return net::build_msg<chat_msg>( size - net::header_client_UDP::header_size );
 	}
 
 	bool new_packet_UDP(gef::unique_ref<PacketUDPclient> p, const i16 from_id) noexcept {
@@ -209,6 +238,7 @@ static bool setup_host(Hoster& host) noexcept {
 	} while (name.size() > MAX_NAME_SIZE);
 
 	host.clients.emplace_at(host.host_id(), std::move(name));
+	host.snapshot_insert(host.host_id());
 
 	return true;
 }
@@ -247,16 +277,16 @@ int main() {
 		else if (msg.text == "/mode udp") {
 			mode_tcp = false;
 		}
-		else {
+		else { // through the handlers, like the others' messages, which print and broadcast it
 			if (mode_tcp) {
-				auto p = gef::unique_ref<HOST::PacketTCP>::make(std::move(m));
+				auto p = gef::unique_ref<HOST::PacketTCPclient>::make(std::move(m));
 
-				host.Send(std::move(p), host.host_id());
+				host.SendLocal(std::move(p));
 			}
 			else {
-				auto p = gef::unique_ref<HOST::PacketUDP>::make(std::move(m));
+				auto p = gef::unique_ref<HOST::PacketUDPclient>::make(std::move(m));
 
-				host.Send(std::move(p), host.host_id());
+				host.SendLocal(std::move(p));
 			}
 		}
 	}
@@ -0,0 +1,284 @@
+#pragma once
+
+#include "canyon.hpp"
+#include "derive.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <span>
+
+namespace net {
+
+	/// A message body of packed bits, written with a `BitWriter` and read with a `BitReader`.
+	/// Build a received one with `build_msg<bitstream<Identifier>>(size)`
+	template <auto Identifier>
+	struct bitstream {
+		std::vector<u8> bytes;
+	};
+
+	template <auto Identifier>
+	struct vectorize_msg<bitstream<Identifier>> : derive_vectorize<bitstream<Identifier>, Identifier> {};
+
+	namespace quantize {
+
+		// The bits a value in [0, range] takes
+		constexpr u8 bits_for(const u32 range) noexcept {
+			return static_cast<u8>(std::bit_width(range));
+		}
+
+		// The bits a value in [min, max] takes at `precision` steps
+		inline u8 bits_for(const float min, const float max, const float precision) noexcept {
+			return bits_for(static_cast<u32>(std::ceil((max - min) / precision)));
+		}
+
+		// `value` clamped to [min, max], as one of 2^bits evenly spaced steps
+		inline u32 to_fixed(const float value, const float min, const float max, const u8 bits) noexcept {
+			const u32 steps = static_cast<u32>((u64{ 1 } << bits) - 1);
+			const float unit = (std::clamp(value, min, max) - min) / (max - min);
+
+			return static_cast<u32>(std::lround(unit * static_cast<float>(steps)));
+		}
+
+		inline float from_fixed(const u32 fixed, const float min, const float max, const u8 bits) noexcept {
+			const u32 steps = static_cast<u32>((u64{ 1 } << bits) - 1);
+
+			return min + (max - min) * (static_cast<float>(fixed) / static_cast<float>(steps));
+		}
+
+		// the smallest three components of a unit quaternion are within ±1/√2
+		inline constexpr float quat_component_max = 0.70710678f;
+	}
+
+	/// Packs values into a byte vector, least significant bit first. Nothing is complete until `Flush()`
+	class BitWriter {
+	public:
+
+		/// appends to `out`
+		BitWriter(std::vector<u8>& out) noexcept : out(out) {}
+
+		/// the low `bits` (0 - 32) of `value`
+		void Write(const u32 value, const u8 bits) noexcept {
+			scratch |= (value & mask(bits)) << scratch_bits;
+			scratch_bits += bits;
+			written += bits;
+
+			if (scratch_bits >= 32) {
+				for (int i = 0; i < 4; i++) {
+					out.push_back(static_cast<u8>(scratch >> (8 * i)));
+				}
+
+				scratch >>= 32;
+				scratch_bits -= 32;
+			}
+		}
+
+		void WriteBool(const bool value) noexcept {
+			Write(value, 1);
+		}
+
+		/// `value` in [min, max], in as few bits as the range takes
+		void WriteRanged(const i32 value, const i32 min, const i32 max) noexcept {
+			Write(static_cast<u32>(std::clamp(value, min, max) - min), quantize::bits_for(static_cast<u32>(max - min)));
+		}
+
+		/// `value` clamped to [min, max] as a `bits` fixed-point number
+		void WriteFixed(const float value, const float min, const float max, const u8 bits) noexcept {
+			Write(quantize::to_fixed(value, min, max, bits), bits);
+		}
+
+		/// Smallest three, a unit quaternion (x, y, z, w) as the index of its largest component
+		/// and the other three in `bits` each, 2 + 3 * `bits` in total
+		void WriteQuat(std::array<float, 4> const& q, const u8 bits) noexcept {
+			size_t largest = 0;
+
+			for (size_t i = 1; i < 4; i++) {
+				if (std::abs(q[i]) > std::abs(q[largest])) {
+					largest = i;
+				}
+			}
+
+			// q and -q are the same rotation, the dropped component is sent as positive
+			const float sign = q[largest] < 0 ? -1.f : 1.f;
+
+			Write(static_cast<u32>(largest), 2);
+
+			for (size_t i = 0; i < 4; i++) {
+				if (i != largest) {
+					WriteFixed(sign * q[i], -quantize::quat_component_max, quantize::quat_component_max, bits);
+				}
+			}
+		}
+
+		/// Bulk, every value in `bits`
+		void WriteMany(std::span<const u32> values, const u8 bits) noexcept {
+			Reserve(values.size() * bits);
+
+			for (const u32 v : values) {
+				Write(v, bits);
+			}
+		}
+
+		/// Bulk, every value clamped to [min, max] as a `bits` fixed-point number
+		void WriteFixedMany(std::span<const float> values, const float min, const float max, const u8 bits) noexcept {
+			Reserve(values.size() * bits);
+
+			for (const float v : values) {
+				WriteFixed(v, min, max, bits);
+			}
+		}
+
+		/// An array of entities, its size (up to `max_count`) then `write_one(*this, entity)` for each
+		template <typename T, typename F>
+		void WriteArray(std::span<const T> entities, const u32 max_count, F&& write_one) noexcept {
+			const u32 count = std::min<u32>(static_cast<u32>(entities.size()), max_count);
+
+			Write(count, quantize::bits_for(max_count));
+
+			for (u32 i = 0; i < count; i++) {
+				write_one(*this, entities[i]);
+			}
+		}
+
+		/// Writes out the last partial bytes, the rest of the last byte is zeroes
+		void Flush() noexcept {
+			while (scratch_bits > 0) {
+				out.push_back(static_cast<u8>(scratch));
+
+				scratch >>= 8;
+				scratch_bits = scratch_bits > 8 ? scratch_bits - 8 : 0;
+			}
+
+			scratch = 0;
+		}
+
+		constexpr size_t bits() const noexcept {
+			return written;
+		}
+
+	private:
+		// room for `bits` more, growing the way push_back() would
+		void Reserve(const size_t bits) noexcept {
+			const size_t needed = out.size() + (scratch_bits + bits) / 8 + 1;
+
+			if (needed > out.capacity()) {
+				out.reserve(std::max<size_t>(needed, out.capacity() * 2));
+			}
+		}
+
+		static constexpr u64 mask(const u8 bits) noexcept {
+			return (u64{ 1 } << bits) - 1;
+		}
+
+		std::vector<u8>& out;
+
+		u64 scratch = 0;
+		u32 scratch_bits = 0;
+
+		size_t written = 0;
+	};
+
+	/// Reads what a `BitWriter` wrote, in the same order.
+	/// Reading past the end yields zeroes and sets `overrun()`, check it once the message is read
+	class BitReader {
+	public:
+
+		BitReader(std::span<const u8> in) noexcept : in(in) {}
+
+		u32 Read(const u8 bits) noexcept {
+			while (scratch_bits < bits) {
+				if (next == in.size()) {
+					overran = true;
+					return 0;
+				}
+
+				scratch |= static_cast<u64>(in[next++]) << scratch_bits;
+				scratch_bits += 8;
+			}
+
+			const u32 value = static_cast<u32>(scratch & ((u64{ 1 } << bits) - 1));
+
+			scratch >>= bits;
+			scratch_bits -= bits;
+
+			return value;
+		}
+
+		bool ReadBool() noexcept {
+			return Read(1) != 0;
+		}
+
+		i32 ReadRanged(const i32 min, const i32 max) noexcept {
+			return min + static_cast<i32>(Read(quantize::bits_for(static_cast<u32>(max - min))));
+		}
+
+		float ReadFixed(const float min, const float max, const u8 bits) noexcept {
+			return quantize::from_fixed(Read(bits), min, max, bits);
+		}
+
+		std::array<float, 4> ReadQuat(const u8 bits) noexcept {
+			const size_t largest = Read(2);
+
+			std::array<float, 4> q{};
+			float sum = 0;
+
+			for (size_t i = 0; i < 4; i++) {
+				if (i != largest) {
+					q[i] = ReadFixed(-quantize::quat_component_max, quantize::quat_component_max, bits);
+					sum += q[i] * q[i];
+				}
+			}
+
+			q[largest] = std::sqrt(std::max<float>(0.f, 1.f - sum));
+
+			return q;
+		}
+
+		void ReadMany(std::span<u32> values, const u8 bits) noexcept {
+			for (u32& v : values) {
+				v = Read(bits);
+			}
+		}
+
+		void ReadFixedMany(std::span<float> values, const float min, const float max, const u8 bits) noexcept {
+			for (float& v : values) {
+				v = ReadFixed(min, max, bits);
+			}
+		}
+
+		/// Reads what `BitWriter::WriteArray()` wrote, `read_one(*this)` returns an entity.
+		/// A count above `max_count` is malformed, sets `overrun()` and reads none
+		template <typename T, typename F>
+		std::vector<T> ReadArray(const u32 max_count, F&& read_one) noexcept {
+			const u32 count = Read(quantize::bits_for(max_count));
+
+			std::vector<T> entities;
+
+			if (count > max_count) {
+				overran = true;
+				return entities;
+			}
+
+			entities.reserve(count);
+
+			for (u32 i = 0; i < count && not overran; i++) {
+				entities.push_back(read_one(*this));
+			}
+
+			return entities;
+		}
+
+		constexpr bool overrun() const noexcept {
+			return overran;
+		}
+
+	private:
+		std::span<const u8> in;
+		size_t next = 0;
+
+		u64 scratch = 0;
+		u32 scratch_bits = 0;
+
+		bool overran = false;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <chrono>
+
+namespace net {
+
+	namespace detail {
+#ifdef SO_BUSY_POLL
+		using busy_poll_option = asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>;
+#endif
+	}
+
+	// Sets `SO_BUSY_POLL` on `socket` when `us` isn't 0 (Linux), a socket that can't keep it polls as usual
+	template <typename Socket>
+	void set_busy_poll(Socket& socket, const u32 us) noexcept {
+#ifdef SO_BUSY_POLL
+		if (us != 0) {
+			asio::error_code ec;
+			socket.set_option(detail::busy_poll_option(static_cast<int>(us)), ec);
+		}
+#endif
+	}
+
+	// Where a busy polling io thread's time went, see `busy_poll_config`
+	struct busy_poll_stats {
+		u64 work_ns = 0;   // running handlers
+		u64 spin_ns = 0;   // polling with nothing to run
+		u64 parked_ns = 0; // blocked for the next handler, and running it
+		u64 handlers = 0;
+		u64 parks = 0;
+	};
+
+	// Runs an io_context on the calling thread, spinning on poll() while there was work within the last `spin_us`,
+	// blocking in run_one() once there wasn't
+	class BusyPoller {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		// Returns once `ctx` stopped or ran out of work, like run()
+		void Run(asio::io_context& ctx, busy_poll_config const& config, asio::error_code& ec) noexcept {
+			const auto budget = std::chrono::microseconds(config.spin_us);
+
+			clock::time_point idle_since = clock::now();
+
+			while (not ctx.stopped()) {
+				const clock::time_point before = clock::now();
+				const size_t ran = ctx.poll(ec);
+				const clock::time_point after = clock::now();
+
+				if (ec) {
+					return;
+				}
+
+				if (ran != 0) {
+					Add(work_ns, after - before);
+					handlers.fetch_add(ran, std::memory_order_relaxed);
+
+					idle_since = after;
+					continue;
+				}
+
+				Add(spin_ns, after - before);
+
+				if (after - idle_since < budget) {
+					continue;
+				}
+
+				const size_t woke = ctx.run_one(ec);
+
+				idle_since = clock::now();
+
+				Add(parked_ns, idle_since - after);
+				handlers.fetch_add(woke, std::memory_order_relaxed);
+				parks.fetch_add(1, std::memory_order_relaxed);
+
+				if (ec) {
+					return;
+				}
+			}
+		}
+
+		// any thread
+		busy_poll_stats stats() const noexcept {
+			return {
+				work_ns.load(std::memory_order_relaxed),
+				spin_ns.load(std::memory_order_relaxed),
+				parked_ns.load(std::memory_order_relaxed),
+				handlers.load(std::memory_order_relaxed),
+				parks.load(std::memory_order_relaxed)
+			};
+		}
+
+	private:
+		static void Add(std::atomic<u64>& total, const clock::duration d) noexcept {
+			total.fetch_add(static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()), std::memory_order_relaxed);
+		}
+
+		std::atomic<u64> work_ns{ 0 };
+		std::atomic<u64> spin_ns{ 0 };
+		std::atomic<u64> parked_ns{ 0 };
+		std::atomic<u64> handlers{ 0 };
+		std::atomic<u64> parks{ 0 };
+	};
+}
\ No newline at end of file
@@ -15,12 +15,19 @@
 #define _WIN32_WINNT 0x0A00
 #endif
 
+// asio on io_uring instead of epoll (Linux, liburing), see `io_uring_backend`.
+// asio's reactor is picked by the build for every translation unit, the same way, never by this header
+#if defined(HCNET_IO_URING) && !(defined(ASIO_HAS_IO_URING) && defined(ASIO_DISABLE_EPOLL))
+#error "HCNET_IO_URING needs ASIO_HAS_IO_URING and ASIO_DISABLE_EPOLL defined for the whole target"
+#endif
+
 #include "asio.hpp"
 #include "gef.hpp"
 #include "concurrentqueue/blockingconcurrentqueue.h"
 
 // lib
 #include "error.hpp"
+#include "config.hpp"
 
 using namespace asio::ip;
 
@@ -122,6 +129,50 @@ namespace net {
 		udp
 	};
 
+	// Out-going priority lanes, a socket always drains the higher lanes first
+	enum class lane : u8 {
+		critical,
+		normal,
+		bulk
+	};
+
+	inline constexpr size_t lane_count = 3;
+
+	namespace detail {
+		inline constexpr size_t cache_line = 64;
+	}
+
+	// Message types reserved by the library, applications' message types must be non-negative
+	struct control_msg {
+		enum type : i16 {
+			fragment = -1,       // a slice of a bulk TCP packet, the packet is rebuilt once all slices arrived
+
+			mesh_register = -2,  // client -> host, `mesh_register`
+			mesh_welcome = -3,   // host -> client, header only, `from_id` is the client's own id
+			mesh_peer = -4,      // host -> client, `mesh_peer`
+			mesh_peer_left = -5, // host -> client, header only, `from_id` left the mesh
+			mesh_path = -6,      // client -> host, `mesh_path`
+			mesh_probe = -7,     // peer <-> peer (UDP), carries the pair's `mesh_peer::token` and the sender's timestamp
+			mesh_probe_ack = -8, // peer <-> peer (UDP), echoes the probe's token and timestamp
+
+			relay = -9,          // host -> relay -> subtree (UDP), a broadcast datagram to deliver and forward
+			relay_assign = -10,  // host -> client, `relay_assign`
+
+			framing = -11,       // client -> host -> client, header only, handshake: `size` is the requested / granted `framing`
+
+			heartbeat = -12,     // either way, header only, sent when nothing else was for `keepalive_config::interval_ms`
+
+			shm_offer = -13,     // client -> host, `shm_offer`, the client's segment (see `shm_config`)
+			shm_switch = -14,    // either way, `shm_switch`, the sender's last packet through the sockets before the segment
+
+			file_offer = -15,    // host -> client, `file_offer`, a file the host streams (see `Host::SendFile`)
+			file_accept = -16,   // client -> host, `file_accept`, the offset the transfer starts, or resumes, from
+			file_chunk = -17,    // host -> client, `file_chunk_prefix` then the data, in the bulk lane
+			file_ack = -18,      // client -> host, `file_ack`, opens the host's window
+			file_cancel = -19    // either way, `file_cancel`, declines an offer or ends a transfer
+		};
+	};
+
 	template <typename Header>
 	struct packet_tcp {
 	public:
@@ -163,9 +214,15 @@ namespace net {
 			);
 		}
 
+		// Fills in `h` as a send would, for a packet handed over as its message object, nothing is copied
+		void fill_header() noexcept {
+			static_cast<void>(const_buf_seq());
+		}
+
 	public:
 		gef::option<gef::unique_ref<any_msg>> m;
 		Header h;
+		lane priority = lane::normal;
 	};
 
 	template <typename Header>
@@ -192,6 +249,11 @@ namespace net {
 			return vec;
 		}
 
+		// See packet_tcp's
+		void fill_header() noexcept {
+			static_cast<void>(const_buf_seq());
+		}
+
 		std::vector<mut_buf> mut_buf_seq() noexcept {
 			auto vec = m->mut_buf_seq_with_header(h.msg_type);
 
@@ -203,5 +265,6 @@ namespace net {
 	public:
 		gef::unique_ref<any_msg> m;
 		Header h;
+		lane priority = lane::normal;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,440 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#ifdef _WIN32
+#include "win32.hpp"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace net {
+
+	enum class capture_direction : u8 {
+		in,
+		out
+	};
+
+	struct capture_file_header {
+		inline static constexpr std::array<char, 8> expected_magic{ 'h', 'c', 'n', 'e', 't', 'c', 'a', 'p' };
+		inline static constexpr u32 current_version = 1;
+
+		std::array<char, 8> magic;
+		u32 version;
+		u32 record_header_size;
+		i64 started_unix_ns; // a record's `time_ns` is relative to this
+	};
+
+	// Precedes every captured packet, the packet is the header and the body as they were on the wire
+	struct capture_record {
+		i64 time_ns;
+		u32 size;       // of the packet, 0 until the record is complete
+		i16 wire;       // the wire's id on a host, -1 on a client
+		protocol proto;
+		capture_direction direction;
+	};
+
+	namespace detail {
+		constexpr size_t capture_align(const size_t size) noexcept {
+			return (size + 7) & ~size_t{ 7 };
+		}
+
+		inline std::error_code last_system_error() noexcept {
+#ifdef _WIN32
+			return { static_cast<int>(::GetLastError()), std::system_category() };
+#else
+			return { errno, std::system_category() };
+#endif
+		}
+
+		// A file mapped whole into memory
+		class mapped_file {
+		public:
+
+			mapped_file() noexcept {}
+
+			mapped_file(mapped_file const&) = delete;
+
+			~mapped_file() noexcept {
+				Close();
+			}
+
+			// writable - creates / truncates the file to `size`, otherwise maps the existing file as it is
+			std::error_code Open(std::string const& path, size_t size, const bool writable) noexcept {
+#ifdef _WIN32
+				file = ::CreateFileA(path.c_str(),
+					writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+					FILE_SHARE_READ, nullptr,
+					writable ? CREATE_ALWAYS : OPEN_EXISTING,
+					FILE_ATTRIBUTE_NORMAL, nullptr);
+
+				if (file == INVALID_HANDLE_VALUE) {
+					return last_system_error();
+				}
+
+				if (not writable) {
+					LARGE_INTEGER file_size;
+					::GetFileSizeEx(file, &file_size);
+					size = static_cast<size_t>(file_size.QuadPart);
+				}
+
+				if (size == 0) {
+					return {};
+				}
+
+				mapping = ::CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+					static_cast<DWORD>(static_cast<u64>(size) >> 32), static_cast<DWORD>(size), nullptr);
+
+				if (mapping == nullptr) {
+					return last_system_error();
+				}
+
+				view = ::MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+
+				if (view == nullptr) {
+					return last_system_error();
+				}
+#else
+				fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+
+				if (fd < 0) {
+					return last_system_error();
+				}
+
+				if (writable) {
+					if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+						return last_system_error();
+					}
+				}
+				else {
+					struct stat st;
+
+					if (::fstat(fd, &st) != 0) {
+						return last_system_error();
+					}
+
+					size = static_cast<size_t>(st.st_size);
+				}
+
+				if (size == 0) {
+					return {};
+				}
+
+				void* addr = ::mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+				if (addr == MAP_FAILED) {
+					return last_system_error();
+				}
+
+				view = addr;
+#endif
+				mapped_size = size;
+
+				return {};
+			}
+
+			// keep_size - the file is truncated to it, 0 keeps the whole mapping
+			void Close(const size_t keep_size = 0) noexcept {
+#ifdef _WIN32
+				if (view != nullptr) { ::UnmapViewOfFile(view); }
+				if (mapping != nullptr) { ::CloseHandle(mapping); }
+
+				if (file != INVALID_HANDLE_VALUE) {
+					if (keep_size != 0) {
+						LARGE_INTEGER end;
+						end.QuadPart = static_cast<LONGLONG>(keep_size);
+						::SetFilePointerEx(file, end, nullptr, FILE_BEGIN);
+						::SetEndOfFile(file);
+					}
+
+					::CloseHandle(file);
+				}
+
+				mapping = nullptr;
+				file = INVALID_HANDLE_VALUE;
+#else
+				if (view != nullptr) { ::munmap(view, mapped_size); }
+
+				if (fd >= 0) {
+					if (keep_size != 0) {
+						[[maybe_unused]] int ignored = ::ftruncate(fd, static_cast<off_t>(keep_size));
+					}
+
+					::close(fd);
+				}
+
+				fd = -1;
+#endif
+				view = nullptr;
+				mapped_size = 0;
+			}
+
+			constexpr u8* data() const noexcept {
+				return static_cast<u8*>(view);
+			}
+
+			constexpr size_t size() const noexcept {
+				return mapped_size;
+			}
+
+		private:
+#ifdef _WIN32
+			HANDLE file = INVALID_HANDLE_VALUE;
+			HANDLE mapping = nullptr;
+#else
+			int fd = -1;
+#endif
+			void* view = nullptr;
+			size_t mapped_size = 0;
+		};
+	}
+
+	// Append-only trace of packets, in a file mapped into memory.
+	//
+	// * thread safe, recording a packet is a `fetch_add` and a copy into the mapping, no lock and no system call
+	// * the file has a fixed capacity, packets that don't fit are counted in `dropped()`
+	// * the file is truncated to what was recorded once closed
+	class CaptureFile {
+	public:
+
+		CaptureFile() noexcept {}
+
+		~CaptureFile() noexcept {
+			Close();
+		}
+
+		std::error_code Open(std::string const& path, const size_t capacity) noexcept {
+			if (std::error_code ec = file.Open(path, detail::capture_align(sizeof(capture_file_header)) + capacity, true)) {
+				file.Close();
+				return ec;
+			}
+
+			started = std::chrono::steady_clock::now();
+
+			capture_file_header h{
+				capture_file_header::expected_magic,
+				capture_file_header::current_version,
+				sizeof(capture_record),
+				std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()
+			};
+
+			std::memcpy(file.data(), &h, sizeof(h));
+
+			tail = detail::capture_align(sizeof(capture_file_header));
+
+			return {};
+		}
+
+		void Close() noexcept {
+			file.Close(std::min<u64>(tail, file.size()));
+		}
+
+		// The concatenation of `parts` (buffer sequences) is the packet
+		template <typename ...Parts>
+		void Record(const i16 wire, const protocol proto, const capture_direction direction, Parts const& ...parts) noexcept {
+			const size_t size = (asio::buffer_size(parts) + ...);
+			const size_t space = detail::capture_align(sizeof(capture_record) + size);
+
+			const u64 at = tail.fetch_add(space, std::memory_order_relaxed);
+
+			if (at + space > file.size()) {
+				dropped_packets.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			u8* record = file.data() + at;
+
+			capture_record r{
+				std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count(),
+				0,
+				wire,
+				proto,
+				direction
+			};
+
+			std::memcpy(record, &r, sizeof(r));
+
+			u8* out = record + sizeof(capture_record);
+
+			auto append = [&](auto const& part) {
+				out += asio::buffer_copy(mut_buf{ out, asio::buffer_size(part) }, part);
+			};
+
+			(append(parts), ...);
+
+			// complete, a reader stops at the first record with no size
+			std::atomic_ref<u32>(reinterpret_cast<capture_record*>(record)->size).store(static_cast<u32>(size), std::memory_order_release);
+		}
+
+		constexpr bool is_open() const noexcept {
+			return file.data() != nullptr;
+		}
+
+		u64 recorded_bytes() const noexcept {
+			return std::min<u64>(tail, file.size());
+		}
+
+		u64 dropped() const noexcept {
+			return dropped_packets;
+		}
+
+	private:
+		detail::mapped_file file;
+
+		std::chrono::steady_clock::time_point started;
+
+		std::atomic<u64> tail{ 0 };
+		std::atomic<u64> dropped_packets{ 0 };
+	};
+
+	// The running capture of a host or a client, replaced or stopped while the sockets record into it.
+	//
+	// * a recorder holds a `ref` while it records, taking one when nothing is captured is a single load
+	// * Replace() closes and frees the previous capture once every recorder that could have seen it let go,
+	//   the recorders are counted in two generations, flipped twice so the ones still arriving can't hold it up
+	// * Replace() is called from one thread at a time
+	class CaptureSlot {
+	public:
+
+		class ref {
+		public:
+
+			explicit ref(CaptureSlot& slot) noexcept {
+				if (slot.current.load(std::memory_order_relaxed) == nullptr) {
+					return;
+				}
+
+				generation = slot.generation.load();
+				users = &slot.users[generation];
+
+				// seq_cst, either Replace() waits for this recorder or the recorder sees the next capture
+				users->fetch_add(1);
+				file = slot.current.load();
+			}
+
+			ref(ref const&) = delete;
+
+			~ref() noexcept {
+				if (users != nullptr) {
+					users->fetch_sub(1, std::memory_order_release);
+				}
+			}
+
+			explicit operator bool() const noexcept {
+				return file != nullptr;
+			}
+
+			CaptureFile* operator->() const noexcept {
+				return file;
+			}
+
+			CaptureFile& operator*() const noexcept {
+				return *file;
+			}
+
+		private:
+			CaptureFile* file = nullptr;
+			std::atomic<u32>* users = nullptr;
+			u32 generation = 0;
+		};
+
+		CaptureSlot() noexcept {}
+
+		CaptureSlot(CaptureSlot const&) = delete;
+
+		~CaptureSlot() noexcept {
+			delete current.load();
+		}
+
+		// `next` (nullptr stops capturing) takes the place of the running capture, which is truncated, unmapped and freed
+		// once the packets being recorded into it are
+		void Replace(std::unique_ptr<CaptureFile> next) noexcept {
+			std::unique_ptr<CaptureFile> previous{ current.exchange(next.release()) };
+
+			if (not previous) {
+				return;
+			}
+
+			for (int flip = 0; flip < 2; flip++) {
+				const u32 draining = generation.load();
+
+				generation.store(draining ^ 1);
+
+				while (users[draining].load(std::memory_order_acquire) != 0) {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	private:
+		std::atomic<CaptureFile*> current{ nullptr };
+
+		std::atomic<u32> generation{ 0 };
+		std::array<std::atomic<u32>, 2> users{};
+	};
+
+	// Reads a trace written by `CaptureFile`
+	class CaptureReader {
+	public:
+
+		std::error_code Open(std::string const& path) noexcept {
+			if (std::error_code ec = file.Open(path, 0, false)) {
+				file.Close();
+				return ec;
+			}
+
+			if (file.size() < sizeof(capture_file_header)) {
+				file.Close();
+				return std::make_error_code(std::errc::invalid_argument);
+			}
+
+			std::memcpy(&h, file.data(), sizeof(h));
+
+			if (h.magic != capture_file_header::expected_magic
+				|| h.version != capture_file_header::current_version
+				|| h.record_header_size != sizeof(capture_record))
+			{
+				file.Close();
+				return std::make_error_code(std::errc::invalid_argument);
+			}
+
+			return {};
+		}
+
+		constexpr capture_file_header const& header() const noexcept {
+			return h;
+		}
+
+		// f(capture_record const&, const_buf packet), in the order the records were reserved
+		template <typename F>
+		void for_each(F&& f) const noexcept {
+			size_t at = detail::capture_align(sizeof(capture_file_header));
+
+			while (at + sizeof(capture_record) <= file.size()) {
+				capture_record r;
+				std::memcpy(&r, file.data() + at, sizeof(r));
+
+				if (r.size == 0 || at + sizeof(capture_record) + r.size > file.size()) {
+					break;
+				}
+
+				f(r, const_buf{ file.data() + at + sizeof(capture_record), r.size });
+
+				at += detail::capture_align(sizeof(capture_record) + r.size);
+			}
+		}
+
+	private:
+		detail::mapped_file file;
+		capture_file_header h{};
+	};
+}
\ No newline at end of file
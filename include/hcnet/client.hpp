@@ -2,6 +2,11 @@
 
 #include "canyon.hpp"
 #include "socket.hpp"
+#include "mesh.hpp"
+#include "tick.hpp"
+#include "busy_poll.hpp"
+#include "thread.hpp"
+#include "events.hpp"
 
 namespace net {
 
@@ -15,64 +20,121 @@ public:
 	using PacketTCPserver = packet_tcp<header_server_TCP>;
 	using PacketUDPserver = packet_udp<header_server_UDP>;
 
-	Client() noexcept :
+	using Event = net_event<PacketTCPserver, PacketUDPserver>;
+
+	Client(client_config const& config = {}) noexcept :
+		m_own_context(std::make_unique<asio::io_context>()),
+		m_context(*m_own_context),
 		connected(false),
-		tcp_socket(*this, m_context),
-		udp_socket(*this, m_context)
+		tcp_socket(*this, m_context, config.tcp_queue, config.io_writes),
+		udp_socket(*this, m_context, config.udp_queue, config.io_writes),
+		mesh_socket(*this, m_context, config.mesh),
+		m_ticks(*this, m_context),
+		m_keepalive_timer(m_context),
+		m_config(config)
+	{}
+
+	// Runs on `shared`, no thread of its own, the sockets write from `shared`'s threads too.
+	// Many clients can share a few threads this way (e.g. a load generator).
+	// - The owner runs `shared`, and destroys the client only once `shared` stopped
+	Client(asio::io_context& shared, client_config const& config = {}) noexcept :
+		m_context(shared),
+		connected(false),
+		tcp_socket(*this, m_context, config.tcp_queue, true),
+		udp_socket(*this, m_context, config.udp_queue, true),
+		mesh_socket(*this, m_context, config.mesh),
+		m_ticks(*this, m_context),
+		m_keepalive_timer(m_context),
+		m_config(config)
 	{}
 
 	~Client() noexcept {
-		Stop();
+		if (m_own_context) {
+			Stop();
+		}
 	}
 
 private:
 
 	friend SocketTCP<Client, gef::unique_ref, header_client_TCP, header_server_TCP>;
 	friend SocketUDP<Client, gef::unique_ref, header_client_UDP, header_server_UDP>;
+	friend MeshSocket<Client>;
+	friend TickScheduler<Client>;
 
-	asio::io_context m_context;
+	std::unique_ptr<asio::io_context> m_own_context; // null on a shared context
+	asio::io_context& m_context;
 	std::thread m_self_thread;
 
+	CaptureSlot m_capture; // the running capture, see StartCapture()
+
 	SocketTCP<Client, gef::unique_ref, header_client_TCP, header_server_TCP> tcp_socket;
 	SocketUDP<Client, gef::unique_ref, header_client_UDP, header_server_UDP> udp_socket;
+	MeshSocket<Client> mesh_socket;
 
-	bool connected;
+	TickScheduler<Client> m_ticks;
 
-public:
+	// Send()s waiting for the end of the tick, see `tick_config::coalesce`
+	struct held_output {
+		std::vector<gef::unique_ref<PacketTCP>> tcp;
+		std::vector<gef::unique_ref<PacketUDP>> udp;
+	};
 
-	void Start(std::string const& host_ip, const u16 port, gef::unique_ref<PacketTCP> cinfo) noexcept {
+	gef::mutex<held_output> m_held;
 
-		tcp::endpoint endpoint{ asio::ip::make_address(host_ip), port };
+	// Send()s made while the handshake runs, sent right after it completed
+	gef::mutex<held_output> m_pending;
+	std::atomic<bool> handshaking{ false };
 
-		tcp_socket.socket.async_connect(endpoint,
-			[this, cinfo = std::move(cinfo)](asio::error_code ec) mutable {
-				if (ec) {
-					access_clienter().on_error({ net::net_error::failed_to_connect, ec });
-					return;
-				}
+	// see `keepalive_config`, ms on `elapsed_ms()`
+	asio::steady_timer m_keepalive_timer;
+	const std::chrono::steady_clock::time_point m_epoch = std::chrono::steady_clock::now();
+	std::atomic<i64> last_in_ms{ 0 };
+	std::atomic<i64> last_out_ms{ 0 };
 
-				auto const& local_endpoint = tcp_socket.socket.local_endpoint();
-				auto const& remote_endpoint = tcp_socket.socket.remote_endpoint();
+	BusyPoller m_poller; // own context only
 
-				ec = udp_socket.OpenBindConnect(
-					udp::endpoint(local_endpoint.address(), local_endpoint.port()),
-					udp::endpoint(remote_endpoint.address(), remote_endpoint.port())
-				);
+	EventQueue<Event> m_events; // see `client_config::pull_events`
 
-				if (ec) {
-					access_clienter().on_error({ net::net_error::failed_to_connect, ec });
-					return;
-				}
+	client_config m_config;
 
-				CinfoWrite(std::move(cinfo));
+	header_client_TCP framing_request{}; // see `client_config::header_framing`
+
+	std::atomic<bool> connected;
+
+	// see `client_config::shm`, after the sockets: its reader, delivering into them, is joined before they're gone
+	std::unique_ptr<ShmLink> m_shm;
+
+	std::vector<file_download> m_downloads; // see on_file_offer(), io thread only
+
+public:
+
+	void Start(std::string const& host_ip, const u16 port, gef::unique_ref<PacketTCP> cinfo) noexcept {
+
+		tcp::endpoint endpoint{ asio::ip::make_address(host_ip), port };
+
+		handshaking = true;
+
+		// on a shared context, the connect starts from one of its threads
+		asio::post(m_context,
+			[this, endpoint, cinfo = std::move(cinfo)]() mutable {
+				Connect(endpoint, std::move(cinfo));
 			});
 
+		if (not m_own_context) {
+			return;
+		}
 
 		// actually start
-		m_self_thread = std::thread(
+		m_self_thread = spawn_thread(m_config.threads, thread_role::io, "hcnet-io",
 			[this]() {
 				asio::error_code ec;
-				m_context.run(ec);
+
+				if (m_config.busy_poll.enabled) {
+					m_poller.Run(m_context, m_config.busy_poll, ec);
+				}
+				else {
+					m_context.run(ec);
+				}
 
 				if (ec) {
 					access_clienter().on_error({ net_error::failed_to_run_io_context, ec });
@@ -82,27 +144,281 @@ public:
 
 	// Stops the client.
 	// Call Start() to restart the client.
+	// - On a shared context, closes the connection and returns, the context keeps running
 	void Stop() noexcept {
+		if (not m_own_context) {
+			asio::post(m_context,
+				[this]() {
+					asio::error_code ec = asio::error::eof;
+					Close({ net_error::failed_to_read, ec });
+				});
+			return;
+		}
+
 		if (not m_context.stopped()) { m_context.stop(); }
 
 		if (m_self_thread.joinable()) { m_self_thread.join(); }
+
+		DropPending();
+
+		StopShm();
+
+		m_ticks.Stop();
+		m_keepalive_timer.cancel();
+
+		m_held.lock([](held_output& held) { held = {}; });
+	}
+
+	// Where the io thread's time went while busy polling (see `busy_poll_config`), zeros otherwise
+	busy_poll_stats poll_stats() const noexcept {
+		return m_poller.stats();
+	}
+
+	// Pull mode (see `client_config::pull_events`), moves up to `out.size()` queued events into `out`, returns how many.
+	// Call from one thread, e.g. once per frame of the game loop
+	size_t PollEvents(std::span<Event> out) noexcept {
+		return m_events.Poll(out);
+	}
+
+	// Pull mode, `f(Event&)` for up to `max` queued events, returns how many. Same thread as PollEvents()
+	template <typename F>
+	size_t ForEachEvent(F&& f, const size_t max = std::numeric_limits<size_t>::max()) noexcept {
+		return m_events.ForEach(std::forward<F>(f), max);
 	}
 
 	constexpr bool is_connected() const noexcept {
 		return connected;
 	}
 
-	constexpr void Send(gef::unique_ref<PacketTCP> p) noexcept {
+	constexpr size_t queued_bytes(const protocol proto) const noexcept {
+		return proto == protocol::tcp
+			? tcp_socket.queue().bytes()
+			: udp_socket.queue().bytes();
+	}
+
+	// Between Start() and the end of the handshake, `p` is held and sent once the handshake completes.
+	// Before Start(), or once the connection closed, `p` is dropped
+	constexpr void Send(gef::unique_ref<PacketTCP> p, const lane priority = lane::normal) noexcept {
+		p->priority = priority;
+
+		last_out_ms.store(elapsed_ms(), std::memory_order_relaxed);
+
+		if (HoldForHandshake(p)) {
+			return;
+		}
+
+		Dispatch(std::move(p));
+	}
+
+	// With the mesh, `p` also goes straight to the peers that have a direct path,
+	// the host relays it only to the rest. Held during the handshake like the TCP Send()
+	constexpr void Send(gef::unique_ref<PacketUDP> p, const lane priority = lane::normal) noexcept {
+		p->priority = priority;
+
+		last_out_ms.store(elapsed_ms(), std::memory_order_relaxed);
+
+		if (HoldForHandshake(p)) {
+			return;
+		}
+
+		Dispatch(std::move(p));
+	}
+
+	// Sends the Send()s held for the end of the tick right away, in the order they were sent.
+	// Runs after every `on_tick`
+	void Flush() noexcept {
+		held_output out;
+
+		m_held.lock([&](held_output& held) { std::swap(out, held); });
+
+		for (auto& p : out.tcp) {
+			tcp_socket.Send(std::move(p));
+		}
+
+		for (auto& p : out.udp) {
+			SendUDP(std::move(p));
+		}
+	}
+
+	constexpr bool holds_output() const noexcept {
+		return m_config.tick.rate_hz != 0 && m_config.tick.coalesce;
+	}
+
+	// Records every packet, in and out, into a trace at `path` (see `CaptureFile`) until StopCapture().
+	// Replaces a running capture, call from one thread.
+	std::error_code StartCapture(std::string const& path, const size_t capacity = 256 * 1024 * 1024) noexcept {
+		auto file = std::make_unique<CaptureFile>();
+
+		if (std::error_code ec = file->Open(path, capacity)) {
+			return ec;
+		}
+
+		m_capture.Replace(std::move(file));
+
+		return {};
+	}
+
+	// Waits for the packets being recorded, then truncates the trace to what was recorded, unmaps and frees it.
+	void StopCapture() noexcept {
+		m_capture.Replace(nullptr);
+	}
+
+	// Ends a file the host streams (see `Host::SendFile`), what was written is kept to resume from. Any thread
+	void CancelFile(const u32 transfer) noexcept {
+		asio::post(m_context,
+			[this, transfer]() {
+				auto it = std::ranges::find(m_downloads, transfer, &file_download::id);
+
+				if (it != m_downloads.end()) {
+					SendFileCancel(transfer);
+					EndDownload(it, false);
+				}
+			});
+	}
+
+	// number of peers reached without the host, see `mesh_config`
+	size_t direct_peers() noexcept {
+		return mesh_socket.direct_peers();
+	}
+
+private:
+
+	// Holds `p` in `m_pending` while the handshake runs, returns false once it's done (or never started)
+	template <typename P>
+	bool HoldForHandshake(P& p) noexcept {
+		if (not handshaking.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		bool held = false;
+
+		m_pending.lock(
+			[&](held_output& pending) {
+				if (not handshaking) { // completed meanwhile
+					return;
+				}
+
+				if constexpr (std::same_as<P, gef::unique_ref<PacketTCP>>) {
+					pending.tcp.push_back(std::move(p));
+				}
+				else {
+					pending.udp.push_back(std::move(p));
+				}
+
+				held = true;
+			});
+
+		return held;
+	}
+
+	// The handshake completed, the held Send()s go out before any made from now on
+	void SendPending() noexcept {
+		m_pending.lock(
+			[&](held_output& pending) {
+				for (auto& p : pending.tcp) {
+					Dispatch(std::move(p));
+				}
+
+				for (auto& p : pending.udp) {
+					Dispatch(std::move(p));
+				}
+
+				pending = {};
+				handshaking = false;
+			});
+	}
+
+	// Holds `p` for the end of the tick, or sends it
+	void Dispatch(gef::unique_ref<PacketTCP> p) noexcept {
+		if (holds_output()) {
+			m_held.lock([&](held_output& held) { held.tcp.push_back(std::move(p)); });
+			return;
+		}
+
 		tcp_socket.Send(std::move(p));
 	}
 
-	constexpr void Send(gef::unique_ref<PacketUDP> p) noexcept {
+	void Dispatch(gef::unique_ref<PacketUDP> p) noexcept {
+		if (holds_output()) {
+			m_held.lock([&](held_output& held) { held.udp.push_back(std::move(p)); });
+			return;
+		}
+
+		SendUDP(std::move(p));
+	}
+
+	// The handshake failed, or the connection closed
+	void DropPending() noexcept {
+		m_pending.lock(
+			[this](held_output& pending) {
+				pending = {};
+				handshaking = false;
+			});
+	}
+
+	constexpr void SendUDP(gef::unique_ref<PacketUDP> p) noexcept {
+		if (mesh_socket.is_running()) {
+			mesh_socket.SendDirect(*p);
+		}
+
 		udp_socket.Send(std::move(p));
 	}
 
-private:
+	// TickScheduler, on the io thread
+	void Tick(const u64 tick_no, const double dt) noexcept {
+		if constexpr (requires { access_clienter().on_tick(tick_no, dt); }) {
+			access_clienter().on_tick(tick_no, dt);
+		}
+
+		Flush();
+	}
+
+	void TickOverrun(const u64 tick_no, const u64 skipped) noexcept {
+		if constexpr (requires { access_clienter().on_tick_overrun(tick_no, skipped); }) {
+			access_clienter().on_tick_overrun(tick_no, skipped);
+		}
+	}
+
+	i64 elapsed_ms() const noexcept {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+	}
+
+	// Closes a host that sent nothing for `timeout_ms` with `net_error::timed_out`,
+	// sends a heartbeat when nothing was sent for `interval_ms`
+	void KeepaliveTimer() noexcept {
+		m_keepalive_timer.expires_after(std::chrono::milliseconds(std::max<u32>(m_config.keepalive.resolution_ms, 1)));
+
+		m_keepalive_timer.async_wait(
+			[this](asio::error_code ec) {
+				if (ec || not connected) {
+					return;
+				}
+
+				const i64 now_ms = elapsed_ms();
+
+				if (m_config.keepalive.timeout_ms != 0 && now_ms - last_in_ms >= m_config.keepalive.timeout_ms) {
+					ec = asio::error::timed_out;
+					Close({ net_error::timed_out, ec });
+					return;
+				}
+
+				if (m_config.keepalive.interval_ms != 0 && now_ms - last_out_ms >= m_config.keepalive.interval_ms) {
+					auto heartbeat = gef::unique_ref<PacketTCP>::make(control_msg::heartbeat);
+					heartbeat->priority = lane::critical;
+
+					tcp_socket.Send(std::move(heartbeat));
+					last_out_ms = now_ms;
+				}
+
+				KeepaliveTimer();
+			});
+	}
 
 	constexpr gef::option<gef::unique_ref<any_msg>> builder_TCP(header_server_TCP const& h) noexcept {
+		if (h.msg_type < 0) {
+			return detail::build_control(h);
+		}
+
 		return access_clienter().builder_TCP(h);
 	}
 
@@ -111,23 +427,104 @@ private:
 	}
 
 	constexpr void NewPacketTCP(gef::unique_ref<PacketTCPserver>&& p) noexcept {
+		last_in_ms.store(elapsed_ms(), std::memory_order_relaxed);
+
+		if (p->h.msg_type < 0) {
+			Control(std::move(p));
+			return;
+		}
+
+		if (m_config.pull_events) {
+			const i16 from_id = p->h.from_id;
+			m_events.Push({ .kind = event_kind::packet_tcp, .from_id = from_id, .tcp = std::move(p) });
+			return;
+		}
+
 		access_clienter().new_packet_TCP(std::forward<decltype(p)>(p));
 	}
 
 	constexpr bool NewPacketUDP(gef::unique_ref<PacketUDPserver>&& p) noexcept {
+		last_in_ms.store(elapsed_ms(), std::memory_order_relaxed);
+
+		if (m_config.pull_events) {
+			const i16 from_id = p->h.from_id;
+			m_events.Push({ .kind = event_kind::packet_udp, .from_id = from_id, .udp = std::move(p) });
+			return true;
+		}
+
 		return access_clienter().new_packet_UDP(std::forward<decltype(p)>(p));
 	}
 
+	// congested - the send queue crossed its high-water mark, or drained back below half of it
+	constexpr void QueuePressure(const protocol proto, const bool congested) noexcept {
+		if constexpr (requires { access_clienter().on_send_queue_pressure(proto, congested); }) {
+			access_clienter().on_send_queue_pressure(proto, congested);
+		}
+	}
+
+	// reports a direct path to `peer` going up or down, the host relays accordingly
+	void MeshPathChanged(const i16 peer, const bool up, const u32 rtt_us) noexcept {
+		Send(
+			gef::unique_ref<PacketTCP>::make(
+				gef::unique_ref<msg<mesh_path>>::make( mesh_path{ peer, up, rtt_us } )
+			), lane::critical);
+	}
+
+	CaptureSlot::ref capture() noexcept {
+		return CaptureSlot::ref{ m_capture };
+	}
+
+	constexpr i16 capture_id() const noexcept {
+		return -1;
+	}
+
+	constexpr thread_config const& threads() const noexcept {
+		return m_config.threads;
+	}
+
+	constexpr size_t max_message_bytes() const noexcept {
+		return m_config.max_message_bytes;
+	}
+
+	// the host's datagrams with a negative type, runs on the io thread
+	void ControlUDP(const_buf datagram) noexcept {
+		header_server_UDP h;
+		std::memcpy(&h, datagram.data(), header_server_UDP::header_size);
+
+		if (h.msg_type == control_msg::relay) {
+			mesh_socket.Relay(datagram);
+		}
+	}
+
 	void Close(error_info const& err) noexcept {
 
+		DropPending();
+
 		if (tcp_socket.socket.is_open()) {
+			StopShm();
+
 			tcp_socket.socket.shutdown(tcp::socket::shutdown_both);
 			tcp_socket.socket.close();
 
 			udp_socket.socket.close(); // udp can just be closed
 
+			mesh_socket.Stop();
+			m_ticks.Stop();
+			m_keepalive_timer.cancel();
+
 			connected = false;
 
+			m_held.lock([](held_output& held) { held = {}; });
+
+			while (not m_downloads.empty()) {
+				EndDownload(m_downloads.begin(), false);
+			}
+
+			if (m_config.pull_events) {
+				m_events.Push(detail::close_event<Event>(-1, err));
+				return;
+			}
+
 			access_clienter().on_close_connection(
 				err.ec.and_then<error_info const&>( // ?? fails to deduce `U` (option<U>)
 					[&](auto const& ec) -> gef::option<error_info const&> {
@@ -140,10 +537,320 @@ private:
 
 private:
 
+	// Handles the library's control messages, runs on the io thread
+	void Control(gef::unique_ref<PacketTCPserver> p) noexcept {
+		switch (p->h.msg_type) {
+		case control_msg::mesh_welcome:
+			mesh_socket.Start(p->h.from_id);
+			break;
+		case control_msg::mesh_peer:
+			p->m.inspect(
+				[&](gef::unique_ref<any_msg> const& m) {
+					mesh_socket.AddPeer(m->as<mesh_peer>().inner);
+				});
+			break;
+		case control_msg::mesh_peer_left:
+			mesh_socket.RemovePeer(p->h.from_id);
+			break;
+		case control_msg::relay_assign:
+			p->m.inspect(
+				[&](gef::unique_ref<any_msg> const& m) {
+					mesh_socket.Assign(m->as<relay_assign>().inner);
+				});
+			break;
+		case control_msg::shm_switch:
+			p->m.inspect(
+				[&](gef::unique_ref<any_msg> const& m) {
+					ShmSwitch(m->as<shm_switch>().inner.accepted != 0);
+				});
+			break;
+		case control_msg::file_offer:
+			p->m.inspect(
+				[&](gef::unique_ref<any_msg> const& m) {
+					FileOffered(m->as<file_offer>().inner);
+				});
+			break;
+		case control_msg::file_chunk:
+			p->m.inspect(
+				[&](gef::unique_ref<any_msg> const& m) {
+					FileChunk(static_cast<detail::file_chunk_in const&>(m.get()));
+				});
+			break;
+		case control_msg::file_cancel:
+			p->m.inspect(
+				[&](gef::unique_ref<any_msg> const& m) {
+					auto it = std::ranges::find(m_downloads, m->as<file_cancel>().inner.transfer, &file_download::id);
+
+					if (it != m_downloads.end()) {
+						EndDownload(it, false);
+					}
+				});
+			break;
+		}
+	}
+
+	// The host offers a file, `on_file_offer(offer)` returns the path it's written to, or gef::nullopt to decline it.
+	// What the file already holds is kept and the host sends the rest only if an earlier transfer of the same file left it:
+	// stamped with the offer's last write time (see FileChunk()), no longer than it. Anything else starts over.
+	// Whole seconds are compared, some file systems keep no finer
+	void FileOffered(file_offer const& offer) noexcept {
+		gef::option<std::string> path = gef::nullopt;
+
+		if constexpr (requires { access_clienter().on_file_offer(offer); }) {
+			path = access_clienter().on_file_offer(offer);
+		}
+
+		if (path.is_null()) {
+			SendFileCancel(offer.transfer);
+			return;
+		}
+
+		auto file = std::make_unique<detail::stream_file>();
+
+		std::error_code ec = file->Open(path.value_unchecked(), true);
+
+		const bool resumable = offer.modified != 0 && file->size() <= offer.size
+			&& file->modified() / 1'000'000'000 == offer.modified / 1'000'000'000;
+
+		if (not ec && file->size() != 0 && not resumable) {
+			ec = file->Truncate(0);
+		}
+
+		if (ec) {
+			access_clienter().on_error({ net_error::file_transfer, ec });
+			SendFileCancel(offer.transfer);
+			return;
+		}
+
+		const u64 offset = file->size();
+
+		m_downloads.push_back(file_download{ offer.transfer, std::move(file), offer.size, offer.modified, offset });
+
+		Send(
+			gef::unique_ref<PacketTCP>::make(
+				gef::unique_ref<msg<file_accept>>::make( file_accept{ offer.transfer, offset } )
+			), lane::critical);
+
+		if constexpr (requires { access_clienter().on_file_progress(offer.transfer, offset, offer.size); }) {
+			access_clienter().on_file_progress(offer.transfer, offset, offer.size);
+		}
+
+		if (offset == offer.size) { // nothing left, the host ends it on the accept
+			EndDownload(m_downloads.end() - 1, true);
+		}
+	}
+
+	// Chunks come in order, one past a gap means the one before it was dropped, the host is asked for the rest from the gap.
+	// Each one is acked, the host keeps at most its window ahead of the acks
+	void FileChunk(detail::file_chunk_in const& chunk) noexcept {
+		auto it = std::ranges::find(m_downloads, chunk.prefix.transfer, &file_download::id);
+
+		if (it == m_downloads.end() || chunk.prefix.offset < it->received) { // cancelled, or sent again after a gap
+			return;
+		}
+
+		if (chunk.prefix.offset > it->received) {
+			if (not it->resume_asked) {
+				it->resume_asked = true;
+
+				Send(
+					gef::unique_ref<PacketTCP>::make(
+						gef::unique_ref<msg<file_accept>>::make( file_accept{ it->id, it->received } )
+					), lane::critical);
+			}
+			return;
+		}
+
+		if (it->received + chunk.data.size() > it->size) {
+			SendFileCancel(it->id);
+			EndDownload(it, false);
+			return;
+		}
+
+		// on the io thread, see `file_stream_config`. The stamp after it marks what's written as this file's
+		std::error_code ec = it->file->WriteAt(it->received, asio::buffer(chunk.data));
+
+		if (not ec) {
+			ec = it->file->SetModified(it->modified);
+		}
+
+		if (ec) {
+			access_clienter().on_error({ net_error::file_transfer, ec });
+			SendFileCancel(it->id);
+			EndDownload(it, false);
+			return;
+		}
+
+		it->received += chunk.data.size();
+		it->resume_asked = false;
+
+		Send(
+			gef::unique_ref<PacketTCP>::make(
+				gef::unique_ref<msg<file_ack>>::make( file_ack{ it->id, it->received } )
+			), lane::critical);
+
+		if constexpr (requires { access_clienter().on_file_progress(it->id, it->received, it->size); }) {
+			access_clienter().on_file_progress(it->id, it->received, it->size);
+		}
+
+		if (it->received == it->size) {
+			EndDownload(it, true);
+		}
+	}
+
+	void SendFileCancel(const u32 transfer) noexcept {
+		Send(
+			gef::unique_ref<PacketTCP>::make(
+				gef::unique_ref<msg<file_cancel>>::make( file_cancel{ transfer } )
+			), lane::critical);
+	}
+
+	// complete - the whole file was written, `on_file_cancel(transfer)` otherwise
+	void EndDownload(std::vector<file_download>::iterator it, const bool complete) noexcept {
+		const u32 id = it->id;
+
+		m_downloads.erase(it);
+
+		if (complete) {
+			return;
+		}
+
+		if constexpr (requires { access_clienter().on_file_cancel(id); }) {
+			access_clienter().on_file_cancel(id);
+		}
+	}
+
+	// Creates the segment and offers it to the host, the sockets carry everything until the host's answer
+	void OfferShm() noexcept {
+		auto link = std::make_unique<ShmLink>();
+
+		if (std::error_code ec = link->Create(m_config.shm.ring_bytes, m_config.shm.full_timeout_ms)) { // not fatal, the sockets stay
+			access_clienter().on_error({ net_error::failed_to_connect, ec });
+			return;
+		}
+
+		shm_offer offer{};
+		std::ranges::copy(link->name(), offer.name.begin());
+
+		m_shm = std::move(link);
+
+		Send(gef::unique_ref<PacketTCP>::make( gef::unique_ref<msg<shm_offer>>::make( offer ) ), lane::critical);
+	}
+
+	// The host's answer to the offer, its last packet through the socket. Accepted, the client's next packet through
+	// the socket says it switched too, the ones after it go through the segment
+	void ShmSwitch(const bool accepted) noexcept {
+		if (not m_shm) {
+			return;
+		}
+
+		if (not accepted) {
+			m_shm.reset();
+			return;
+		}
+
+		m_shm->Start(m_config.threads, m_config.shm.spin_us, m_config.max_message_bytes,
+			[this](const protocol proto, const const_buf packet) {
+				if (proto == protocol::tcp) {
+					tcp_socket.DeliverShm(packet);
+				}
+				else {
+					udp_socket.DeliverShm(packet);
+				}
+			},
+			[this]() {
+				asio::post(m_context, [this]() { Close({ net_error::unknown_msg_type, gef::nullopt }); });
+			});
+
+		auto switched = gef::unique_ref<PacketTCP>::make( gef::unique_ref<msg<shm_switch>>::make( shm_switch{ 1 } ) );
+		switched->priority = lane::bulk; // behind everything the socket still holds
+
+		tcp_socket.Send(std::move(switched));
+
+		tcp_socket.UseShm(m_shm.get());
+		udp_socket.UseShm(m_shm.get());
+	}
+
+	// Back to the sockets, nothing is delivered from the segment after this
+	void StopShm() noexcept {
+		tcp_socket.UseShm(nullptr);
+		udp_socket.UseShm(nullptr);
+
+		if (m_shm) {
+			m_shm->Stop();
+		}
+	}
+
+	// Opens the mesh socket next to the TCP connection and registers it with the host
+	void StartMesh() noexcept {
+		asio::error_code ec;
+
+		auto const& local_endpoint = tcp_socket.socket.local_endpoint(ec);
+
+		if (not ec) {
+			ec = mesh_socket.Open(local_endpoint.address());
+		}
+
+		if (ec) { // not fatal, everything keeps going through the host
+			access_clienter().on_error({ net_error::failed_to_connect, ec });
+			return;
+		}
+
+		Send(
+			gef::unique_ref<PacketTCP>::make(
+				gef::unique_ref<msg<mesh_register>>::make(
+					mesh_register{ mesh_socket.port(), std::min<u8>(m_config.mesh.relay_capacity, relay_children_max) }
+				)
+			), lane::critical);
+	}
+
+	void Connect(tcp::endpoint const& endpoint, gef::unique_ref<PacketTCP> cinfo) noexcept {
+		m_shm.reset(); // the previous connection's
+		m_downloads.clear();
+
+		tcp_socket.socket.async_connect(endpoint,
+			[this, cinfo = std::move(cinfo)](asio::error_code ec) mutable {
+				if (ec) {
+					DropPending();
+					access_clienter().on_error({ net::net_error::failed_to_connect, ec });
+					return;
+				}
+
+				auto const& local_endpoint = tcp_socket.socket.local_endpoint();
+				auto const& remote_endpoint = tcp_socket.socket.remote_endpoint();
+
+				ec = udp_socket.OpenBindConnect(
+					udp::endpoint(local_endpoint.address(), local_endpoint.port()),
+					udp::endpoint(remote_endpoint.address(), remote_endpoint.port())
+				);
+
+				if (ec) {
+					DropPending();
+					access_clienter().on_error({ net::net_error::failed_to_connect, ec });
+					return;
+				}
+
+				set_busy_poll(tcp_socket.socket, m_config.busy_poll.socket_busy_poll_us);
+				set_busy_poll(udp_socket.socket, m_config.busy_poll.socket_busy_poll_us);
+
+				CinfoWrite(std::move(cinfo));
+			});
+	}
+
+	// With `framing::compact`, the request goes right before the cinfo
 	void CinfoWrite(gef::unique_ref<PacketTCP> cinfo) noexcept {
 		auto bufs = cinfo->const_buf_seq();
 
-		tcp_socket.socket.async_send(bufs,
+		tcp_socket.UseFraming(framing::fixed, -1);
+		udp_socket.UseFraming(framing::fixed, -1);
+
+		if (m_config.header_framing == framing::compact) {
+			framing_request = header_client_TCP{ static_cast<u32>(framing::compact), control_msg::framing };
+
+			bufs.insert(bufs.begin(), header_to<const_buf>(framing_request));
+		}
+
+		asio::async_write(tcp_socket.socket, bufs,
 			[this, cinfo = std::move(cinfo)](asio::error_code ec, size_t) {
 				if (ec) {
 					Close({ net_error::failed_to_write, ec });
@@ -159,13 +866,23 @@ private:
 
 		auto buf = header_to<mut_buf>(p->h);
 
-		tcp_socket.socket.async_receive(buf,
+		asio::async_read(tcp_socket.socket, buf,
 			[this, p = std::move(p)](asio::error_code ec, size_t) mutable {
 				if (ec) {
 					Close({ net_error::failed_to_read, ec });
 					return;
 				}
 
+				if (p->h.msg_type == control_msg::framing) { // granted, the hinfo follows
+					if (p->h.size == static_cast<u32>(framing::compact)) {
+						tcp_socket.UseFraming(framing::compact, p->h.from_id);
+						udp_socket.UseFraming(framing::compact, p->h.from_id);
+					}
+
+					HinfoReadHeader();
+					return;
+				}
+
 				p->m.replace(access_clienter().connection_result_builder(p->h))
 					.map_or_else(
 						[&](gef::unique_ref<any_msg>& m) {
@@ -181,7 +898,7 @@ private:
 
 		auto bufs = m.mut_buf_seq();
 
-		tcp_socket.socket.async_receive(bufs,
+		asio::async_read(tcp_socket.socket, bufs,
 			[this, p = std::move(p)](asio::error_code ec, size_t) mutable {
 				if (ec) {
 					Close({ net_error::failed_to_read, ec });
@@ -189,6 +906,7 @@ private:
 				}
 
 				if (not access_clienter().connection_result(std::move(p))) {
+					DropPending();
 					return;
 				}
 
@@ -196,6 +914,27 @@ private:
 
 				tcp_socket.Start();
 				udp_socket.Start();
+
+				SendPending();
+
+				if (m_config.tick.rate_hz != 0) {
+					m_ticks.Start(m_config.tick.rate_hz);
+				}
+
+				if (m_config.keepalive.interval_ms != 0 || m_config.keepalive.timeout_ms != 0) {
+					last_in_ms = elapsed_ms();
+					last_out_ms = elapsed_ms();
+
+					KeepaliveTimer();
+				}
+
+				if (m_config.mesh.enabled) {
+					StartMesh();
+				}
+
+				if (shm_supported && m_config.shm.enabled && detail::is_local_peer(tcp_socket.socket)) {
+					OfferShm();
+				}
 			});
 	}
 
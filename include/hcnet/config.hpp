@@ -0,0 +1,280 @@
+#pragma once
+
+#include "canyon.hpp"
+
+namespace net {
+
+	// Built with HCNET_IO_URING (and asio's ASIO_HAS_IO_URING, ASIO_DISABLE_EPOLL, as the target's compile definitions,
+	// see examples/bench/CMakeLists.txt), every socket operation is an io_uring submission,
+	// the ones queued while the io thread runs its handlers are submitted together.
+	// Writes join them only with `host_config::io_writes`, which stays opt-in
+#ifdef HCNET_IO_URING
+	inline constexpr bool io_uring_backend = true;
+#else
+	inline constexpr bool io_uring_backend = false;
+#endif
+
+	// What a socket does with a packet that doesn't fit in its send queue
+	enum class overflow_policy : i8 {
+		drop_oldest_unreliable, // UDP drops the oldest queued datagram, TCP falls back to `drop_newest`
+		drop_newest,            // the packet being queued is dropped
+		block,                  // the producer waits until the queue drains, on a host it holds the broadcast to every wire.
+		                        // With `io_writes` the io thread drains it, a packet it queues is dropped instead
+		disconnect              // the connection is closed with `net_error::slow_consumer`
+	};
+
+	// Headers on the wire between a host and a client
+	enum class framing : u8 {
+		fixed,  // the header structs as they are in memory
+		compact // variable length, little-endian, `from_id` only when it isn't the host's (see framing.hpp)
+	};
+
+	// Per-socket send queue limits, 0 means unbounded / disabled
+	struct send_queue_limits {
+		size_t max_bytes = 0;
+		size_t max_packets = 0;
+
+		// crossing it upwards reports congestion, draining below half of it reports relief
+		size_t high_water_bytes = 0;
+
+		overflow_policy policy = overflow_policy::drop_newest;
+
+		// TCP only, bulk lane packets larger than this are sent in slices of this size,
+		// so higher lanes get through in between (0 = never slice)
+		size_t bulk_slice_bytes = 16 * 1024;
+
+		// packets up to this size, header included, are copied into one buffer and sent with a single write instead of
+		// a scatter/gather one, larger ones are gathered in place (0 = always gather, at most 2048).
+		// On loopback the copy was ~15% cheaper up to 2KB and slower from 4KB, see examples/bench/src/small_msgs.cpp
+		size_t linearize_bytes = 1024;
+	};
+
+	// How a host accepts and greets new connections
+	struct accept_config {
+		// listening sockets sharing the port, more than one needs SO_REUSEPORT (Linux, BSD)
+		u8 acceptors = 1;
+
+		// threads that accept and run the cinfo/hinfo handshake,
+		// 0 = accept on the io thread, together with the established wires.
+		// The Hoster's callbacks of a handshake (builder_TCP for the cinfo, new_client, on_error, and on_close_connection
+		// for a handshake that failed) run on these threads, concurrently with the io thread's callbacks and,
+		// with more than one thread, with each other
+		u8 threads = 0;
+
+		// async_accept()s kept pending on every acceptor
+		u8 outstanding_accepts = 1;
+
+		int backlog = asio::socket_base::max_listen_connections;
+	};
+
+	// Peer-to-peer UDP, clients send their datagrams straight to each other,
+	// the host relays only to the peers a client has no direct path to
+	struct mesh_config {
+		bool enabled = false;
+
+		// client only, direct paths are probed this often
+		u32 probe_interval_ms = 250;
+
+		// client only, a direct path is dropped after this many unanswered probes
+		u8 probe_misses = 4;
+
+		// host only, the host's own UDP broadcasts go to this many relays, which forward them down a tree.
+		// 0 sends every broadcast to every wire
+		u8 relay_fanout = 0;
+
+		// host only, the tree is rebuilt this long after the mesh changed, so a burst of changes rebuilds it once
+		u32 relay_rebuild_ms = 100;
+
+		// client only, how many peers this client forwards to as a relay (its upload budget),
+		// at most `relay_children_max`, 0 never relays
+		u8 relay_capacity = 0;
+	};
+
+	// Fixed rate ticks on the io thread, `on_tick(tick_no, dt)` on the Hoster / Clienter (see `TickScheduler`)
+	struct tick_config {
+		// 0 = no ticks
+		u32 rate_hz = 0;
+
+		// Send()s are held and flushed together at the end of every tick instead of queued right away,
+		// Flush() sends them early
+		bool coalesce = true;
+	};
+
+	// Heartbeats and dead peer detection, on both sides of a connection. 0 disables either
+	struct keepalive_config {
+		// a heartbeat is sent after this long without sending anything
+		u32 interval_ms = 0;
+
+		// the connection is closed with `net_error::timed_out` after this long without receiving anything,
+		// set it to a few of the other side's `interval_ms`
+		u32 timeout_ms = 0;
+
+		// how often they're checked, the host's timer wheel has a slot per `resolution_ms`
+		u32 resolution_ms = 100;
+	};
+
+	// The io thread spins on poll() instead of blocking for the next completion, trading a core for wake-up latency
+	// (see `BusyPoller`)
+	struct busy_poll_config {
+		bool enabled = false;
+
+		// how long it keeps spinning after the last handler ran, then blocks until the next one
+		u32 spin_us = 50;
+
+		// SO_BUSY_POLL on the sockets (Linux, may need CAP_NET_ADMIN above net.core.busy_read), 0 leaves it off
+		u32 socket_busy_poll_us = 0;
+	};
+
+	// Host broadcasts, the wires are split into shards each sent to by a fan-out worker of its own,
+	// so a broadcast costs the dequeue thread one enqueue per shard instead of a send per wire
+	struct fanout_config {
+		// 0 = half the hardware threads, fewer than 2 never shards
+		u8 workers = 0;
+
+		// fan-out moves to the workers once this many wires are connected, and stays there until Stop()
+		u32 shard_above_wires = 64;
+	};
+
+	// The application's packet handlers run on a pool of worker threads instead of the io thread, so a slow one
+	// holds up only its own connection. A connection's handlers still run one at a time, in the order its packets
+	// were read, per protocol (see `HandlerPool`). A connection's on_close_connection runs on a worker too,
+	// after the handlers of both protocols' packets read before it closed
+	struct handler_config {
+		// 0 = handlers run on the io thread
+		u8 workers = 0;
+	};
+
+	// A client on the same machine as its host talks to it through a shared memory segment instead of the loopback sockets,
+	// a ring each way (see `ShmLink`). Agreed on once the connection is up when both sides enable it, the sockets stay
+	// open to tell a closed connection. Out-going packets still go through the sockets' send queues, their writer
+	// copies them into the ring instead of sending them. The packets read from the segment are handed to the io thread,
+	// as if read from the sockets. POSIX only, a host that predates it rejects the offer
+	struct shm_config {
+		bool enabled = false;
+
+		// client only, the size of each ring, a packet larger than half of it is written in pieces
+		size_t ring_bytes = 1024 * 1024;
+
+		// how long the reader spins on an empty ring before it sleeps until the writer wakes it
+		u32 spin_us = 50;
+
+		// a socket's writer waits this long for room in a full ring, then the connection is closed with `net_error::slow_consumer`.
+		// Meanwhile the packets queue up under `send_queue_limits`, the io thread (`io_writes`) retries without waiting
+		u32 full_timeout_ms = 1000;
+	};
+
+	// Files a host streams to its clients (see `Host::SendFile`), a chunk at a time in the bulk lane, so the other lanes
+	// get through between two chunks. On Linux a wire's writer thread sends the chunks from the file (sendfile),
+	// they're read into memory first when the wire writes from the io thread (`io_writes`) or through shared memory.
+	//
+	// * with `io_writes`, or without sendfile, a chunk is read from the disk on the host's io thread as it's queued
+	// * the client writes every chunk to its file on its io thread
+	// A slow disk delays every other connection's packets on that thread meanwhile, a chunk at a time, keep `chunk_bytes` small there
+	struct file_stream_config {
+		// the data of a chunk, at most `file_chunk_max`. Like `send_queue_limits::bulk_slice_bytes`,
+		// the most a critical packet waits behind
+		u32 chunk_bytes = 16 * 1024;
+
+		// the most a transfer sends ahead of the client's acks, 0 = the whole file is queued at once
+		u32 window_bytes = 1024 * 1024;
+	};
+
+	// Where a kind of library thread runs (see `spawn_thread`), best effort, a setting the OS refuses is left as it was
+	struct thread_placement {
+		// the cpus these threads may run on, empty = any
+		std::vector<u16> cpus{};
+
+		// 1-99 runs them SCHED_FIFO at this priority (Linux, needs CAP_SYS_NICE), THREAD_PRIORITY_HIGHEST on Windows.
+		// 0 leaves the default scheduling
+		u8 realtime_priority = 0;
+	};
+
+	struct thread_config {
+		thread_placement io{};      // runs the io_context, a client's only with its own context
+		thread_placement accept{};  // host only, see `accept_config::threads`
+		thread_placement dequeue{}; // host only, hand the queued packets to the wires, or to the fan-out workers
+		thread_placement fanout{};  // host only, see `fanout_config`
+		thread_placement handler{}; // host only, see `handler_config`
+		thread_placement writer{};  // one per socket, unless `io_writes`
+		thread_placement shm{};     // reads a connection's shared memory ring, see `shm_config`
+
+		// "hcnet-io", "hcnet-wr-tcp" ... in top, perf and debuggers
+		bool names = true;
+	};
+
+	struct host_config {
+		send_queue_limits tcp_queue{};
+		send_queue_limits udp_queue{};
+
+		accept_config accept{};
+
+		mesh_config mesh{};
+
+		// `framing::compact` grants it to the clients that ask for it, the others keep `framing::fixed`
+		framing header_framing = framing::fixed;
+
+		// ticks from Start() to Stop()
+		tick_config tick{};
+
+		keepalive_config keepalive{};
+
+		busy_poll_config busy_poll{};
+
+		fanout_config fanout{};
+
+		handler_config handlers{};
+
+		shm_config shm{};
+
+		file_stream_config files{};
+
+		// packets and connection events are queued for PollEvents() / ForEachEvent() instead of passed to
+		// new_packet_TCP / new_packet_UDP / on_close_connection, which are then never called (see `EventQueue`).
+		// Takes the place of `handlers`
+		bool pull_events = false;
+
+		thread_config threads{};
+
+		// the largest packet a client may send, header included. A bulk packet rebuilt from its slices growing past it
+		// closes the connection with `net_error::message_too_large`
+		size_t max_message_bytes = 64 * 1024 * 1024;
+
+		// every wire writes from the io thread, instead of a writer thread of its own doing a blocking send per packet.
+		// On io_uring, a broadcast's sends to every wire then go out in one submission.
+		// The io thread never waits for a full queue, see `overflow_policy::block`
+		bool io_writes = false;
+	};
+
+	struct client_config {
+		send_queue_limits tcp_queue{};
+		send_queue_limits udp_queue{};
+
+		mesh_config mesh{};
+
+		// asked for in the handshake, used only if the host grants it.
+		// A host that predates compact framing rejects the request
+		framing header_framing = framing::fixed;
+
+		// ticks while connected, from the host's accepting to the connection's close
+		tick_config tick{};
+
+		keepalive_config keepalive{};
+
+		// own context only, a shared context is run by its owner
+		busy_poll_config busy_poll{};
+
+		// see `host_config::pull_events`
+		bool pull_events = false;
+
+		shm_config shm{};
+
+		thread_config threads{};
+
+		// see `host_config::max_message_bytes`, the largest packet the host may send
+		size_t max_message_bytes = 64 * 1024 * 1024;
+
+		// writes from the io thread instead of writer threads, always on a shared context (see `Client`).
+		// See `host_config::io_writes`
+		bool io_writes = false;
+	};
+}
\ No newline at end of file
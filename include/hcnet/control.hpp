@@ -0,0 +1,242 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <array>
+#include <memory>
+
+namespace net {
+
+	// Payloads of the library's control messages (see `control_msg`), trivially copyable and sent as they are
+
+	struct mesh_register {
+		u16 port; // of the client's mesh socket, the address is the one the host sees
+		u8 relay_capacity;
+	};
+
+	struct mesh_peer {
+		i16 id;
+		u16 port;
+		u8 v6;
+		std::array<u8, 16> address;
+		u64 token; // issued for this pair of peers, both announcements carry it, their probes prove it
+	};
+
+	struct mesh_path {
+		i16 peer;
+		u8 up;
+		u32 rtt_us; // when it went up
+	};
+
+	inline constexpr size_t relay_children_max = 16;
+
+	// the peers a relay forwards the host's broadcasts to, replaces the previous assignment
+	struct relay_assign {
+		u16 version; // of the tree, a relay forwards only the broadcasts sent for its version
+		u8 count;
+		std::array<i16, relay_children_max> children;
+	};
+
+	inline constexpr size_t shm_name_max = 48;
+
+	// the segment the client created, named as shm_open() takes it, null terminated
+	struct shm_offer {
+		std::array<char, shm_name_max> name;
+	};
+
+	struct shm_switch {
+		u8 accepted; // from the host, 0 declines the offer and the sockets are kept
+	};
+
+	inline constexpr size_t file_name_max = 128;
+
+	// the most data a `control_msg::file_chunk` carries, a larger one is malformed
+	inline constexpr size_t file_chunk_max = 1024 * 1024;
+
+	// what the application named the file, null terminated
+	// `size` and `modified` tell the file's content apart, a client resumes into a partial copy only if both match
+	struct file_offer {
+		u32 transfer;
+		u64 size;
+		u64 modified; // the last write time of the host's file, ns since the epoch
+		std::array<char, file_name_max> name;
+	};
+
+	// accepts an offer, or asks for the rest of an accepted transfer again from a chunk that never arrived
+	struct file_accept {
+		u32 transfer;
+		u64 offset; // what the client already has of the file
+	};
+
+	// precedes a chunk's data
+	struct file_chunk_prefix {
+		u32 transfer;
+		u64 offset;
+	};
+
+	struct file_ack {
+		u32 transfer;
+		u64 received; // the client has the file up to here
+	};
+
+	struct file_cancel {
+		u32 transfer;
+	};
+
+	namespace detail {
+		template <typename T, control_msg::type Identifier>
+			requires std::is_trivially_copyable_v<T>
+		struct vectorize_control {
+
+			static constexpr i16 identifier = Identifier;
+
+			template <bool IncludeHeaderBuf, typename Buf>
+			static std::vector<Buf> vectorize(T const& obj) noexcept {
+				return build_custom_buf_seq<IncludeHeaderBuf, Buf>(
+					Buf((void*)&obj, sizeof(obj))
+				);
+			}
+		};
+	}
+
+	template <>
+	struct vectorize_msg<mesh_register> : detail::vectorize_control<mesh_register, control_msg::mesh_register> {};
+
+	template <>
+	struct vectorize_msg<mesh_peer> : detail::vectorize_control<mesh_peer, control_msg::mesh_peer> {};
+
+	template <>
+	struct vectorize_msg<mesh_path> : detail::vectorize_control<mesh_path, control_msg::mesh_path> {};
+
+	template <>
+	struct vectorize_msg<relay_assign> : detail::vectorize_control<relay_assign, control_msg::relay_assign> {};
+
+	template <>
+	struct vectorize_msg<shm_offer> : detail::vectorize_control<shm_offer, control_msg::shm_offer> {};
+
+	template <>
+	struct vectorize_msg<shm_switch> : detail::vectorize_control<shm_switch, control_msg::shm_switch> {};
+
+	template <>
+	struct vectorize_msg<file_offer> : detail::vectorize_control<file_offer, control_msg::file_offer> {};
+
+	template <>
+	struct vectorize_msg<file_accept> : detail::vectorize_control<file_accept, control_msg::file_accept> {};
+
+	template <>
+	struct vectorize_msg<file_ack> : detail::vectorize_control<file_ack, control_msg::file_ack> {};
+
+	template <>
+	struct vectorize_msg<file_cancel> : detail::vectorize_control<file_cancel, control_msg::file_cancel> {};
+}
+
+#include "msg.hpp"
+
+namespace net::detail {
+
+	template <typename T>
+	gef::option<gef::unique_ref<any_msg>> build_control_as(const size_t size) noexcept {
+		if (size != sizeof(T)) { // a malformed control message would desync the stream
+			return gef::nullopt;
+		}
+
+		return gef::unique_ref<msg<T>>::make();
+	}
+
+	// A received `control_msg::file_chunk`, its prefix and data
+	class file_chunk_in : public any_msg {
+	public:
+		file_chunk_in(const size_t data_size) noexcept : data(data_size) {}
+
+		std::vector<const_buf> const_buf_seq(i16& msg_type) const noexcept override {
+			msg_type = control_msg::file_chunk;
+
+			return { const_buf{}, const_buf{ &prefix, sizeof(prefix) }, asio::buffer(data) };
+		}
+
+		std::vector<mut_buf> mut_buf_seq() noexcept override {
+			return { mut_buf{ &prefix, sizeof(prefix) }, asio::buffer(data) };
+		}
+
+		std::vector<mut_buf> mut_buf_seq_with_header(i16& msg_type) noexcept override {
+			msg_type = control_msg::file_chunk;
+
+			return { mut_buf{}, mut_buf{ &prefix, sizeof(prefix) }, asio::buffer(data) };
+		}
+
+	public:
+		file_chunk_prefix prefix{};
+		std::vector<u8> data;
+	};
+
+	inline gef::option<gef::unique_ref<any_msg>> build_file_chunk(const size_t size) noexcept {
+		if (size <= sizeof(file_chunk_prefix) || size > sizeof(file_chunk_prefix) + file_chunk_max) {
+			return gef::nullopt;
+		}
+
+		return gef::unique_ref<file_chunk_in>::make( size - sizeof(file_chunk_prefix) );
+	}
+
+	// Builds the body of a control message, `gef::nullopt` if the type or size is unknown
+	template <typename Header>
+	gef::option<gef::unique_ref<any_msg>> build_control(Header const& h) noexcept {
+		switch (h.msg_type) {
+		case control_msg::mesh_register:
+			return build_control_as<mesh_register>(h.size);
+		case control_msg::mesh_peer:
+			return build_control_as<mesh_peer>(h.size);
+		case control_msg::mesh_path:
+			return build_control_as<mesh_path>(h.size);
+		case control_msg::relay_assign:
+			return build_control_as<relay_assign>(h.size);
+		case control_msg::shm_offer:
+			return build_control_as<shm_offer>(h.size);
+		case control_msg::shm_switch:
+			return build_control_as<shm_switch>(h.size);
+		case control_msg::file_offer:
+			return build_control_as<file_offer>(h.size);
+		case control_msg::file_accept:
+			return build_control_as<file_accept>(h.size);
+		case control_msg::file_chunk:
+			return build_file_chunk(h.size);
+		case control_msg::file_ack:
+			return build_control_as<file_ack>(h.size);
+		case control_msg::file_cancel:
+			return build_control_as<file_cancel>(h.size);
+		default:
+			return gef::nullopt;
+		}
+	}
+
+	// the body of a `control_msg::relay` datagram starts with the tree's version, then the broadcast's own header and body
+	inline constexpr size_t relay_prefix_size = header_server_UDP::header_size + sizeof(u16);
+
+	// Wraps a broadcast datagram as `control_msg::relay`.
+	// Send only, a relay forwards the received datagram as it is
+	template <typename PacketUDP>
+	class relay_envelope : public any_msg {
+	public:
+		relay_envelope(std::shared_ptr<PacketUDP> inner, const u16 version) noexcept : inner(std::move(inner)), version(version) {}
+
+		std::vector<const_buf> const_buf_seq(i16& msg_type) const noexcept override {
+			msg_type = control_msg::relay;
+
+			auto bufs = inner->const_buf_seq(); // [inner header, inner body...]
+
+			bufs.insert(bufs.begin(), { const_buf{}, const_buf{ &version, sizeof(version) } }); // slot of the outer header, version
+
+			return bufs;
+		}
+
+		std::vector<mut_buf> mut_buf_seq() noexcept override {
+			return {};
+		}
+
+		std::vector<mut_buf> mut_buf_seq_with_header(i16&) noexcept override {
+			return {};
+		}
+
+	private:
+		std::shared_ptr<PacketUDP> inner;
+		u16 version;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace net {
+
+	namespace detail {
+		// converts to any member type, only in unevaluated aggregate initialization
+		struct any_member {
+			template <typename T>
+			operator T() const noexcept;
+		};
+
+		// any_member for a braced initializer, the lvalue keeps a member's copy and move constructors from competing
+		struct any_member_ref {
+			template <typename T>
+			operator T&() const noexcept;
+		};
+
+		// The number of initializers an aggregate takes. A member that is itself an aggregate counts as one,
+		// it converts from any_member. A C array doesn't, brace elision counts each of its elements
+		template <typename T, typename ...Members>
+		consteval size_t member_count() noexcept {
+			if constexpr (requires { T{ Members{}..., any_member{} }; }) {
+				return member_count<T, Members..., any_member>();
+			}
+			else {
+				return sizeof...(Members);
+			}
+		}
+
+		// member_count with each initializer in braces, no brace elision, a C array counts as one
+		template <typename T, typename ...Members>
+		consteval size_t braced_member_count() noexcept {
+			if constexpr (requires { T{ { Members{} }..., { any_member_ref{} } }; }) {
+				return braced_member_count<T, Members..., any_member_ref>();
+			}
+			else {
+				return sizeof...(Members);
+			}
+		}
+
+		inline constexpr size_t derive_members_max = 8;
+
+		// f(members...), in declaration order
+		template <typename T, typename F>
+		constexpr decltype(auto) visit_members(T& obj, F&& f) noexcept {
+			constexpr size_t n = member_count<std::remove_cv_t<T>>();
+
+			static_assert(n == braced_member_count<std::remove_cv_t<T>>(), "a derived message can't have C array members, use std::array");
+			static_assert(n >= 1 && n <= derive_members_max, "a derived message has 1 to `derive_members_max` members");
+
+			if constexpr (n == 1) { auto& [a] = obj; return f(a); }
+			else if constexpr (n == 2) { auto& [a, b] = obj; return f(a, b); }
+			else if constexpr (n == 3) { auto& [a, b, c] = obj; return f(a, b, c); }
+			else if constexpr (n == 4) { auto& [a, b, c, d] = obj; return f(a, b, c, d); }
+			else if constexpr (n == 5) { auto& [a, b, c, d, e] = obj; return f(a, b, c, d, e); }
+			else if constexpr (n == 6) { auto& [a, b, c, d, e, g] = obj; return f(a, b, c, d, e, g); }
+			else if constexpr (n == 7) { auto& [a, b, c, d, e, g, h] = obj; return f(a, b, c, d, e, g, h); }
+			else { auto& [a, b, c, d, e, g, h, i] = obj; return f(a, b, c, d, e, g, h, i); }
+		}
+
+		struct member_tuple {
+			template <typename ...M>
+			std::tuple<std::remove_cvref_t<M>...> operator()(M& ...) const noexcept { return {}; }
+		};
+
+		template <typename T>
+		using member_types = decltype(visit_members(std::declval<T&>(), member_tuple{}));
+
+		template <typename T>
+		inline constexpr bool is_trailing_range_v = false;
+
+		template <typename C, typename Tr, typename A>
+		inline constexpr bool is_trailing_range_v<std::basic_string<C, Tr, A>> = std::is_trivially_copyable_v<C>;
+
+		template <typename E, typename A>
+		inline constexpr bool is_trailing_range_v<std::vector<E, A>> = std::is_trivially_copyable_v<E> && not std::is_same_v<E, bool>;
+
+		template <typename Tuple, size_t ...I>
+		consteval bool trailing_layout(std::index_sequence<I...>) noexcept {
+			return (std::is_trivially_copyable_v<std::tuple_element_t<I, Tuple>> && ...)
+				&& is_trailing_range_v<std::tuple_element_t<sizeof...(I), Tuple>>;
+		}
+
+		// trivially copyable members, then a string / vector of trivially copyable elements
+		template <typename T>
+		consteval bool has_trailing_layout() noexcept {
+			if constexpr (std::is_aggregate_v<T>) {
+				using members = member_types<T>;
+
+				return trailing_layout<members>(std::make_index_sequence<std::tuple_size_v<members> - 1>{});
+			}
+			else {
+				return false;
+			}
+		}
+
+		template <typename T>
+		concept derivable = std::is_trivially_copyable_v<T> || has_trailing_layout<T>();
+
+		// f(the members before the last as raw bytes, the last one)
+		template <typename T, typename F>
+		constexpr decltype(auto) split_trailing(T& obj, F&& f) noexcept {
+			return visit_members(obj,
+				[&](auto& ...m) -> decltype(auto) {
+					constexpr size_t n = sizeof...(m);
+
+					auto& last = std::get<n - 1>(std::tie(m...));
+
+					// up to the end of the member before the last, the padding in between is sent as well
+					size_t prefix = 0;
+
+					if constexpr (n > 1) {
+						auto& before_last = std::get<n - 2>(std::tie(m...));
+
+						prefix = static_cast<size_t>(reinterpret_cast<const u8*>(&before_last) + sizeof(before_last) - reinterpret_cast<const u8*>(&obj));
+					}
+
+					return f(prefix, last);
+				});
+		}
+	}
+
+	/// `vectorize_msg` derived from the layout of `T`, specialize it as
+	///   template <> struct net::vectorize_msg<my_msg> : net::derive_vectorize<my_msg, my_type::my_msg> {};
+	///
+	/// * a trivially copyable `T` is one buffer, the whole object
+	/// * an aggregate of trivially copyable members followed by a string or a vector (of trivially copyable elements)
+	///   is at most two buffers, the members before the last as they are in memory, then the last one's elements.
+	///   Build it with `build_msg<T>(size)`, which sizes the last member from the header
+	template <typename T, auto Identifier>
+	struct derive_vectorize {
+
+		static_assert(detail::derivable<T>, "`T` is neither trivially copyable nor an aggregate of trivially copyable members with a trailing string / vector");
+
+		static constexpr auto identifier = Identifier;
+
+		template <bool IncludeHeaderBuf, typename Buf>
+		static std::vector<Buf> vectorize(T const& obj) noexcept {
+			if constexpr (std::is_trivially_copyable_v<T>) {
+				return build_custom_buf_seq<IncludeHeaderBuf, Buf>(
+					Buf((void*)&obj, sizeof(obj))
+				);
+			}
+			else {
+				return detail::split_trailing(obj,
+					[&](const size_t prefix, auto const& last) {
+						const Buf trailing((void*)last.data(), last.size() * sizeof(*last.data()));
+
+						if (prefix == 0) {
+							return build_custom_buf_seq<IncludeHeaderBuf, Buf>(trailing);
+						}
+
+						return build_custom_buf_seq<IncludeHeaderBuf, Buf>(
+							Buf((void*)&obj, prefix),
+							trailing
+						);
+					});
+			}
+		}
+
+		// sizes the trailing member for a body of `body_size` bytes, before it's received
+		static void resize(T& obj, const size_t body_size) noexcept {
+			if constexpr (not std::is_trivially_copyable_v<T>) {
+				detail::split_trailing(obj,
+					[&](const size_t prefix, auto& last) {
+						last.resize(body_size > prefix ? (body_size - prefix) / sizeof(*last.data()) : 0);
+					});
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,724 @@
+#pragma once
+
+#include "canyon.hpp"
+#include "derive.hpp"
+#include <cmath>
+#include <cstring>
+#include <span>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HCNET_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(HCNET_X86) && (defined(__GNUC__) || defined(__clang__))
+#define HCNET_TARGET(isa) __attribute__((target(isa)))
+#else
+#define HCNET_TARGET(isa)
+#endif
+
+namespace net {
+
+	/// Entity state for a tick, as a struct of arrays. Every array has `size()` entities
+	struct entity_soa {
+		std::vector<float> x, y, z;
+		std::vector<u32> flags;
+
+		void resize(const size_t count) noexcept {
+			x.resize(count);
+			y.resize(count);
+			z.resize(count);
+			flags.resize(count);
+		}
+
+		constexpr size_t size() const noexcept {
+			return x.size();
+		}
+	};
+
+	/// The arrays of an entity update, every span has the same size
+	struct entity_soa_view {
+		std::span<const float> x, y, z;
+		std::span<const u32> flags;
+
+		entity_soa_view(std::span<const float> x, std::span<const float> y, std::span<const float> z, std::span<const u32> flags) noexcept :
+			x(x), y(y), z(z), flags(flags)
+		{}
+
+		entity_soa_view(entity_soa const& soa) noexcept :
+			x(soa.x), y(soa.y), z(soa.z), flags(soa.flags)
+		{}
+
+		constexpr size_t size() const noexcept {
+			return x.size();
+		}
+	};
+
+	/// A message body of encoded entity updates, written by an `EntityEncoder` and read by an `EntityDecoder`.
+	/// Build a received one with `build_msg<entity_batch<Identifier>>(size)`
+	template <auto Identifier>
+	struct entity_batch {
+		std::vector<u8> bytes;
+	};
+
+	template <auto Identifier>
+	struct vectorize_msg<entity_batch<Identifier>> : derive_vectorize<entity_batch<Identifier>, Identifier> {};
+
+	// The instruction sets the entity batch kernels can use, picked once at runtime
+	enum class simd_level : u8 {
+		scalar,
+		ssse3,
+		avx2
+	};
+
+	namespace detail {
+
+		inline simd_level detect_simd() noexcept {
+#if defined(HCNET_X86) && defined(_MSC_VER)
+			int info[4];
+
+			__cpuid(info, 0);
+			const int ids = info[0];
+
+			__cpuid(info, 1);
+			const bool ssse3 = info[2] & (1 << 9);
+			const bool osxsave = info[2] & (1 << 27);
+
+			bool avx2 = false;
+
+			if (ids >= 7 && osxsave && (_xgetbv(0) & 0x6) == 0x6) {
+				__cpuidex(info, 7, 0);
+				avx2 = info[1] & (1 << 5);
+			}
+
+			return avx2 ? simd_level::avx2 : ssse3 ? simd_level::ssse3 : simd_level::scalar;
+#elif defined(HCNET_X86)
+			__builtin_cpu_init();
+
+			return __builtin_cpu_supports("avx2") ? simd_level::avx2
+				: __builtin_cpu_supports("ssse3") ? simd_level::ssse3
+				: simd_level::scalar;
+#else
+			return simd_level::scalar;
+#endif
+		}
+
+		inline simd_level best_simd() noexcept {
+			static const simd_level level = detect_simd();
+			return level;
+		}
+
+		// Encoded batch: [count: u32][sequence: u32][base: u32][keyframe: u8], then for each channel (x, y, z, flags)
+		// [planes: u8][planes * count bytes]. `base` is the sequence of the batch a delta is against. A channel is the zigzagged deltas against the previous batch,
+		// byte shuffled, the bytes of every entity's delta at 0 first, then at 1...
+		// Planes that are zero for every entity, the high bytes of small deltas, aren't sent
+		inline constexpr size_t entity_batch_preamble = 3 * sizeof(u32) + 1;
+		inline constexpr size_t entity_channels = 4;
+		inline constexpr size_t entity_position_channels = 3;
+
+		constexpr u32 zigzag(const i32 d) noexcept {
+			return (static_cast<u32>(d) << 1) ^ static_cast<u32>(d >> 31);
+		}
+
+		constexpr i32 unzigzag(const u32 z) noexcept {
+			return static_cast<i32>(z >> 1) ^ -static_cast<i32>(z & 1);
+		}
+
+		// the bytes needed by every value OR-ed into `any`
+		constexpr u8 planes_for(const u32 any) noexcept {
+			return any == 0 ? 0 : any <= 0xFF ? 1 : any <= 0xFFFF ? 2 : any <= 0xFFFFFF ? 3 : 4;
+		}
+
+		// Kernels, `prev` is the previous batch and is updated to this one.
+		// The quantizing / delta ones return every output OR-ed
+
+		// out = zigzag(round(in * scale) - prev)
+		inline u32 quantize_delta_scalar(const float* in, const float scale, i32* prev, u32* out, const size_t n) noexcept {
+			u32 any = 0;
+
+			for (size_t i = 0; i < n; i++) {
+				const i32 q = static_cast<i32>(std::nearbyint(in[i] * scale));
+
+				out[i] = zigzag(q - prev[i]);
+				prev[i] = q;
+				any |= out[i];
+			}
+
+			return any;
+		}
+
+		inline u32 delta_scalar(const u32* in, u32* prev, u32* out, const size_t n) noexcept {
+			u32 any = 0;
+
+			for (size_t i = 0; i < n; i++) {
+				out[i] = zigzag(static_cast<i32>(in[i] - prev[i]));
+				prev[i] = in[i];
+				any |= out[i];
+			}
+
+			return any;
+		}
+
+		inline void shuffle_scalar(const u32* in, const size_t n, const u8 planes, u8* out) noexcept {
+			for (u8 p = 0; p < planes; p++) {
+				for (size_t i = 0; i < n; i++) {
+					out[p * n + i] = static_cast<u8>(in[i] >> (8 * p));
+				}
+			}
+		}
+
+		inline void unshuffle_scalar(const u8* in, const size_t n, const u8 planes, u32* out) noexcept {
+			for (size_t i = 0; i < n; i++) {
+				u32 v = 0;
+
+				for (u8 p = 0; p < planes; p++) {
+					v |= static_cast<u32>(in[p * n + i]) << (8 * p);
+				}
+
+				out[i] = v;
+			}
+		}
+
+		// out = (prev + unzigzag(in)) / scale
+		inline void undelta_dequantize_scalar(const u32* in, const float inv_scale, i32* prev, float* out, const size_t n) noexcept {
+			for (size_t i = 0; i < n; i++) {
+				prev[i] += unzigzag(in[i]);
+				out[i] = static_cast<float>(prev[i]) * inv_scale;
+			}
+		}
+
+		inline void undelta_scalar(const u32* in, u32* prev, u32* out, const size_t n) noexcept {
+			for (size_t i = 0; i < n; i++) {
+				prev[i] += static_cast<u32>(unzigzag(in[i]));
+				out[i] = prev[i];
+			}
+		}
+
+#ifdef HCNET_X86
+		// bytes 0 of 4 lanes, then bytes 1..., within every 128 bits
+		HCNET_TARGET("ssse3") inline __m128i byte_transpose_mask_128() noexcept {
+			return _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+		}
+
+		HCNET_TARGET("ssse3") inline u32 or_lanes_128(const __m128i v) noexcept {
+			alignas(16) u32 lanes[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+
+			return lanes[0] | lanes[1] | lanes[2] | lanes[3];
+		}
+
+		HCNET_TARGET("ssse3") inline u32 quantize_delta_ssse3(const float* in, const float scale, i32* prev, u32* out, const size_t n) noexcept {
+			const __m128 s = _mm_set1_ps(scale);
+			__m128i any = _mm_setzero_si128();
+
+			size_t i = 0;
+
+			for (; i + 4 <= n; i += 4) {
+				const __m128i q = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), s));
+				const __m128i d = _mm_sub_epi32(q, _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i)));
+				const __m128i z = _mm_xor_si128(_mm_slli_epi32(d, 1), _mm_srai_epi32(d, 31));
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(prev + i), q);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), z);
+
+				any = _mm_or_si128(any, z);
+			}
+
+			return or_lanes_128(any) | quantize_delta_scalar(in + i, scale, prev + i, out + i, n - i);
+		}
+
+		HCNET_TARGET("ssse3") inline u32 delta_ssse3(const u32* in, u32* prev, u32* out, const size_t n) noexcept {
+			__m128i any = _mm_setzero_si128();
+
+			size_t i = 0;
+
+			for (; i + 4 <= n; i += 4) {
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				const __m128i d = _mm_sub_epi32(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i)));
+				const __m128i z = _mm_xor_si128(_mm_slli_epi32(d, 1), _mm_srai_epi32(d, 31));
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(prev + i), v);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), z);
+
+				any = _mm_or_si128(any, z);
+			}
+
+			return or_lanes_128(any) | delta_scalar(in + i, prev + i, out + i, n - i);
+		}
+
+		HCNET_TARGET("ssse3") inline void shuffle_ssse3(const u32* in, const size_t n, const u8 planes, u8* out) noexcept {
+			const __m128i mask = byte_transpose_mask_128();
+
+			size_t i = 0;
+
+			for (; i + 4 <= n; i += 4) {
+				alignas(16) u8 t[16];
+				_mm_store_si128(reinterpret_cast<__m128i*>(t), _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), mask));
+
+				for (u8 p = 0; p < planes; p++) {
+					std::memcpy(out + p * n + i, t + 4 * p, 4);
+				}
+			}
+
+			for (; i < n; i++) {
+				for (u8 p = 0; p < planes; p++) {
+					out[p * n + i] = static_cast<u8>(in[i] >> (8 * p));
+				}
+			}
+		}
+
+		HCNET_TARGET("ssse3") inline void unshuffle_ssse3(const u8* in, const size_t n, const u8 planes, u32* out) noexcept {
+			const __m128i mask = byte_transpose_mask_128();
+
+			size_t i = 0;
+
+			for (; i + 4 <= n; i += 4) {
+				alignas(16) u8 t[16]{};
+
+				for (u8 p = 0; p < planes; p++) {
+					std::memcpy(t + 4 * p, in + p * n + i, 4);
+				}
+
+				// the transpose is its own inverse
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(t)), mask));
+			}
+
+			for (; i < n; i++) {
+				u32 v = 0;
+
+				for (u8 p = 0; p < planes; p++) {
+					v |= static_cast<u32>(in[p * n + i]) << (8 * p);
+				}
+
+				out[i] = v;
+			}
+		}
+
+		HCNET_TARGET("ssse3") inline void undelta_dequantize_ssse3(const u32* in, const float inv_scale, i32* prev, float* out, const size_t n) noexcept {
+			const __m128 s = _mm_set1_ps(inv_scale);
+			const __m128i one = _mm_set1_epi32(1);
+
+			size_t i = 0;
+
+			for (; i + 4 <= n; i += 4) {
+				const __m128i z = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				const __m128i d = _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, one)));
+				const __m128i q = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i)), d);
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(prev + i), q);
+				_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(q), s));
+			}
+
+			undelta_dequantize_scalar(in + i, inv_scale, prev + i, out + i, n - i);
+		}
+
+		HCNET_TARGET("ssse3") inline void undelta_ssse3(const u32* in, u32* prev, u32* out, const size_t n) noexcept {
+			const __m128i one = _mm_set1_epi32(1);
+
+			size_t i = 0;
+
+			for (; i + 4 <= n; i += 4) {
+				const __m128i z = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+				const __m128i d = _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, one)));
+				const __m128i v = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i)), d);
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(prev + i), v);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+			}
+
+			undelta_scalar(in + i, prev + i, out + i, n - i);
+		}
+
+		HCNET_TARGET("avx2") inline u32 or_lanes_256(const __m256i v) noexcept {
+			alignas(32) u32 lanes[8];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+
+			return lanes[0] | lanes[1] | lanes[2] | lanes[3] | lanes[4] | lanes[5] | lanes[6] | lanes[7];
+		}
+
+		HCNET_TARGET("avx2") inline u32 quantize_delta_avx2(const float* in, const float scale, i32* prev, u32* out, const size_t n) noexcept {
+			const __m256 s = _mm256_set1_ps(scale);
+			__m256i any = _mm256_setzero_si256();
+
+			size_t i = 0;
+
+			for (; i + 8 <= n; i += 8) {
+				const __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(in + i), s));
+				const __m256i d = _mm256_sub_epi32(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i)));
+				const __m256i z = _mm256_xor_si256(_mm256_slli_epi32(d, 1), _mm256_srai_epi32(d, 31));
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(prev + i), q);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), z);
+
+				any = _mm256_or_si256(any, z);
+			}
+
+			return or_lanes_256(any) | quantize_delta_scalar(in + i, scale, prev + i, out + i, n - i);
+		}
+
+		HCNET_TARGET("avx2") inline u32 delta_avx2(const u32* in, u32* prev, u32* out, const size_t n) noexcept {
+			__m256i any = _mm256_setzero_si256();
+
+			size_t i = 0;
+
+			for (; i + 8 <= n; i += 8) {
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+				const __m256i d = _mm256_sub_epi32(v, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i)));
+				const __m256i z = _mm256_xor_si256(_mm256_slli_epi32(d, 1), _mm256_srai_epi32(d, 31));
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(prev + i), v);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), z);
+
+				any = _mm256_or_si256(any, z);
+			}
+
+			return or_lanes_256(any) | delta_scalar(in + i, prev + i, out + i, n - i);
+		}
+
+		// after the in-lane transpose the 32 bit groups are [p0 p1 p2 p3 | p0 p1 p2 p3] (4 entities each),
+		// gathered into 8 bytes per plane
+		HCNET_TARGET("avx2") inline void shuffle_avx2(const u32* in, const size_t n, const u8 planes, u8* out) noexcept {
+			const __m256i mask = _mm256_broadcastsi128_si256(byte_transpose_mask_128());
+			const __m256i gather = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+			size_t i = 0;
+
+			for (; i + 8 <= n; i += 8) {
+				const __m256i t = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), mask);
+
+				alignas(32) u8 g[32];
+				_mm256_store_si256(reinterpret_cast<__m256i*>(g), _mm256_permutevar8x32_epi32(t, gather));
+
+				for (u8 p = 0; p < planes; p++) {
+					std::memcpy(out + p * n + i, g + 8 * p, 8);
+				}
+			}
+
+			for (; i < n; i++) {
+				for (u8 p = 0; p < planes; p++) {
+					out[p * n + i] = static_cast<u8>(in[i] >> (8 * p));
+				}
+			}
+		}
+
+		HCNET_TARGET("avx2") inline void unshuffle_avx2(const u8* in, const size_t n, const u8 planes, u32* out) noexcept {
+			const __m256i mask = _mm256_broadcastsi128_si256(byte_transpose_mask_128());
+			const __m256i scatter = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+			size_t i = 0;
+
+			for (; i + 8 <= n; i += 8) {
+				alignas(32) u8 g[32]{};
+
+				for (u8 p = 0; p < planes; p++) {
+					std::memcpy(g + 8 * p, in + p * n + i, 8);
+				}
+
+				const __m256i t = _mm256_permutevar8x32_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(g)), scatter);
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_shuffle_epi8(t, mask));
+			}
+
+			for (; i < n; i++) {
+				u32 v = 0;
+
+				for (u8 p = 0; p < planes; p++) {
+					v |= static_cast<u32>(in[p * n + i]) << (8 * p);
+				}
+
+				out[i] = v;
+			}
+		}
+
+		HCNET_TARGET("avx2") inline void undelta_dequantize_avx2(const u32* in, const float inv_scale, i32* prev, float* out, const size_t n) noexcept {
+			const __m256 s = _mm256_set1_ps(inv_scale);
+			const __m256i one = _mm256_set1_epi32(1);
+
+			size_t i = 0;
+
+			for (; i + 8 <= n; i += 8) {
+				const __m256i z = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+				const __m256i d = _mm256_xor_si256(_mm256_srli_epi32(z, 1), _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(z, one)));
+				const __m256i q = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i)), d);
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(prev + i), q);
+				_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(q), s));
+			}
+
+			undelta_dequantize_scalar(in + i, inv_scale, prev + i, out + i, n - i);
+		}
+
+		HCNET_TARGET("avx2") inline void undelta_avx2(const u32* in, u32* prev, u32* out, const size_t n) noexcept {
+			const __m256i one = _mm256_set1_epi32(1);
+
+			size_t i = 0;
+
+			for (; i + 8 <= n; i += 8) {
+				const __m256i z = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+				const __m256i d = _mm256_xor_si256(_mm256_srli_epi32(z, 1), _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(z, one)));
+				const __m256i v = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i)), d);
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(prev + i), v);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+			}
+
+			undelta_scalar(in + i, prev + i, out + i, n - i);
+		}
+#endif
+
+		// Dispatch, the scalar kernels when the level isn't compiled in
+		inline u32 quantize_delta(const simd_level level, const float* in, const float scale, i32* prev, u32* out, const size_t n) noexcept {
+#ifdef HCNET_X86
+			switch (level) {
+			case simd_level::avx2:  return quantize_delta_avx2(in, scale, prev, out, n);
+			case simd_level::ssse3: return quantize_delta_ssse3(in, scale, prev, out, n);
+			default: break;
+			}
+#endif
+			return quantize_delta_scalar(in, scale, prev, out, n);
+		}
+
+		inline u32 delta(const simd_level level, const u32* in, u32* prev, u32* out, const size_t n) noexcept {
+#ifdef HCNET_X86
+			switch (level) {
+			case simd_level::avx2:  return delta_avx2(in, prev, out, n);
+			case simd_level::ssse3: return delta_ssse3(in, prev, out, n);
+			default: break;
+			}
+#endif
+			return delta_scalar(in, prev, out, n);
+		}
+
+		inline void shuffle(const simd_level level, const u32* in, const size_t n, const u8 planes, u8* out) noexcept {
+#ifdef HCNET_X86
+			switch (level) {
+			case simd_level::avx2:  return shuffle_avx2(in, n, planes, out);
+			case simd_level::ssse3: return shuffle_ssse3(in, n, planes, out);
+			default: break;
+			}
+#endif
+			shuffle_scalar(in, n, planes, out);
+		}
+
+		inline void unshuffle(const simd_level level, const u8* in, const size_t n, const u8 planes, u32* out) noexcept {
+#ifdef HCNET_X86
+			switch (level) {
+			case simd_level::avx2:  return unshuffle_avx2(in, n, planes, out);
+			case simd_level::ssse3: return unshuffle_ssse3(in, n, planes, out);
+			default: break;
+			}
+#endif
+			unshuffle_scalar(in, n, planes, out);
+		}
+
+		inline void undelta_dequantize(const simd_level level, const u32* in, const float inv_scale, i32* prev, float* out, const size_t n) noexcept {
+#ifdef HCNET_X86
+			switch (level) {
+			case simd_level::avx2:  return undelta_dequantize_avx2(in, inv_scale, prev, out, n);
+			case simd_level::ssse3: return undelta_dequantize_ssse3(in, inv_scale, prev, out, n);
+			default: break;
+			}
+#endif
+			undelta_dequantize_scalar(in, inv_scale, prev, out, n);
+		}
+
+		inline void undelta(const simd_level level, const u32* in, u32* prev, u32* out, const size_t n) noexcept {
+#ifdef HCNET_X86
+			switch (level) {
+			case simd_level::avx2:  return undelta_avx2(in, prev, out, n);
+			case simd_level::ssse3: return undelta_ssse3(in, prev, out, n);
+			default: break;
+			}
+#endif
+			undelta_scalar(in, prev, out, n);
+		}
+	}
+
+	/// Encodes a tick of entity updates against the previous one, for an `EntityDecoder` that got every batch before it.
+	/// Positions are quantized to multiples of `precision`, they must stay within ±2^31 of it.
+	///
+	/// * a keyframe (deltas against zero) is sent first, whenever the entity count changes, and every `keyframe_interval` batches
+	/// * unreliable channels need keyframes often enough, or a way to resync a decoder that missed a batch,
+	///   every batch carries its sequence and a decoder rejects the deltas after a lost one
+	class EntityEncoder {
+	public:
+
+		EntityEncoder(const float precision, const u32 keyframe_interval = 0, const simd_level level = detail::best_simd()) noexcept :
+			scale(1.f / precision),
+			keyframe_interval(keyframe_interval),
+			level(level)
+		{}
+
+		/// appends the batch to `out`
+		void Encode(entity_soa_view const& entities, std::vector<u8>& out) noexcept {
+			const size_t n = entities.size();
+
+			const bool keyframe = n != count || force_keyframe || (keyframe_interval != 0 && since_keyframe >= keyframe_interval);
+
+			if (keyframe) {
+				for (auto& p : prev_q) {
+					p.assign(n, 0);
+				}
+
+				prev_flags.assign(n, 0);
+
+				count = n;
+				since_keyframe = 0;
+				force_keyframe = false;
+			}
+
+			since_keyframe++;
+
+			deltas.resize(n);
+
+			const size_t first = out.size();
+			out.resize(first + detail::entity_batch_preamble + detail::entity_channels * (1 + 4 * n));
+
+			u8* w = out.data() + first;
+
+			const u32 preamble[3] = { static_cast<u32>(n), sequence, sequence - 1 };
+			std::memcpy(w, preamble, sizeof(preamble));
+			w[sizeof(preamble)] = keyframe;
+			w += detail::entity_batch_preamble;
+
+			sequence++;
+
+			const std::span<const float> positions[detail::entity_position_channels] = { entities.x, entities.y, entities.z };
+
+			for (size_t c = 0; c < detail::entity_position_channels; c++) {
+				const u32 any = detail::quantize_delta(level, positions[c].data(), scale, prev_q[c].data(), deltas.data(), n);
+				w = Channel(any, w);
+			}
+
+			w = Channel(detail::delta(level, entities.flags.data(), prev_flags.data(), deltas.data(), n), w);
+
+			out.resize(static_cast<size_t>(w - out.data()));
+		}
+
+		/// the next batch is a keyframe, for a decoder that joined or missed one
+		void ForceKeyframe() noexcept {
+			force_keyframe = true;
+		}
+
+	private:
+		u8* Channel(const u32 any, u8* w) noexcept {
+			const u8 planes = detail::planes_for(any);
+
+			*w++ = planes;
+			detail::shuffle(level, deltas.data(), count, planes, w);
+
+			return w + planes * count;
+		}
+
+		const float scale;
+		const u32 keyframe_interval;
+		const simd_level level;
+
+		std::vector<i32> prev_q[detail::entity_position_channels];
+		std::vector<u32> prev_flags;
+		std::vector<u32> deltas;
+
+		size_t count = 0;
+		u32 sequence = 0;
+		u32 since_keyframe = 0;
+		bool force_keyframe = true;
+	};
+
+	/// Decodes the batches of an `EntityEncoder` with the same `precision`, in the order they were encoded
+	class EntityDecoder {
+	public:
+
+		EntityDecoder(const float precision, const simd_level level = detail::best_simd()) noexcept :
+			inv_scale(precision),
+			level(level)
+		{}
+
+		/// Returns false when `in` is malformed, a delta against a batch other than the last one decoded
+		/// (one was lost, or they came out of order), or a keyframe older than that batch.
+		/// `out` is left as it was, after a lost batch wait for a keyframe
+		bool Decode(std::span<const u8> in, entity_soa& out) noexcept {
+			if (in.size() < detail::entity_batch_preamble) {
+				return false;
+			}
+
+			u32 preamble[3];
+			std::memcpy(preamble, in.data(), sizeof(preamble));
+
+			const size_t n = preamble[0];
+			const u32 sequence = preamble[1];
+			const u32 base = preamble[2];
+			const bool keyframe = in[sizeof(preamble)] != 0;
+
+			if (keyframe
+				? synced && static_cast<i32>(sequence - last) <= 0
+				: not synced || base != last || n != count)
+			{
+				return false;
+			}
+
+			// validated whole before anything is decoded
+			size_t at = detail::entity_batch_preamble;
+
+			for (size_t c = 0; c < detail::entity_channels; c++) {
+				if (at >= in.size() || in[at] > 4 || in.size() - at - 1 < in[at] * n) {
+					return false;
+				}
+
+				at += 1 + in[at] * n;
+			}
+
+			if (keyframe) {
+				for (auto& p : prev_q) {
+					p.assign(n, 0);
+				}
+
+				prev_flags.assign(n, 0);
+
+				count = n;
+				synced = true;
+			}
+
+			out.resize(n);
+			deltas.resize(n);
+
+			const u8* r = in.data() + detail::entity_batch_preamble;
+
+			float* positions[detail::entity_position_channels] = { out.x.data(), out.y.data(), out.z.data() };
+
+			for (size_t c = 0; c < detail::entity_position_channels; c++) {
+				r = Channel(r);
+				detail::undelta_dequantize(level, deltas.data(), inv_scale, prev_q[c].data(), positions[c], n);
+			}
+
+			r = Channel(r);
+			detail::undelta(level, deltas.data(), prev_flags.data(), out.flags.data(), n);
+
+			last = sequence;
+
+			return true;
+		}
+
+	private:
+		const u8* Channel(const u8* r) noexcept {
+			const u8 planes = *r++;
+
+			detail::unshuffle(level, r, count, planes, deltas.data());
+
+			return r + planes * count;
+		}
+
+		const float inv_scale;
+		const simd_level level;
+
+		std::vector<i32> prev_q[detail::entity_position_channels];
+		std::vector<u32> prev_flags;
+		std::vector<u32> deltas;
+
+		size_t count = 0;
+		u32 last = 0; // the sequence of the last batch decoded
+		bool synced = false;
+	};
+}
\ No newline at end of file
@@ -6,9 +6,14 @@ namespace net {
 	enum class net_error {
 		unknown_msg_type,
 		failed_to_connect,
+		failed_to_listen,
 		failed_to_run_io_context,
 		failed_to_read,
-		failed_to_write
+		failed_to_write,
+		slow_consumer,
+		timed_out,    // nothing was received for `keepalive_config::timeout_ms`
+		file_transfer,    // a streamed file couldn't be opened or written, the transfer is cancelled (see `Host::SendFile`)
+		message_too_large // a packet the peer sent in pieces grew past `max_message_bytes`
 	};
 
 	enum class upnp_error {
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <array>
+#include <span>
+#include <limits>
+
+namespace net {
+
+	enum class event_kind : u8 {
+		connected,    // host only, the wire finished its handshake
+		disconnected,
+		packet_tcp,
+		packet_udp
+	};
+
+	// An inbound event of a host or a client in pull mode (see `host_config::pull_events`)
+	template <typename PacketTCP, typename PacketUDP>
+	struct net_event {
+		event_kind kind = event_kind::connected;
+
+		// the wire on a host, the packet's sender on a client (-1 for `disconnected`)
+		i16 from_id = -1;
+
+		gef::unique_ref<PacketTCP> tcp{ nullptr }; // `packet_tcp` only
+		gef::unique_ref<PacketUDP> udp{ nullptr }; // `packet_udp` only
+
+		// `disconnected` only, what `on_close_connection` would have been given, nullopt when it closed cleanly
+		gef::option<net_error> error = gef::nullopt;
+		std::error_code ec{};
+	};
+
+	namespace detail {
+		// the `disconnected` event of a close with `err`, clean when on_close_connection's would be
+		template <typename Event>
+		Event close_event(const i16 from_id, error_info const& err) noexcept {
+			Event e{ .kind = event_kind::disconnected, .from_id = from_id };
+
+			err.ec.inspect(
+				[&](std::error_code const& ec) {
+					if (ec != asio::error::eof) {
+						e.error = gef::option<net_error>{ err.what };
+						e.ec = ec;
+					}
+				});
+
+			return e;
+		}
+	}
+
+	// The events of a connection's io thread, drained in batches by the application's thread.
+	//
+	// * lock-free, any number of producers, one consumer
+	// * a producer's events come out in the order it pushed them, a connection's events all come from its io thread
+	template <typename Event>
+	class EventQueue {
+	public:
+		inline static constexpr size_t batch_size = 64;
+
+		void Push(Event&& e) noexcept {
+			queue.enqueue(std::move(e));
+		}
+
+		// Moves up to `out.size()` events into `out`, returns how many
+		size_t Poll(std::span<Event> out) noexcept {
+			return queue.try_dequeue_bulk(out.begin(), out.size());
+		}
+
+		// `f(Event&)` for up to `max` queued events, a batch at a time, returns how many
+		template <typename F>
+		size_t ForEach(F&& f, const size_t max = std::numeric_limits<size_t>::max()) noexcept {
+			size_t total = 0;
+
+			while (total < max) {
+				const size_t count = queue.try_dequeue_bulk(batch.begin(), std::min<size_t>(batch.size(), max - total));
+
+				for (size_t i = 0; i < count; i++) {
+					f(batch[i]);
+					batch[i] = Event{};
+				}
+
+				total += count;
+
+				if (count < batch.size()) {
+					break;
+				}
+			}
+
+			return total;
+		}
+
+		size_t size_approx() const noexcept {
+			return queue.size_approx();
+		}
+
+	private:
+		moodycamel::ConcurrentQueue<Event> queue;
+
+		std::array<Event, batch_size> batch; // ForEach() only, the consumer's
+	};
+}
\ No newline at end of file
@@ -0,0 +1,418 @@
+#pragma once
+
+#include "canyon.hpp"
+#include "control.hpp"
+#include "capture.hpp"
+#include <atomic>
+#include <memory>
+
+#ifdef _WIN32
+#include "win32.hpp"
+#else
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+namespace net {
+
+	// Linux, a streamed file's chunks go from the file to the socket in the kernel (see `file_stream_config`)
+#ifdef __linux__
+	inline constexpr bool sendfile_supported = true;
+#else
+	inline constexpr bool sendfile_supported = false;
+#endif
+
+	namespace detail {
+		// A file read or written at offsets, a transfer's and its queued chunks'
+		class stream_file {
+		public:
+
+			stream_file() noexcept {}
+
+			stream_file(stream_file const&) = delete;
+
+			~stream_file() noexcept {
+				Close();
+			}
+
+			// writable - creates the file if it's missing, what's there is kept to resume after
+			std::error_code Open(std::string const& path, const bool writable) noexcept {
+#ifdef _WIN32
+				file = ::CreateFileA(path.c_str(),
+					writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+					FILE_SHARE_READ, nullptr,
+					writable ? OPEN_ALWAYS : OPEN_EXISTING,
+					FILE_ATTRIBUTE_NORMAL, nullptr);
+
+				if (file == INVALID_HANDLE_VALUE) {
+					return last_system_error();
+				}
+
+				LARGE_INTEGER file_size;
+
+				if (not ::GetFileSizeEx(file, &file_size)) {
+					return last_system_error();
+				}
+
+				file_bytes = static_cast<u64>(file_size.QuadPart);
+
+				FILETIME written;
+
+				if (not ::GetFileTime(file, nullptr, nullptr, &written)) {
+					return last_system_error();
+				}
+
+				file_modified = from_filetime(written);
+#else
+				fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+
+				if (fd < 0) {
+					return last_system_error();
+				}
+
+				struct stat st;
+
+				if (::fstat(fd, &st) != 0) {
+					return last_system_error();
+				}
+
+				file_bytes = static_cast<u64>(st.st_size);
+#ifdef __APPLE__
+				file_modified = static_cast<u64>(st.st_mtimespec.tv_sec) * 1'000'000'000 + static_cast<u64>(st.st_mtimespec.tv_nsec);
+#else
+				file_modified = static_cast<u64>(st.st_mtim.tv_sec) * 1'000'000'000 + static_cast<u64>(st.st_mtim.tv_nsec);
+#endif
+#endif
+				return {};
+			}
+
+			void Close() noexcept {
+#ifdef _WIN32
+				if (file != INVALID_HANDLE_VALUE) { ::CloseHandle(file); }
+
+				file = INVALID_HANDLE_VALUE;
+#else
+				if (fd >= 0) { ::close(fd); }
+
+				fd = -1;
+#endif
+			}
+
+			std::error_code Truncate(const u64 size) noexcept {
+#ifdef _WIN32
+				LARGE_INTEGER end;
+				end.QuadPart = static_cast<LONGLONG>(size);
+
+				if (not ::SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || not ::SetEndOfFile(file)) {
+					return last_system_error();
+				}
+#else
+				if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+					return last_system_error();
+				}
+#endif
+				file_bytes = size;
+
+				return {};
+			}
+
+			// all of `out`, a file that ends before is an error
+			std::error_code ReadAt(u64 offset, mut_buf out) noexcept {
+				while (out.size() > 0) {
+#ifdef _WIN32
+					OVERLAPPED at{};
+					at.Offset = static_cast<DWORD>(offset);
+					at.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+					DWORD read = 0;
+
+					if (not ::ReadFile(file, out.data(), static_cast<DWORD>(out.size()), &read, &at)) {
+						return last_system_error();
+					}
+#else
+					const ssize_t read = ::pread(fd, out.data(), out.size(), static_cast<off_t>(offset));
+
+					if (read < 0) {
+						if (errno == EINTR) {
+							continue;
+						}
+
+						return last_system_error();
+					}
+#endif
+					if (read == 0) {
+						return asio::error::eof;
+					}
+
+					offset += static_cast<u64>(read);
+					out += static_cast<size_t>(read);
+				}
+
+				return {};
+			}
+
+			std::error_code WriteAt(u64 offset, const_buf in) noexcept {
+				while (in.size() > 0) {
+#ifdef _WIN32
+					OVERLAPPED at{};
+					at.Offset = static_cast<DWORD>(offset);
+					at.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+					DWORD written = 0;
+
+					if (not ::WriteFile(file, in.data(), static_cast<DWORD>(in.size()), &written, &at)) {
+						return last_system_error();
+					}
+#else
+					const ssize_t written = ::pwrite(fd, in.data(), in.size(), static_cast<off_t>(offset));
+
+					if (written < 0) {
+						if (errno == EINTR) {
+							continue;
+						}
+
+						return last_system_error();
+					}
+#endif
+					offset += static_cast<u64>(written);
+					in += static_cast<size_t>(written);
+				}
+
+				file_bytes = std::max<u64>(file_bytes, offset);
+
+				return {};
+			}
+
+			// Writes `head`, then `len` bytes of the file from `offset`, which the kernel copies to the socket itself (Linux).
+			// The head is held back (MSG_MORE) to leave with the data. A full socket buffer is waited out,
+			// asio keeps the socket non-blocking.
+			// - eof if the file got shorter than `offset + len`: nothing is written if it already was,
+			//   the rest of the data is zeros if it got shorter meanwhile, the stream's framing holds either way
+			asio::error_code SendTo(tcp::socket& socket, const const_buf head, const u64 offset, size_t len) noexcept {
+				asio::error_code ec;
+#ifdef __linux__
+				struct stat st;
+
+				if (::fstat(fd, &st) == 0 && static_cast<u64>(st.st_size) < offset + len) {
+					return asio::error::eof;
+				}
+
+				static constexpr std::array<u8, 4096> zeros{};
+
+				const int out = socket.native_handle();
+
+				const u8* head_at = static_cast<const u8*>(head.data());
+				size_t head_left = head.size();
+				off_t at = static_cast<off_t>(offset);
+				bool cut = false;
+
+				while (head_left > 0 || len > 0) {
+					const ssize_t sent = head_left > 0
+						? ::send(out, head_at, head_left, MSG_MORE | MSG_NOSIGNAL)
+						: cut ? ::send(out, zeros.data(), std::min(len, zeros.size()), MSG_NOSIGNAL)
+						: ::sendfile(out, fd, &at, len);
+
+					if (sent > 0) {
+						if (head_left > 0) {
+							head_at += sent;
+							head_left -= static_cast<size_t>(sent);
+						}
+						else {
+							len -= static_cast<size_t>(sent);
+						}
+
+						continue;
+					}
+
+					if (sent == 0) { // the file got shorter since the check
+						cut = true;
+						continue;
+					}
+
+					if (errno == EINTR) {
+						continue;
+					}
+
+					if (errno != EAGAIN && errno != EWOULDBLOCK) {
+						return last_system_error();
+					}
+
+					socket.wait(tcp::socket::wait_write, ec);
+
+					if (ec) {
+						return ec;
+					}
+				}
+
+				if (cut) {
+					return asio::error::eof;
+				}
+#else
+				ec = asio::error::operation_not_supported;
+#endif
+				return ec;
+			}
+
+			// Sets the last write time, ns since the epoch. A write changes it again
+			std::error_code SetModified(const u64 ns) noexcept {
+#ifdef _WIN32
+				const FILETIME written = to_filetime(ns);
+
+				if (not ::SetFileTime(file, nullptr, nullptr, &written)) {
+					return last_system_error();
+				}
+#else
+				const timespec times[2] = {
+					{ 0, UTIME_OMIT }, // access
+					{ static_cast<time_t>(ns / 1'000'000'000), static_cast<long>(ns % 1'000'000'000) }
+				};
+
+				if (::futimens(fd, times) != 0) {
+					return last_system_error();
+				}
+#endif
+				file_modified = ns;
+
+				return {};
+			}
+
+			constexpr u64 size() const noexcept {
+				return file_bytes;
+			}
+
+			// the last write time when opened, or as SetModified() left it, ns since the epoch
+			constexpr u64 modified() const noexcept {
+				return file_modified;
+			}
+
+			// The file got shorter than its transfer's size, true the first time. Its chunks from there are dropped
+			bool MarkShrunk() noexcept {
+				return not shrunk.exchange(true, std::memory_order_relaxed);
+			}
+
+			bool has_shrunk() const noexcept {
+				return shrunk.load(std::memory_order_relaxed);
+			}
+
+		private:
+#ifdef _WIN32
+			// FILETIME counts 100ns from 1601
+			static constexpr u64 filetime_epoch = 116444736000000000;
+
+			static u64 from_filetime(const FILETIME ft) noexcept {
+				const u64 ticks = (static_cast<u64>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+				return ticks < filetime_epoch ? 0 : (ticks - filetime_epoch) * 100;
+			}
+
+			static FILETIME to_filetime(const u64 ns) noexcept {
+				const u64 ticks = ns / 100 + filetime_epoch;
+				return { static_cast<DWORD>(ticks), static_cast<DWORD>(ticks >> 32) };
+			}
+#endif
+
+#ifdef _WIN32
+			HANDLE file = INVALID_HANDLE_VALUE;
+#else
+			int fd = -1;
+#endif
+			u64 file_bytes = 0;
+			u64 file_modified = 0;
+			std::atomic<bool> shrunk{ false };
+		};
+
+		// A chunk of a file the host streams, its data stays in the file until it's written (see `SocketTCP`).
+		// Where the writer can't send it from the file, Load() reads it into memory first, the data's buffer
+		// in const_buf_seq() is sized but empty until then. Send only
+		class file_chunk_out : public any_msg {
+		public:
+			file_chunk_out(std::shared_ptr<stream_file> file, const u32 transfer, const u64 offset, const u32 len) noexcept :
+				file(std::move(file)), prefix{ transfer, offset }, len(len)
+			{}
+
+			std::vector<const_buf> const_buf_seq(i16& msg_type) const noexcept override {
+				msg_type = control_msg::file_chunk;
+
+				return { const_buf{}, const_buf{ &prefix, sizeof(prefix) }, const_buf{ data.get(), len } };
+			}
+
+			std::vector<mut_buf> mut_buf_seq() noexcept override {
+				return {};
+			}
+
+			std::vector<mut_buf> mut_buf_seq_with_header(i16&) noexcept override {
+				return {};
+			}
+
+			// once, by the thread that queues or writes the chunk
+			std::error_code Load() noexcept {
+				if (data) {
+					return {};
+				}
+
+				data = std::make_unique_for_overwrite<u8[]>(len);
+
+				return file->ReadAt(prefix.offset, mut_buf{ data.get(), len });
+			}
+
+			constexpr bool loaded() const noexcept {
+				return data != nullptr;
+			}
+
+			// the chunk's header, `head`, then its prefix and data, see `stream_file::SendTo`
+			asio::error_code SendFromFile(tcp::socket& socket, const const_buf head) noexcept {
+				std::array<u8, 32> framed;
+
+				const size_t head_size = asio::buffer_copy(asio::buffer(framed), std::array<const_buf, 2>{ head, const_buf{ &prefix, sizeof(prefix) } });
+
+				return file->SendTo(socket, const_buf{ framed.data(), head_size }, prefix.offset, len);
+			}
+
+			constexpr u32 transfer() const noexcept {
+				return prefix.transfer;
+			}
+
+			stream_file& source() noexcept {
+				return *file;
+			}
+
+		private:
+			std::shared_ptr<stream_file> file;
+			file_chunk_prefix prefix;
+			u32 len;
+			std::unique_ptr<u8[]> data;
+		};
+
+		// The chunk an out-going `control_msg::file_chunk` carries, only the host sends them
+		template <typename Packet>
+		file_chunk_out& file_chunk_of(Packet& p) noexcept {
+			return static_cast<file_chunk_out&>(p.m.value_unchecked().get());
+		}
+	}
+
+	// A file the host streams to a wire, see `Host::SendFile`
+	struct file_transfer {
+		u32 id;
+		i16 to;
+		std::shared_ptr<detail::stream_file> file;
+		u64 size;
+		u64 next = 0;  // the offset of the next chunk to queue
+		u64 acked = 0; // the client has the file up to here
+	};
+
+	// A file the host streams to the client, written where its on_file_offer() put it.
+	// Stamped with the host's file's last write time after every chunk, what a resume checks (see `file_offer`)
+	struct file_download {
+		u32 id;
+		std::unique_ptr<detail::stream_file> file;
+		u64 size;
+		u64 modified;
+		u64 received = 0;
+		bool resume_asked = false; // a chunk went missing, the host was asked for the rest from `received`
+	};
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <array>
+
+namespace net::detail {
+
+	// `framing::compact` headers, little-endian whatever the machine's byte order.
+	// `from_id` is written only when it differs from the implied one, the host's id
+	//
+	// TCP: [desc][msg_type: i8 or i16][from_id: i16][size: 0, 1, 2 or 4 bytes]
+	//   desc bits 0-1 - how many bytes the size takes: 0, 1, 2, 4. With 0 the size (< 16) is in bits 4-7
+	//   desc bit  2   - msg_type is an i16
+	//   desc bit  3   - from_id follows
+	//
+	// UDP: [desc][msg_type: i16][from_id: i16]
+	//   desc bit  7   - msg_type is an i16 and follows, otherwise bits 0-5 hold msg_type + 32 (-32 .. 31)
+	//   desc bit  6   - from_id follows
+
+	inline constexpr size_t compact_header_max = 9;
+
+	// desc and an i8 msg_type, the shortest TCP header
+	inline constexpr size_t compact_tcp_header_min = 2;
+
+	using compact_header = std::array<u8, compact_header_max>;
+
+	inline constexpr std::array<u8, 4> compact_size_bytes{ 0, 1, 2, 4 };
+
+	constexpr void put_le(u8*& out, const u32 value, const size_t bytes) noexcept {
+		for (size_t i = 0; i < bytes; i++) {
+			*out++ = static_cast<u8>(value >> (8 * i));
+		}
+	}
+
+	constexpr u32 get_le(const u8*& in, const size_t bytes) noexcept {
+		u32 value = 0;
+
+		for (size_t i = 0; i < bytes; i++) {
+			value |= static_cast<u32>(*in++) << (8 * i);
+		}
+
+		return value;
+	}
+
+	template <typename Header>
+	constexpr bool writes_from(Header const& h, const i16 implied_from) noexcept {
+		if constexpr (requires { h.from_id; }) {
+			return h.from_id != implied_from;
+		}
+		else {
+			return false;
+		}
+	}
+
+	template <typename Header>
+	constexpr void read_from(Header& h, const bool present, const u8*& in, const i16 implied_from) noexcept {
+		const i16 from_id = present ? static_cast<i16>(get_le(in, 2)) : implied_from;
+
+		if constexpr (requires { h.from_id; }) {
+			h.from_id = from_id;
+		}
+	}
+
+	// Returns the header's size
+	template <typename Header>
+	constexpr size_t encode_compact_tcp(Header const& h, const i16 implied_from, u8* out) noexcept {
+		u8* const first = out;
+
+		const bool wide = h.msg_type < -128 || h.msg_type > 127;
+		const bool from = writes_from(h, implied_from);
+
+		const u8 size_code = h.size < 16 ? 0 : h.size <= 0xFF ? 1 : h.size <= 0xFFFF ? 2 : 3;
+
+		*out++ = static_cast<u8>(size_code | (wide << 2) | (from << 3) | (size_code == 0 ? h.size << 4 : 0));
+
+		put_le(out, static_cast<u16>(h.msg_type), wide ? 2 : 1);
+
+		if constexpr (requires { h.from_id; }) {
+			if (from) {
+				put_le(out, static_cast<u16>(h.from_id), 2);
+			}
+		}
+
+		put_le(out, h.size, compact_size_bytes[size_code]);
+
+		return static_cast<size_t>(out - first);
+	}
+
+	// the whole header's size, from its first byte
+	constexpr size_t compact_tcp_header_size(const u8 desc) noexcept {
+		return 1 + ((desc & 0b100) ? 2 : 1) + ((desc & 0b1000) ? 2 : 0) + compact_size_bytes[desc & 0b11];
+	}
+
+	template <typename Header>
+	constexpr void decode_compact_tcp(const u8* in, Header& h, const i16 implied_from) noexcept {
+		const u8 desc = *in++;
+
+		h.msg_type = (desc & 0b100)
+			? static_cast<i16>(get_le(in, 2))
+			: static_cast<i8>(get_le(in, 1));
+
+		read_from(h, desc & 0b1000, in, implied_from);
+
+		h.size = (desc & 0b11) == 0
+			? desc >> 4
+			: get_le(in, compact_size_bytes[desc & 0b11]);
+	}
+
+	// Returns the header's size
+	template <typename Header>
+	constexpr size_t encode_compact_udp(Header const& h, const i16 implied_from, u8* out) noexcept {
+		u8* const first = out;
+
+		const bool wide = h.msg_type < -32 || h.msg_type > 31;
+		const bool from = writes_from(h, implied_from);
+
+		*out++ = static_cast<u8>((wide << 7) | (from << 6) | (wide ? 0 : h.msg_type + 32));
+
+		if (wide) {
+			put_le(out, static_cast<u16>(h.msg_type), 2);
+		}
+
+		if constexpr (requires { h.from_id; }) {
+			if (from) {
+				put_le(out, static_cast<u16>(h.from_id), 2);
+			}
+		}
+
+		return static_cast<size_t>(out - first);
+	}
+
+	// Returns the header's size, 0 when the datagram is too short to hold it
+	template <typename Header>
+	constexpr size_t decode_compact_udp(const u8* in, const size_t size, Header& h, const i16 implied_from) noexcept {
+		if (size == 0) {
+			return 0;
+		}
+
+		const u8 desc = *in++;
+		const size_t header_size = 1 + ((desc & 0x80) ? 2 : 0) + ((desc & 0x40) ? 2 : 0);
+
+		if (size < header_size) {
+			return 0;
+		}
+
+		h.msg_type = (desc & 0x80)
+			? static_cast<i16>(get_le(in, 2))
+			: static_cast<i16>((desc & 0x3F) - 32);
+
+		read_from(h, desc & 0x40, in, implied_from);
+
+		return header_size;
+	}
+}
\ No newline at end of file
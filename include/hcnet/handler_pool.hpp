@@ -0,0 +1,114 @@
+#pragma once
+
+#include "canyon.hpp"
+#include "thread.hpp"
+#include <chrono>
+#include <optional>
+
+namespace net {
+
+	// How long the packets waited between their read and their handler, see `HandlerPool`
+	struct handler_stats {
+		u64 handled = 0;
+		u64 pending = 0; // queued, not handled yet
+		u64 delay_total_ns = 0;
+		u64 delay_max_ns = 0;
+
+		constexpr double mean_delay_us() const noexcept {
+			return handled == 0 ? 0.0 : delay_total_ns / 1e3 / handled;
+		}
+	};
+
+	// Runs the application's packet handlers on worker threads instead of the io thread.
+	// A strand per connection and protocol keeps their handlers in the order the packets were read,
+	// the strands of different connections run in parallel.
+	//
+	// * Start() / Stop() from one thread, Post() from any while it runs
+	class HandlerPool {
+	public:
+		using clock = std::chrono::steady_clock;
+		using strand = asio::strand<asio::io_context::executor_type>;
+
+		~HandlerPool() noexcept {
+			Stop();
+		}
+
+		void Start(const u8 workers, thread_config const& threads) noexcept {
+			if (workers == 0) {
+				return;
+			}
+
+			ctx.restart();
+			work.emplace(asio::make_work_guard(ctx));
+
+			for (u8 i = 0; i < workers; i++) {
+				pool.push_back(spawn_thread(threads, thread_role::handler, "hcnet-handler",
+					[this]() {
+						asio::error_code ec;
+						ctx.run(ec);
+					}));
+			}
+		}
+
+		// Runs the handlers queued so far, then joins the workers
+		void Stop() noexcept {
+			work.reset();
+
+			for (std::thread& t : pool) {
+				if (t.joinable()) { t.join(); }
+			}
+
+			pool.clear();
+		}
+
+		constexpr bool is_running() const noexcept {
+			return not pool.empty();
+		}
+
+		strand MakeStrand() noexcept {
+			return asio::make_strand(ctx);
+		}
+
+		// `handler()` runs on a worker after the ones posted to `s` before it
+		template <typename F>
+		void Post(strand const& s, F&& handler) noexcept {
+			const clock::time_point queued_at = clock::now();
+
+			pending.fetch_add(1, std::memory_order_relaxed);
+
+			asio::post(s,
+				[this, queued_at, handler = std::forward<F>(handler)]() mutable {
+					const u64 delay_ns = static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - queued_at).count());
+
+					pending.fetch_sub(1, std::memory_order_relaxed);
+					handled.fetch_add(1, std::memory_order_relaxed);
+					delay_total_ns.fetch_add(delay_ns, std::memory_order_relaxed);
+
+					u64 max = delay_max_ns.load(std::memory_order_relaxed);
+					while (delay_ns > max && not delay_max_ns.compare_exchange_weak(max, delay_ns, std::memory_order_relaxed)) {}
+
+					handler();
+				});
+		}
+
+		// any thread
+		handler_stats stats() const noexcept {
+			return {
+				handled.load(std::memory_order_relaxed),
+				pending.load(std::memory_order_relaxed),
+				delay_total_ns.load(std::memory_order_relaxed),
+				delay_max_ns.load(std::memory_order_relaxed)
+			};
+		}
+
+	private:
+		asio::io_context ctx;
+		std::optional<asio::executor_work_guard<asio::io_context::executor_type>> work;
+		std::vector<std::thread> pool;
+
+		std::atomic<u64> handled{ 0 };
+		std::atomic<u64> pending{ 0 };
+		std::atomic<u64> delay_total_ns{ 0 };
+		std::atomic<u64> delay_max_ns{ 0 };
+	};
+}
\ No newline at end of file
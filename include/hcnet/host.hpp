@@ -2,9 +2,28 @@
 
 #include "canyon.hpp"
 #include "socket.hpp"
+#include "mesh.hpp"
+#include "tick.hpp"
+#include "timer_wheel.hpp"
+#include "busy_poll.hpp"
+#include "thread.hpp"
+#include "handler_pool.hpp"
+#include "events.hpp"
+#include "session_table.hpp"
+#include <limits>
 
 namespace net {
 
+namespace detail {
+#ifdef SO_REUSEPORT
+	using reuse_port = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+	inline constexpr bool reuse_port_supported = true;
+#else
+	inline constexpr bool reuse_port_supported = false;
+#endif
+}
+
 template <class Hoster>
 class Host;
 
@@ -19,14 +38,42 @@ private:
 	friend SocketUDP<self_t, std::shared_ptr, header_server_UDP, header_client_UDP>;
 
 
-	std::jthread self_thread;
-
 	SocketTCP<self_t, std::shared_ptr, header_server_TCP, header_client_TCP> tcp_socket;
 	SocketUDP<self_t, std::shared_ptr, header_server_UDP, header_client_UDP> udp_socket;
 
 	i16 m_id{ -1 };
 
-	bool connected;
+	// tells this wire apart from a later one with the same id, or at the same address (see `Host::CloseWire`)
+	const u64 serial;
+
+	std::atomic<bool> connected;
+
+	// see `mesh_config`
+	std::atomic<bool> mesh_registered{ false };
+	udp::endpoint mesh_endpoint;
+	gef::mutex<std::vector<mesh_path>> mesh_direct; // the paths that are up, to the peers this wire reaches without the host
+
+	// see `mesh_config::relay_fanout`, io thread only
+	u8 relay_capacity = 0;
+	std::vector<i16> relay_children;
+
+	// see `host_config::header_framing`, handshake only
+	bool compact_requested = false;
+	header_server_TCP framing_granted{};
+
+	// see `keepalive_config`, ms on the host's `elapsed_ms()` clock
+	std::atomic<i64> last_in_ms{ 0 };
+	std::atomic<i64> last_out_ms{ 0 };
+	i64 keepalive_due_ms = 0; // io thread only, the wheel's entries for other deadlines are stale
+
+	u32 session_slot = SessionTable<self_t>::no_slot; // see `Host::m_sessions`
+
+	// see `handler_config`, keep the handlers of each protocol in order
+	HandlerPool::strand tcp_handlers;
+	HandlerPool::strand udp_handlers;
+
+	// see `shm_config`, after the sockets: its reader, delivering into them, is joined before they're gone
+	std::unique_ptr<ShmLink> shm;
 
 	static Hoster* running_host;
 
@@ -38,6 +85,8 @@ public:
 	using PacketTCPclient = Host<Hoster>::PacketTCPclient;
 	using PacketUDPclient = Host<Hoster>::PacketUDPclient;
 
+	using Event = Host<Hoster>::Event;
+
 	struct allowed {
 		gef::unique_ref<PacketTCP> hinfo;
 		gef::unique_ref<PacketTCP> cinfo;
@@ -49,15 +98,20 @@ public:
 	};
 
 	Wire(asio::io_context& ctx, tcp::socket&& s) noexcept :
+		serial(running_host->m_wire_serial.fetch_add(1, std::memory_order_relaxed)),
 		connected(false),
-		tcp_socket(*this, ctx, std::move(s)),
-		udp_socket(*this, ctx)
+		tcp_socket(*this, ctx, std::move(s), running_host->config().tcp_queue, running_host->config().io_writes),
+		udp_socket(*this, ctx, running_host->config().udp_queue, running_host->config().io_writes),
+		tcp_handlers(running_host->m_handlers.MakeStrand()),
+		udp_handlers(running_host->m_handlers.MakeStrand())
 	{}
 
 	~Wire() noexcept {}
 
 private:
 
+	// Runs on the thread that accepted `s`, which may not be the io thread (see `accept_config::threads`),
+	// the wire is moved to `ctx` once its handshake is done
 	static void Init(asio::io_context& ctx, tcp::socket&& s) noexcept {
 		auto new_wire = gef::unique_ref<self_t>::make( ctx, std::move(s) );
 
@@ -74,6 +128,11 @@ private:
 			return;
 		}
 
+		const u32 busy_poll_us = new_wire->running_host->config().busy_poll.socket_busy_poll_us;
+
+		set_busy_poll(new_wire->tcp_socket.socket, busy_poll_us);
+		set_busy_poll(new_wire->udp_socket.socket, busy_poll_us);
+
 		auto& new_wire_ref = new_wire.get();
 
 		new_wire_ref.CinfoReadHeader(std::move(new_wire));
@@ -84,13 +143,19 @@ private:
 
 		auto buf = header_to<mut_buf>(p->h);
 
-		tcp_socket.socket.async_receive(buf,
+		asio::async_read(tcp_socket.socket, buf,
 			[this, p = std::move(p), lifetime = std::move(lifetime)](asio::error_code ec, size_t) mutable {
 				if (ec) {
 					Close({ net_error::failed_to_read, ec });
 					return;
 				}
 
+				if (p->h.msg_type == control_msg::framing) { // asked for before the cinfo
+					compact_requested = p->h.size == static_cast<u32>(framing::compact);
+					CinfoReadHeader(std::move(lifetime));
+					return;
+				}
+
 				p->m.replace(builder_TCP(p->h))
 					.map_or_else(
 						[&](gef::unique_ref<any_msg>& m) {
@@ -106,7 +171,7 @@ private:
 
 		auto bufs = m.mut_buf_seq();
 
-		tcp_socket.socket.async_receive(bufs,
+		asio::async_read(tcp_socket.socket, bufs,
 			[this, &m, p = std::move(p), lifetime = std::move(lifetime)](asio::error_code ec, size_t) mutable {
 				if (ec) {
 					Close({ net_error::failed_to_read, ec });
@@ -123,41 +188,77 @@ private:
 					auto bufs = wire_allowed.error().reason->const_buf_seq();
 
 					// send error_packet, and self destruct this wire
-					tcp_socket.socket.async_send(bufs,
+					asio::async_write(tcp_socket.socket, bufs,
 						[this, reason = std::move(wire_allowed.error().reason), lifetime = std::move(lifetime)](asio::error_code ec, size_t)
 						{});
 				}
 			});
 	}
 
+	/// A granted compact framing is announced right before the hinfo, everything after the hinfo is compact.
 	void HinfoWrite(allowed wire_allowed, gef::unique_ref<self_t> lifetime) noexcept {
 
 		auto bufs = wire_allowed.hinfo->const_buf_seq();
 
-		tcp_socket.socket.async_send(bufs,
-			[this, wire_allowed = std::move(wire_allowed), lifetime = std::move(lifetime)](asio::error_code ec, size_t) mutable {
+		const bool compact = compact_requested && running_host->config().header_framing == framing::compact;
+
+		if (compact) {
+			framing_granted = header_server_TCP{ static_cast<u32>(framing::compact), control_msg::framing, running_host->host_id() };
+
+			bufs.insert(bufs.begin(), header_to<const_buf>(framing_granted));
+		}
+
+		asio::async_write(tcp_socket.socket, bufs,
+			[this, compact, wire_allowed = std::move(wire_allowed), lifetime = std::move(lifetime)](asio::error_code ec, size_t) mutable {
 				if (ec) {
 					Close({ net_error::failed_to_write, ec });
 					return;
 				}
 
+				ec = tcp_socket.Rehome();
+
+				if (ec) {
+					Close({ net_error::failed_to_connect, ec });
+					return;
+				}
+
+				if (compact) {
+					tcp_socket.UseFraming(framing::compact, running_host->host_id());
+					udp_socket.UseFraming(framing::compact, running_host->host_id());
+				}
+
 				m_id = wire_allowed.id;
 
 				running_host->wires.lock(
 					[&](auto& vec) {
 						vec.emplace_back(std::move(lifetime));
+
+						running_host->JoinSessions(*this);
 					});
 
 				running_host->Send(std::move(wire_allowed.cinfo), m_id);
 
 				connected = true;
 
-				tcp_socket.Start();
-				udp_socket.Start();
+				asio::post(running_host->m_context,
+					[this]() {
+						if (running_host->config().pull_events) { // from the io thread, ahead of the wire's packets
+							running_host->m_events.Push({ .kind = event_kind::connected, .from_id = m_id });
+						}
+
+						tcp_socket.Start();
+						udp_socket.Start();
+
+						running_host->KeepaliveWatch(*this);
+					});
 			});
 	}
 
 	constexpr gef::option<gef::unique_ref<any_msg>> builder_TCP(header_client_TCP const& h) noexcept {
+		if (h.msg_type < 0) {
+			return detail::build_control(h);
+		}
+
 		return running_host->builder_TCP(h);
 	}
 
@@ -166,16 +267,176 @@ private:
 	}
 
 	constexpr void NewPacketTCP(gef::unique_ref<PacketTCPclient>&& p) noexcept {
+		if (not connected) { // delivered from shared memory after the wire closed, on_close_connection may be out
+			return;
+		}
+
+		last_in_ms.store(running_host->elapsed_ms(), std::memory_order_relaxed);
+
+		if (p->h.msg_type < 0) {
+			running_host->Control(std::move(p), *this);
+			return;
+		}
+
+		if (running_host->config().pull_events) {
+			running_host->m_events.Push({ .kind = event_kind::packet_tcp, .from_id = m_id, .tcp = std::move(p) });
+			return;
+		}
+
+		if (running_host->m_handlers.is_running()) {
+			running_host->m_handlers.Post(tcp_handlers,
+				[p = std::move(p), id = m_id]() mutable {
+					running_host->new_packet_TCP(std::move(p), id);
+				});
+			return;
+		}
+
 		running_host->new_packet_TCP(std::forward<decltype(p)>(p), m_id);
 	}
 
 	constexpr bool NewPacketUDP(gef::unique_ref<PacketUDPclient>&& p) noexcept {
+		if (not connected) { // see NewPacketTCP()
+			return true;
+		}
+
+		last_in_ms.store(running_host->elapsed_ms(), std::memory_order_relaxed);
+
+		if (running_host->config().pull_events) {
+			running_host->m_events.Push({ .kind = event_kind::packet_udp, .from_id = m_id, .udp = std::move(p) });
+			return true;
+		}
+
+		if (running_host->m_handlers.is_running()) {
+			running_host->m_handlers.Post(udp_handlers,
+				[p = std::move(p), id = m_id, wire = this, serial = serial]() mutable {
+					if (not running_host->new_packet_UDP(std::move(p), id)) {
+						running_host->CloseWire(wire, serial, net_error::unknown_msg_type);
+					}
+				});
+			return true;
+		}
+
 		return running_host->new_packet_UDP(std::forward<decltype(p)>(p), m_id);
 	}
 
+	// clients send no control datagrams
+	constexpr void ControlUDP(const_buf) noexcept {}
+
+	CaptureSlot::ref capture() const noexcept {
+		return CaptureSlot::ref{ running_host->m_capture };
+	}
+
+	constexpr i16 capture_id() const noexcept {
+		return m_id;
+	}
+
+	constexpr thread_config const& threads() const noexcept {
+		return running_host->config().threads;
+	}
+
+	constexpr size_t max_message_bytes() const noexcept {
+		return running_host->config().max_message_bytes;
+	}
+
+	// congested - the send queue crossed its high-water mark, or drained back below half of it
+	constexpr void QueuePressure(const protocol proto, const bool congested) noexcept {
+		if constexpr (requires { running_host->on_send_queue_pressure(m_id, proto, congested); }) {
+			running_host->on_send_queue_pressure(m_id, proto, congested);
+		}
+	}
+
+	// A transfer's file got shorter than it was offered as, the transfer is cancelled, the wire stays up. Any thread
+	void FileShrunk(const u32 transfer) noexcept {
+		running_host->CancelFile(transfer);
+	}
+
+	// A client on this machine offered its segment. The answer is the last packet through the socket,
+	// everything after it goes through the segment
+	void ShmOffer(shm_offer const& offer) noexcept {
+		if (shm) {
+			return;
+		}
+
+		auto link = std::make_unique<ShmLink>();
+
+		shm_config const& config = running_host->config().shm;
+
+		// a remote peer can't name a segment here, the check keeps it from naming someone else's
+		const bool accepted = config.enabled && detail::is_local_peer(tcp_socket.socket)
+			&& not link->Open({ offer.name.data(), ::strnlen(offer.name.data(), offer.name.size()) }, config.full_timeout_ms);
+
+		auto answer = std::make_shared<PacketTCP>(gef::unique_ref<msg<shm_switch>>::make( shm_switch{ accepted } ));
+		answer->h.from_id = running_host->host_id();
+		answer->priority = lane::bulk; // behind everything the socket still holds
+
+		tcp_socket.Send(std::move(answer));
+
+		if (accepted) {
+			shm = std::move(link);
+
+			tcp_socket.UseShm(shm.get());
+			udp_socket.UseShm(shm.get());
+		}
+	}
+
+	// The client's last packet through the socket, its next ones are in the segment
+	void ShmSwitched() noexcept {
+		if (not shm) {
+			return;
+		}
+
+		shm->Start(threads(), running_host->config().shm.spin_us, max_message_bytes(),
+			[this](const protocol proto, const const_buf packet) {
+				if (proto == protocol::tcp) {
+					tcp_socket.DeliverShm(packet);
+				}
+				else {
+					udp_socket.DeliverShm(packet);
+				}
+			},
+			[this]() {
+				running_host->CloseWire(this, serial, net_error::unknown_msg_type);
+			});
+	}
+
+	// Back to the sockets, nothing is delivered from the segment after this
+	void StopShm() noexcept {
+		tcp_socket.UseShm(nullptr);
+		udp_socket.UseShm(nullptr);
+
+		if (shm) {
+			shm->Stop();
+		}
+	}
+
+	// on_close_connection, once the handlers of the packets already read ran, on both protocols' strands.
+	// The strands outlive the wire, `err` doesn't outlive Close()
+	void NotifyCloseAfterHandlers(error_info const& err) noexcept {
+		bool report = false;
+		std::error_code ec;
+
+		err.ec.inspect(
+			[&](std::error_code const& e) {
+				report = e != asio::error::eof;
+				ec = e;
+			});
+
+		running_host->m_handlers.Post(tcp_handlers,
+			[id = m_id, udp = udp_handlers, what = err.what, report, ec]() {
+				running_host->m_handlers.Post(udp,
+					[id, what, report, ec]() mutable {
+						const error_info copy{ what, ec };
+
+						running_host->on_close_connection(id, report ? gef::option<error_info const&>{ copy } : gef::nullopt);
+					});
+			});
+	}
+
 	void Close(error_info const& err) noexcept {
 
 		if (tcp_socket.socket.is_open()) {
+			StopShm(); // the reader's posts to the io thread are queued ahead of the reap
+
 			tcp_socket.socket.shutdown(tcp::socket::shutdown_both);
 			tcp_socket.socket.close();
 
@@ -183,6 +444,31 @@ private:
 
 			connected = false;
 
+			running_host->wires.shared_lock(
+				[&](auto&) {
+					if (session_slot != SessionTable<self_t>::no_slot) {
+						running_host->m_sessions.Clear(session_slot, SessionTable<self_t>::open);
+					}
+				});
+
+			if (mesh_registered) {
+				running_host->MeshLeave(*this);
+			}
+
+			running_host->WireFilesClosed(m_id);
+
+			running_host->ReapDeadWires();
+
+			if (running_host->config().pull_events) {
+				running_host->m_events.Push(detail::close_event<Event>(m_id, err));
+				return;
+			}
+
+			if (running_host->m_handlers.is_running()) {
+				NotifyCloseAfterHandlers(err);
+				return;
+			}
+
 			running_host->on_close_connection(
 				m_id,
 				err.ec.and_then<error_info const&>( // ?? fails to deduce `U` (option<U>)
@@ -199,11 +485,21 @@ public:
 	constexpr i16 id() const noexcept {
 		return m_id;
 	}
+
+	constexpr size_t queued_bytes(const protocol proto) const noexcept {
+		return proto == protocol::tcp
+			? tcp_socket.queue().bytes()
+			: udp_socket.queue().bytes();
+	}
 };
 
 template <class Hoster>
 Hoster* Wire<Hoster>::running_host;
 
+/// With `accept_config::threads` > 0, a connection's handshake runs on an accept thread, and so do the Hoster's
+/// callbacks it makes: builder_TCP for the cinfo, new_client, and on_error / on_close_connection for a handshake
+/// that failed. They run concurrently with the io thread's callbacks and, with more than one accept thread,
+/// with each other, the Hoster synchronizes what they share.
 template <class Hoster>
 class Host {
 public:
@@ -214,14 +510,33 @@ public:
 	using PacketTCPclient = packet_tcp<header_client_TCP>;
 	using PacketUDPclient = packet_udp<header_client_UDP>;
 
+	using Event = net_event<PacketTCPclient, PacketUDPclient>;
+
 	using WIRE = Wire<Hoster>;
 
-	Host(const u16 port, const i16 host_id, Hoster* derived_from) noexcept :
-		m_acceptor(m_context, tcp::endpoint(tcp::v4(), port)),
+	Host(const u16 port, const i16 host_id, Hoster* derived_from, host_config const& config = {}) noexcept :
+		m_port(port),
+		m_local_tcp_handlers(m_handlers.MakeStrand()),
+		m_local_udp_handlers(m_handlers.MakeStrand()),
+		m_relay_timer(m_context),
+		m_ticks(*this, m_context),
+		m_keepalive_wheel(config.keepalive.resolution_ms),
+		m_keepalive_timer(m_context),
+		m_config(config),
 		m_host_id(host_id),
 		running(false)
 	{
 		WIRE::running_host = derived_from;
+
+		const size_t workers = config.fanout.workers != 0
+			? config.fanout.workers
+			: std::thread::hardware_concurrency() / 2;
+
+		if (workers >= 2) {
+			for (size_t i = 0; i < workers; i++) {
+				m_shards.push_back(std::make_unique<fanout_shard>());
+			}
+		}
 	}
 
 	~Host() noexcept {
@@ -231,15 +546,88 @@ public:
 private:
 
 	friend WIRE;
+	friend TickScheduler<Host>;
 
 	asio::io_context m_context;
-	tcp::acceptor m_acceptor;
 	std::thread m_self_thread;
 
+	u16 m_port;
+
+	asio::io_context m_accept_context; // used when `accept_config::threads` > 0
+	std::vector<std::shared_ptr<tcp::acceptor>> m_acceptors; // shared with their pending accepts, which can outlive Stop()
+	std::vector<std::thread> m_accept_threads;
+
 	moodycamel::BlockingConcurrentQueue<gef::unique_ref<PacketTCP>> out_queue_tcp;
 	moodycamel::BlockingConcurrentQueue<gef::unique_ref<PacketUDP>> out_queue_udp;
 
+	CaptureSlot m_capture; // the running capture, see StartCapture()
+
+	HandlerPool m_handlers; // before the wires, their strands are on its context
+
+	// see SendLocal(), keep the host player's handlers in order as a wire's
+	HandlerPool::strand m_local_tcp_handlers;
+	HandlerPool::strand m_local_udp_handlers;
+
+	EventQueue<Event> m_events; // see `host_config::pull_events`
+
 	gef::mutex<std::vector<gef::unique_ref<WIRE>>> wires;
+	std::atomic<u64> m_wire_serial{ 0 }; // see `Wire::serial`
+
+	using session_table = SessionTable<WIRE>;
+
+	// the wires' hot state for the fan-out, changed under the wires' exclusive lock, read under their shared one
+	session_table m_sessions;
+
+	// see `fanout_config`, a null job stops the worker
+	struct fanout_job {
+		std::shared_ptr<PacketTCP> tcp;
+		std::shared_ptr<PacketUDP> udp;
+	};
+
+	struct fanout_shard {
+		moodycamel::BlockingConcurrentQueue<fanout_job> jobs;
+	};
+
+	inline static constexpr u8 every_shard = std::numeric_limits<u8>::max();
+
+	std::vector<std::unique_ptr<fanout_shard>> m_shards; // empty when fan-out isn't sharded
+	std::vector<std::thread> m_fanout_threads;
+	std::atomic<bool> m_sharded{ false };
+
+	// The tree of the host's own UDP broadcasts (see `mesh_config::relay_fanout`),
+	// `roots` get the broadcasts from the host, the rest of `covered` from a relay
+	struct relay_plan {
+		u16 version = 0;
+		std::vector<i16> roots;
+		std::vector<i16> covered;
+	};
+
+	gef::mutex<relay_plan> m_relay;
+	asio::steady_timer m_relay_timer;
+	bool relay_rebuild_pending = false; // io thread only
+
+	TickScheduler<Host> m_ticks;
+
+	// Send()s waiting for the end of the tick, see `tick_config::coalesce`
+	struct held_output {
+		std::vector<gef::unique_ref<PacketTCP>> tcp;
+		std::vector<gef::unique_ref<PacketUDP>> udp;
+	};
+
+	gef::mutex<held_output> m_held;
+
+	// see SendFile(), io thread only
+	std::vector<file_transfer> m_transfers;
+	std::atomic<u32> m_next_transfer{ 1 };
+
+	// see `keepalive_config`, io thread only
+	TimerWheel<i16> m_keepalive_wheel;
+	asio::steady_timer m_keepalive_timer;
+	const std::chrono::steady_clock::time_point m_epoch = std::chrono::steady_clock::now();
+
+	BusyPoller m_poller;
+
+	host_config m_config;
 
 	i16 m_host_id;
 
@@ -248,18 +636,71 @@ private:
 public:
 	/// Starts / Restarts the host.
 	void Start() noexcept {
-		AcceptConnections();
+		if (asio::error_code ec = OpenAcceptors()) {
+			access_hoster().on_error({ net_error::failed_to_listen, ec });
+			return;
+		}
+
+		for (auto const& acceptor : m_acceptors) {
+			for (u8 i = 0; i < std::max<u8>(m_config.accept.outstanding_accepts, 1); i++) {
+				AcceptConnections(acceptor);
+			}
+		}
+
+		if (m_config.accept.threads > 0) {
+			m_accept_context.restart();
+
+			for (u8 i = 0; i < m_config.accept.threads; i++) {
+				m_accept_threads.push_back(spawn_thread(m_config.threads, thread_role::accept, "hcnet-accept",
+					[this]() {
+						asio::error_code ec;
+						m_accept_context.run(ec);
+
+						if (ec) {
+							access_hoster().on_error({ net_error::failed_to_run_io_context, ec });
+						}
+					}));
+			}
+		}
+
+		if (m_config.tick.rate_hz != 0) {
+			m_ticks.Start(m_config.tick.rate_hz);
+		}
+
+		if (keepalive_enabled()) {
+			KeepaliveTimer();
+		}
+
+		m_sharded = false;
+
+		for (size_t i = 0; i < m_shards.size(); i++) {
+			fanout_job stale;
+			while (m_shards[i]->jobs.try_dequeue(stale)) {}
 
-		m_self_thread = std::thread(
+			m_fanout_threads.push_back(spawn_thread(m_config.threads, thread_role::fanout, "hcnet-fanout",
+				[this, shard = static_cast<u8>(i)]() {
+					FanOutWorker(shard);
+				}));
+		}
+
+		m_handlers.Start(m_config.handlers.workers, m_config.threads);
+
+		m_self_thread = spawn_thread(m_config.threads, thread_role::io, "hcnet-io",
 			[this]() {
 
 				running = true;
 
-				std::thread{ &Host::DequeueTCP, this }.detach();
-				std::thread{ &Host::DequeueUDP, this }.detach();
+				spawn_thread(m_config.threads, thread_role::dequeue, "hcnet-deq-tcp", [this]() { DequeueTCP(); }).detach();
+				spawn_thread(m_config.threads, thread_role::dequeue, "hcnet-deq-udp", [this]() { DequeueUDP(); }).detach();
 
 				asio::error_code ec;
-				m_context.run(ec);
+
+				if (m_config.busy_poll.enabled) {
+					m_poller.Run(m_context, m_config.busy_poll, ec);
+				}
+				else {
+					m_context.run(ec);
+				}
 
 				if (ec) {
 					access_hoster().on_error({ net_error::failed_to_run_io_context, ec });
@@ -270,15 +711,43 @@ public:
 				// 'Wake up' the wait_dequeue()'s
 				out_queue_tcp.enqueue(gef::unique_ref<PacketTCP>{ nullptr });
 				out_queue_udp.enqueue(gef::unique_ref<PacketUDP>{ nullptr });
+
+				for (auto& shard : m_shards) {
+					shard->jobs.enqueue(fanout_job{});
+				}
 			});
 	}
 
 	/// Stops host.
 	/// Call Start() when you wish to restart the host.
 	void Stop() noexcept {
+		if (not m_accept_context.stopped()) { m_accept_context.stop(); }
+
+		for (std::thread& t : m_accept_threads) {
+			if (t.joinable()) { t.join(); }
+		}
+
+		m_accept_threads.clear();
+
 		if (not m_context.stopped()) { m_context.stop(); }
 
 		if (m_self_thread.joinable()) { m_self_thread.join(); }
+
+		for (std::thread& t : m_fanout_threads) {
+			if (t.joinable()) { t.join(); }
+		}
+
+		m_fanout_threads.clear();
+
+		m_handlers.Stop();
+
+		m_ticks.Stop();
+		m_keepalive_timer.cancel();
+
+		// held for a tick that won't come, a later Start() may have other clients behind the same ids
+		m_held.lock([](held_output& held) { held = {}; });
+
+		CloseAcceptors();
 	}
 
 	constexpr i16 host_id() const noexcept {
@@ -289,125 +758,1129 @@ public:
 		return running;
 	}
 
-	void Send(gef::unique_ref<PacketTCP> p, const i16 skip_client) noexcept {
-
-		p->h.from_id = skip_client;
-
-		out_queue_tcp.enqueue(std::move(p));
+	constexpr host_config const& config() const noexcept {
+		return m_config;
 	}
 
-	void Send(gef::unique_ref<PacketUDP> p, const i16 skip_client) noexcept {
+	/// Where the io thread's time went while busy polling (see `busy_poll_config`), zeros otherwise
+	busy_poll_stats poll_stats() const noexcept {
+		return m_poller.stats();
+	}
 
-		p->h.from_id = skip_client;
+	/// How long the packets waited for a handler worker (see `handler_config`), zeros otherwise
+	handler_stats handler_queue_stats() const noexcept {
+		return m_handlers.stats();
+	}
 
-		out_queue_udp.enqueue(std::move(p));
+	/// Pull mode (see `host_config::pull_events`), moves up to `out.size()` queued events into `out`, returns how many.
+	/// A wire's events come in the order they happened. Call from one thread, e.g. once per frame of the game loop
+	size_t PollEvents(std::span<Event> out) noexcept {
+		return m_events.Poll(out);
 	}
 
-private:
+	/// Pull mode, `f(Event&)` for up to `max` queued events, returns how many. Same thread as PollEvents()
+	template <typename F>
+	size_t ForEachEvent(F&& f, const size_t max = std::numeric_limits<size_t>::max()) noexcept {
+		return m_events.ForEach(std::forward<F>(f), max);
+	}
 
-	void DequeueTCP() noexcept {
+	/// Records every packet of every wire, in and out, into a trace at `path` (see `CaptureFile`) until StopCapture().
+	/// Replaces a running capture, call from one thread.
+	std::error_code StartCapture(std::string const& path, const size_t capacity = 256 * 1024 * 1024) noexcept {
+		auto file = std::make_unique<CaptureFile>();
 
-		gef::unique_ref<PacketTCP> p{ nullptr };
+		if (std::error_code ec = file->Open(path, capacity)) {
+			return ec;
+		}
 
-		out_queue_tcp.wait_dequeue(p);
+		m_capture.Replace(std::move(file));
 
-		if (not running) {
-			return;
-		}
+		return {};
+	}
 
-		std::shared_ptr shared_packet{ std::move(p._Ptr) };
+	/// Waits for the packets being recorded, then truncates the trace to what was recorded, unmaps and frees it.
+	void StopCapture() noexcept {
+		m_capture.Replace(nullptr);
+	}
 
-		bool clear_dead_wires = false;
+	// the wires a UDP broadcast of the host is sent to, fewer than all of them while a relay tree is up
+	size_t broadcast_fanout() noexcept {
+		size_t fanout = 0;
 
 		wires.shared_lock(
 			[&](auto& vec) {
+				m_relay.shared_lock(
+					[&](relay_plan const& plan) {
+						fanout = vec.size() - plan.covered.size() + plan.roots.size();
+					});
+			});
 
-				if (shared_packet->h.from_id == m_host_id) { // host isn't a wire, no need to check id
-					for (gef::unique_ref<WIRE> const& wire : vec) {
-
-						if (wire->tcp_socket.socket.is_open()) {
-							wire->tcp_socket.Send(shared_packet);
-						}
-						else {
-							clear_dead_wires = true;
-						}
-					}
-				}
-				else {
-					for (gef::unique_ref<WIRE> const& wire : vec) {
+		return fanout;
+	}
 
-						if (wire->id() == shared_packet->h.from_id) { // don't send back to the sender
-							continue;
-						}
+	void Send(gef::unique_ref<PacketTCP> p, const i16 skip_client, const lane priority = lane::normal) noexcept {
 
-						if (wire->tcp_socket.socket.is_open()) {
-							wire->tcp_socket.Send(shared_packet);
-						}
-						else {
-							clear_dead_wires = true;
-						}
-					}
-				}
-			});
+		p->h.from_id = skip_client;
+		p->priority = priority;
 
-		if (clear_dead_wires) {
-			std::thread(
-				[&]() {
-					wires.lock(
-						[](auto& vec) {
-							std::erase_if(vec,
-								[](gef::unique_ref<WIRE> const& w) {
-									return w->tcp_socket.socket.is_open();
-								});
-						});
-				}).detach();
+		if (holds_output()) {
+			m_held.lock([&](held_output& held) { held.tcp.push_back(std::move(p)); });
+			return;
 		}
 
-		DequeueTCP();
+		out_queue_tcp.enqueue(std::move(p));
 	}
 
-	void DequeueUDP() noexcept {
-	
-		gef::unique_ref<PacketUDP> p{ nullptr };
+	void Send(gef::unique_ref<PacketUDP> p, const i16 skip_client, const lane priority = lane::normal) noexcept {
 
-		out_queue_udp.wait_dequeue(p);
+		p->h.from_id = skip_client;
+		p->priority = priority;
 
-		if (not running) {
+		if (holds_output()) {
+			m_held.lock([&](held_output& held) { held.udp.push_back(std::move(p)); });
 			return;
 		}
 
-		std::shared_ptr shared_packet{ std::move(p._Ptr) };
+		out_queue_udp.enqueue(std::move(p));
+	}
 
-		bool clear_dead_wires = false;
+	/// The host's own player sends `p` to the host, as a remote player's client would: it's handed to
+	/// new_packet_TCP(p, host_id()) the way a wire's packets are (on the io thread, a handler worker or the event queue),
+	/// as the message object it was built with, nothing is serialized. Broadcasting it from there,
+	/// Send(p, host_id()) reaches every wire.
+	/// Never held for the tick, in order with the player's other SendLocal()s
+	void SendLocal(gef::unique_ref<PacketTCPclient> p) noexcept {
+		p->fill_header();
 
-		wires.shared_lock(
-			[&](auto& vec) {
+		if (m_config.pull_events) {
+			m_events.Push({ .kind = event_kind::packet_tcp, .from_id = m_host_id, .tcp = std::move(p) });
+			return;
+		}
 
-				if (shared_packet->h.from_id == m_host_id) { // host isn't a wire, no need to check id
-					for (gef::unique_ref<WIRE> const& wire : vec) {
-						wire->udp_socket.Send(shared_packet);
-					}
-				}
-				else {
-					for (gef::unique_ref<WIRE> const& wire : vec) {
+		auto handle = [this, p = std::move(p)]() mutable {
+			access_hoster().new_packet_TCP(std::move(p), m_host_id);
+		};
 
-						if (wire->id() == shared_packet->h.from_id) { // don't send back to the sender
-							continue;
-						}
+		if (m_handlers.is_running()) {
+			m_handlers.Post(m_local_tcp_handlers, std::move(handle));
+			return;
+		}
 
-						wire->udp_socket.Send(shared_packet);
-					}
-				}
-			});
+		asio::post(m_context, std::move(handle));
+	}
 
-		DequeueUDP();
+	/// See the TCP one, a `false` from new_packet_UDP is reported to on_error(), there's no wire to close
+	void SendLocal(gef::unique_ref<PacketUDPclient> p) noexcept {
+		p->fill_header();
+
+		if (m_config.pull_events) {
+			m_events.Push({ .kind = event_kind::packet_udp, .from_id = m_host_id, .udp = std::move(p) });
+			return;
+		}
+
+		auto handle = [this, p = std::move(p)]() mutable {
+			if (not access_hoster().new_packet_UDP(std::move(p), m_host_id)) {
+				access_hoster().on_error({ net_error::unknown_msg_type, gef::nullopt });
+			}
+		};
+
+		if (m_handlers.is_running()) {
+			m_handlers.Post(m_local_udp_handlers, std::move(handle));
+			return;
+		}
+
+		asio::post(m_context, std::move(handle));
+	}
+
+	/// Streams the file at `path` to the wire `to`, offered as `name` (see `file_stream_config`).
+	/// The client's on_file_offer() decides where the file goes. The transfer resumes after what's already there
+	/// if a previous transfer of this file left it, same size and last write time, it starts over otherwise.
+	/// `on_file_progress(to, transfer, acked, size)` follows it up to `acked == size`, `on_file_cancel(to, transfer)`
+	/// ends it otherwise: declined, cancelled by either side, the file got shorter, or the wire closed.
+	/// Returns the transfer's id, or why the file couldn't be opened. Any thread
+	std::expected<u32, std::error_code> SendFile(const i16 to, std::string const& path, std::string_view name) noexcept {
+		auto file = std::make_shared<detail::stream_file>();
+
+		if (std::error_code ec = file->Open(path, false)) {
+			return std::unexpected(ec);
+		}
+
+		const u32 id = m_next_transfer.fetch_add(1, std::memory_order_relaxed);
+
+		file_offer offer{ id, file->size(), file->modified(), {} };
+		std::ranges::copy(name.substr(0, file_name_max - 1), offer.name.begin());
+
+		asio::post(m_context,
+			[this, offer, file = std::move(file), to]() mutable {
+				OfferFile(file_transfer{ offer.transfer, to, std::move(file), offer.size }, offer);
+			});
+
+		return id;
+	}
+
+	/// Ends a transfer of SendFile(), the chunks already queued still go out. Any thread
+	void CancelFile(const u32 transfer) noexcept {
+		asio::post(m_context,
+			[this, transfer]() {
+				auto it = std::ranges::find(m_transfers, transfer, &file_transfer::id);
+
+				if (it == m_transfers.end()) {
+					return;
+				}
+
+				WithWire(it->to,
+					[&](WIRE& wire) {
+						auto cancel = std::make_shared<PacketTCP>(gef::unique_ref<msg<file_cancel>>::make( file_cancel{ transfer } ));
+						cancel->h.from_id = m_host_id;
+						cancel->priority = lane::critical;
+
+						wire.tcp_socket.Send(std::move(cancel));
+					});
+
+				EndFile(it, false);
+			});
+	}
+
+	/// Queues the Send()s held for the end of the tick right away, in the order they were sent.
+	/// Runs after every `on_tick`
+	void Flush() noexcept {
+		held_output out;
+
+		m_held.lock([&](held_output& held) { std::swap(out, held); });
+
+		if (not out.tcp.empty()) {
+			out_queue_tcp.enqueue_bulk(std::make_move_iterator(out.tcp.begin()), out.tcp.size());
+		}
+
+		if (not out.udp.empty()) {
+			out_queue_udp.enqueue_bulk(std::make_move_iterator(out.udp.begin()), out.udp.size());
+		}
+	}
+
+	constexpr bool holds_output() const noexcept {
+		return m_config.tick.rate_hz != 0 && m_config.tick.coalesce;
+	}
+
+private:
+
+	// TickScheduler, on the io thread
+	void Tick(const u64 tick_no, const double dt) noexcept {
+		if constexpr (requires { access_hoster().on_tick(tick_no, dt); }) {
+			access_hoster().on_tick(tick_no, dt);
+		}
+
+		Flush();
+	}
+
+	void TickOverrun(const u64 tick_no, const u64 skipped) noexcept {
+		if constexpr (requires { access_hoster().on_tick_overrun(tick_no, skipped); }) {
+			access_hoster().on_tick_overrun(tick_no, skipped);
+		}
+	}
+
+	i64 elapsed_ms() const noexcept {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+	}
+
+	constexpr bool keepalive_enabled() const noexcept {
+		return m_config.keepalive.interval_ms != 0 || m_config.keepalive.timeout_ms != 0;
+	}
+
+	// One timer for every wire, it advances the wheel
+	void KeepaliveTimer() noexcept {
+		m_keepalive_timer.expires_after(std::chrono::milliseconds(std::max<u32>(m_config.keepalive.resolution_ms, 1)));
+
+		m_keepalive_timer.async_wait(
+			[this](asio::error_code ec) {
+				if (ec) {
+					return;
+				}
+
+				CheckKeepalive();
+				KeepaliveTimer();
+			});
+	}
+
+	// A wire that just connected, io thread
+	void KeepaliveWatch(WIRE& wire) noexcept {
+		if (not keepalive_enabled()) {
+			return;
+		}
+
+		const i64 now_ms = elapsed_ms();
+
+		wire.last_in_ms = now_ms;
+		wire.last_out_ms = now_ms;
+
+		ScheduleKeepalive(wire);
+	}
+
+	void ScheduleKeepalive(WIRE& wire) noexcept {
+		keepalive_config const& keepalive = m_config.keepalive;
+
+		i64 due_ms = std::numeric_limits<i64>::max();
+
+		if (keepalive.interval_ms != 0) {
+			due_ms = std::min<i64>(due_ms, wire.last_out_ms + keepalive.interval_ms);
+		}
+
+		if (keepalive.timeout_ms != 0) {
+			due_ms = std::min<i64>(due_ms, wire.last_in_ms + keepalive.timeout_ms);
+		}
+
+		wire.keepalive_due_ms = due_ms;
+
+		m_keepalive_wheel.Schedule(wire.id(), due_ms);
+	}
+
+	/// Closes the wires that received nothing for `timeout_ms` with `net_error::timed_out`,
+	/// sends a heartbeat to the ones that were sent nothing for `interval_ms`.
+	/// Only the wires the wheel expired are looked at, each one's next check is rescheduled from its last activity
+	void CheckKeepalive() noexcept {
+		const i64 now_ms = elapsed_ms();
+
+		std::vector<std::pair<i16, i64>> expired;
+
+		m_keepalive_wheel.Advance(now_ms,
+			[&](const i16 id, const i64 due_ms) {
+				expired.emplace_back(id, due_ms);
+			});
+
+		if (expired.empty()) {
+			return;
+		}
+
+		std::ranges::sort(expired);
+
+		std::vector<WIRE*> timed_out;
+
+		wires.shared_lock(
+			[&](auto& vec) {
+				for (gef::unique_ref<WIRE> const& wire : vec) {
+
+					// a wire's entries for deadlines it moved past are stale, so is the entry of a closed wire that had its id
+					if (not wire->connected || not std::ranges::binary_search(expired, std::pair{ wire->id(), wire->keepalive_due_ms })) {
+						continue;
+					}
+
+					if (m_config.keepalive.timeout_ms != 0 && now_ms - wire->last_in_ms >= m_config.keepalive.timeout_ms) {
+						timed_out.push_back(&wire.get());
+						continue;
+					}
+
+					if (m_config.keepalive.interval_ms != 0 && now_ms - wire->last_out_ms >= m_config.keepalive.interval_ms) {
+						auto heartbeat = std::make_shared<PacketTCP>(control_msg::heartbeat);
+						heartbeat->h.from_id = m_host_id;
+						heartbeat->priority = lane::critical;
+
+						wire->tcp_socket.Send(std::move(heartbeat));
+						wire->last_out_ms = now_ms;
+					}
+
+					ScheduleKeepalive(*wire);
+				}
+			});
+
+		// wires are reaped on the io thread, after the lock they're still there
+		for (WIRE* wire : timed_out) {
+			asio::error_code ec = asio::error::timed_out;
+			wire->Close({ net_error::timed_out, ec });
+		}
+	}
+
+	// Closes `wire` on the io thread, if it's still there. From any thread, the wire may be gone by then:
+	// it's looked up by address and `serial` under the wires' lock, never dereferenced before,
+	// so neither a reused id nor a new wire at the same address is closed instead
+	void CloseWire(WIRE* wire, const u64 serial, const net_error what) noexcept {
+		asio::post(m_context,
+			[this, wire, serial, what]() {
+				bool found = false;
+
+				wires.shared_lock(
+					[&](auto& vec) {
+						found = std::ranges::any_of(vec, [&](gef::unique_ref<WIRE> const& w) { return &w.get() == wire && w->serial == serial; });
+					});
+
+				// wires are reaped on the io thread, after the lock it's still there
+				if (found) {
+					wire->Close({ what, gef::nullopt });
+				}
+			});
+	}
+
+	// `f(WIRE&)` under the wires' lock, if `id` is connected
+	template <typename F>
+	void WithWire(const i16 id, F&& f) noexcept {
+		wires.shared_lock(
+			[&](auto& vec) {
+				auto it = std::ranges::find_if(vec, [&](gef::unique_ref<WIRE> const& w) { return w->id() == id && w->connected; });
+
+				if (it != vec.end()) {
+					f(it->get());
+				}
+			});
+	}
+
+	// Removes the wires whose connection closed. Posted to the io thread after the close,
+	// so the handlers their sockets' aborted operations queued run before the wire is gone
+	void ReapDeadWires() noexcept {
+		asio::post(m_context,
+			[this]() {
+				wires.lock(
+					[this](auto& vec) {
+						auto dead = std::stable_partition(vec.begin(), vec.end(),
+							[](gef::unique_ref<WIRE> const& w) {
+								return w->tcp_socket.socket.is_open();
+							});
+
+						for (auto it = dead; it != vec.end(); ++it) {
+							if ((*it)->session_slot != session_table::no_slot) {
+								m_sessions.Erase((*it)->session_slot);
+							}
+						}
+
+						vec.erase(dead, vec.end());
+					});
+			});
+	}
+
+	void DequeueTCP() noexcept {
+
+		gef::unique_ref<PacketTCP> p{ nullptr };
+
+		out_queue_tcp.wait_dequeue(p);
+
+		if (not running) {
+			return;
+		}
+
+		std::shared_ptr shared_packet{ std::move(p._Ptr) };
+
+		if (Sharded()) {
+			for (auto& shard : m_shards) {
+				shard->jobs.enqueue({ shared_packet, nullptr });
+			}
+		}
+		else {
+			bool clear_dead_wires = false;
+
+			const i64 now_ms = elapsed_ms();
+
+			wires.shared_lock(
+				[&](auto&) {
+					clear_dead_wires = FanOutTCP(every_shard, shared_packet, now_ms);
+				});
+
+			if (clear_dead_wires) {
+				ReapDeadWires();
+			}
+		}
+
+		DequeueTCP();
+	}
+
+	void DequeueUDP() noexcept {
+	
+		gef::unique_ref<PacketUDP> p{ nullptr };
+
+		out_queue_udp.wait_dequeue(p);
+
+		if (not running) {
+			return;
+		}
+
+		std::shared_ptr shared_packet{ std::move(p._Ptr) };
+
+		if (Sharded()) {
+			for (auto& shard : m_shards) {
+				shard->jobs.enqueue({ nullptr, shared_packet });
+			}
+		}
+		else {
+			const i64 now_ms = elapsed_ms();
+
+			wires.shared_lock(
+				[&](auto& vec) {
+					FanOutUDP(vec, every_shard, shared_packet, now_ms);
+				});
+		}
+
+		DequeueUDP();
+	}
+
+	// Sends a TCP packet to the wires of `shard` (`every_shard` unsharded), under the wires' lock.
+	// The wires it skips are told apart on the session table alone. Returns whether one of them is closed
+	bool FanOutTCP(const u8 shard, std::shared_ptr<PacketTCP> const& shared_packet, const i64 now_ms) noexcept {
+		bool dead = false;
+
+		const bool from_host = shared_packet->h.from_id == m_host_id; // host isn't a wire, every wire gets it
+
+		for (u32 slot = 0; slot < m_sessions.slot_count(); slot++) {
+			const u8 flags = m_sessions.flags(slot);
+
+			if (not (flags & session_table::live) || (shard != every_shard && m_sessions.shard(slot) != shard)) {
+				continue;
+			}
+
+			if (not from_host && m_sessions.id(slot) == shared_packet->h.from_id) { // don't send back to the sender
+				continue;
+			}
+
+			if (not (flags & session_table::open)) {
+				dead = true;
+				continue;
+			}
+
+			WIRE* wire = m_sessions.wire(slot);
+
+			wire->tcp_socket.Send(shared_packet);
+			wire->last_out_ms.store(now_ms, std::memory_order_relaxed);
+		}
+
+		return dead;
+	}
+
+	// Sends a UDP packet to the wires of `shard` (`every_shard` unsharded), under the wires' lock
+	void FanOutUDP(std::vector<gef::unique_ref<WIRE>> const& vec, const u8 shard, std::shared_ptr<PacketUDP> const& shared_packet, const i64 now_ms) noexcept {
+
+		const auto in_shard = [&](const u32 slot, const u8 flags) {
+			return (flags & session_table::live) && (shard == every_shard || m_sessions.shard(slot) == shard);
+		};
+
+		if (shared_packet->h.from_id == m_host_id) { // host isn't a wire, no need to check id
+			m_relay.shared_lock(
+				[&](relay_plan const& plan) {
+					std::shared_ptr<PacketUDP> envelope{ nullptr };
+
+					if (not plan.roots.empty()) {
+						envelope = std::make_shared<PacketUDP>(
+							gef::unique_ref<detail::relay_envelope<PacketUDP>>::make( shared_packet, plan.version ));
+						envelope->h.from_id = m_host_id;
+						envelope->priority = shared_packet->priority;
+					}
+
+					for (u32 slot = 0; slot < m_sessions.slot_count(); slot++) {
+						const u8 flags = m_sessions.flags(slot);
+
+						if (not in_shard(slot, flags)) {
+							continue;
+						}
+
+						if (not (flags & session_table::relay_covered)) {
+							m_sessions.wire(slot)->udp_socket.Send(shared_packet);
+							m_sessions.wire(slot)->last_out_ms.store(now_ms, std::memory_order_relaxed);
+						}
+						else if (flags & session_table::relay_root) {
+							m_sessions.wire(slot)->udp_socket.Send(envelope);
+							m_sessions.wire(slot)->last_out_ms.store(now_ms, std::memory_order_relaxed);
+						}
+					}
+				});
+		}
+		else {
+			const std::vector<mesh_path> direct = MeshDirect(vec, shared_packet->h.from_id);
+
+			for (u32 slot = 0; slot < m_sessions.slot_count(); slot++) {
+				const u8 flags = m_sessions.flags(slot);
+
+				if (not in_shard(slot, flags)) {
+					continue;
+				}
+
+				const i16 id = m_sessions.id(slot);
+
+				if (id == shared_packet->h.from_id) { // don't send back to the sender
+					continue;
+				}
+
+				if (std::ranges::find(direct, id, &mesh_path::peer) != direct.end()) { // the sender already reached it
+					continue;
+				}
+
+				m_sessions.wire(slot)->udp_socket.Send(shared_packet);
+				m_sessions.wire(slot)->last_out_ms.store(now_ms, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Mirrors `plan` in the session table's relay bits, under the wires' lock and the plan's exclusive one
+	void MarkRelay(relay_plan const& plan) noexcept {
+		for (u32 slot = 0; slot < m_sessions.slot_count(); slot++) {
+			if (not (m_sessions.flags(slot) & session_table::live)) {
+				continue;
+			}
+
+			const i16 id = m_sessions.id(slot);
+
+			m_sessions.Clear(slot, session_table::relay_covered | session_table::relay_root);
+
+			if (std::ranges::find(plan.covered, id) != plan.covered.end()) {
+				m_sessions.Set(slot, session_table::relay_covered);
+			}
+
+			if (std::ranges::find(plan.roots, id) != plan.roots.end()) {
+				m_sessions.Set(slot, session_table::relay_root);
+			}
+		}
+	}
+
+	// Fan-out moves to the shards for good once there are `fanout_config::shard_above_wires` wires,
+	// going back could send a wire's packet before the ones still queued on its shard
+	bool Sharded() noexcept {
+		if (m_sharded.load(std::memory_order_acquire)) {
+			return true;
+		}
+
+		if (m_shards.empty()) {
+			return false;
+		}
+
+		size_t wire_count = 0;
+
+		wires.shared_lock([&](auto&) { wire_count = m_sessions.size(); });
+
+		if (wire_count < m_config.fanout.shard_above_wires) {
+			return false;
+		}
+
+		m_sharded.store(true, std::memory_order_release);
+
+		return true;
+	}
+
+	// Gives a new wire its slot in the session table, in the shard with the fewest wires, under the wires' exclusive lock
+	void JoinSessions(WIRE& wire) noexcept {
+		wire.session_slot = m_sessions.Insert(&wire, wire.id(), m_sessions.LightestShard(m_shards.size()));
+	}
+
+	// A fan-out worker, sends its shard's share of every broadcast until the io thread stops
+	void FanOutWorker(const u8 shard) noexcept {
+		std::array<fanout_job, 64> batch;
+
+		while (true) {
+			const size_t count = m_shards[shard]->jobs.wait_dequeue_bulk(batch.begin(), batch.size());
+
+			bool stop = false;
+			bool clear_dead_wires = false;
+
+			const i64 now_ms = elapsed_ms();
+
+			wires.shared_lock(
+				[&](auto& vec) {
+					for (size_t i = 0; i < count && not stop; i++) {
+						if (batch[i].tcp) {
+							clear_dead_wires |= FanOutTCP(shard, batch[i].tcp, now_ms);
+						}
+						else if (batch[i].udp) {
+							FanOutUDP(vec, shard, batch[i].udp, now_ms);
+						}
+						else {
+							stop = true;
+						}
+					}
+				});
+
+			std::ranges::fill(batch, fanout_job{});
+
+			if (clear_dead_wires) {
+				ReapDeadWires();
+			}
+
+			if (stop) {
+				return;
+			}
+		}
+	}
+
+	// the peers `id` reaches directly, empty when the mesh is disabled
+	std::vector<mesh_path> MeshDirect(std::vector<gef::unique_ref<WIRE>> const& vec, const i16 id) noexcept {
+		std::vector<mesh_path> direct;
+
+		if (not m_config.mesh.enabled) {
+			return direct;
+		}
+
+		auto it = std::ranges::find_if(vec, [&](gef::unique_ref<WIRE> const& w) { return w->id() == id; });
+
+		if (it != vec.end()) {
+			(*it)->mesh_direct.shared_lock(
+				[&](std::vector<mesh_path> const& paths) {
+					direct = paths;
+				});
+		}
+
+		return direct;
+	}
+
+	// Handles the library's control messages, runs on the io thread
+	void Control(gef::unique_ref<PacketTCPclient> p, WIRE& from) noexcept {
+		if (FileControl(*p, from)) {
+			return;
+		}
+
+		if (p->h.msg_type == control_msg::shm_switch) {
+			from.ShmSwitched();
+			return;
+		}
+
+		if (p->h.msg_type == control_msg::shm_offer && not p->is_header_only()) {
+			from.ShmOffer(p->m.value_unchecked()->as<shm_offer>().inner);
+			return;
+		}
+
+		if (not m_config.mesh.enabled || p->is_header_only()) {
+			return;
+		}
+
+		any_msg& m = p->m.value_unchecked().get();
+
+		switch (p->h.msg_type) {
+		case control_msg::mesh_register:
+			MeshRegister(from, m.as<mesh_register>().inner);
+			break;
+		case control_msg::mesh_path:
+			MeshPath(from, m.as<mesh_path>().inner);
+			break;
+		}
+	}
+
+	// A new transfer of SendFile(), io thread
+	void OfferFile(file_transfer transfer, file_offer const& offer) noexcept {
+		bool offered = false;
+
+		WithWire(transfer.to,
+			[&](WIRE& wire) {
+				auto p = std::make_shared<PacketTCP>(gef::unique_ref<msg<file_offer>>::make( offer ));
+				p->h.from_id = m_host_id;
+
+				wire.tcp_socket.Send(std::move(p));
+
+				offered = true;
+			});
+
+		m_transfers.push_back(std::move(transfer));
+
+		if (not offered) {
+			EndFile(m_transfers.end() - 1, false);
+		}
+	}
+
+	// The client's file_accept / file_ack / file_cancel, false for the other control messages
+	bool FileControl(PacketTCPclient& p, WIRE& from) noexcept {
+		if (p.is_header_only()) {
+			return false;
+		}
+
+		any_msg& m = p.m.value_unchecked().get();
+
+		u32 transfer;
+
+		switch (p.h.msg_type) {
+		case control_msg::file_accept:
+			transfer = m.as<file_accept>().inner.transfer;
+			break;
+		case control_msg::file_ack:
+			transfer = m.as<file_ack>().inner.transfer;
+			break;
+		case control_msg::file_cancel:
+			transfer = m.as<file_cancel>().inner.transfer;
+			break;
+		default:
+			return false;
+		}
+
+		auto it = std::ranges::find(m_transfers, transfer, &file_transfer::id);
+
+		if (it == m_transfers.end() || it->to != from.id()) { // ended, its chunks' acks are still on the way
+			return true;
+		}
+
+		switch (p.h.msg_type) {
+		case control_msg::file_accept: {
+			const u64 offset = m.as<file_accept>().inner.offset;
+
+			if (offset > it->size) {
+				EndFile(it, false);
+				return true;
+			}
+
+			// a first accept, or a chunk that was dropped (see `send_queue_limits::policy`): the rest is sent from `offset`
+			it->next = offset;
+			it->acked = offset;
+			break;
+		}
+		case control_msg::file_ack:
+			it->acked = std::clamp<u64>(m.as<file_ack>().inner.received, it->acked, it->next);
+			break;
+		case control_msg::file_cancel:
+			EndFile(it, false);
+			return true;
+		}
+
+		if constexpr (requires { access_hoster().on_file_progress(it->to, it->id, it->acked, it->size); }) {
+			access_hoster().on_file_progress(it->to, it->id, it->acked, it->size);
+		}
+
+		if (it->acked == it->size) {
+			EndFile(it, true);
+			return true;
+		}
+
+		PumpFile(*it, from);
+
+		return true;
+	}
+
+	// Queues the transfer's next chunks, up to its window past the client's acks
+	void PumpFile(file_transfer& transfer, WIRE& to) noexcept {
+		const u32 chunk_bytes = std::clamp<u32>(m_config.files.chunk_bytes, 1, file_chunk_max);
+		const u64 window = m_config.files.window_bytes;
+
+		while (transfer.next < transfer.size && (window == 0 || transfer.next - transfer.acked < window)) {
+			const u32 len = static_cast<u32>(std::min<u64>(chunk_bytes, transfer.size - transfer.next));
+
+			auto chunk = std::make_shared<PacketTCP>(gef::unique_ref<detail::file_chunk_out>::make( transfer.file, transfer.id, transfer.next, len ));
+			chunk->h.msg_type = control_msg::file_chunk; // the socket tells a chunk apart before it's queued
+			chunk->h.from_id = m_host_id;
+			chunk->priority = lane::bulk;
+
+			to.tcp_socket.Send(std::move(chunk));
+
+			transfer.next += len;
+		}
+
+		to.last_out_ms.store(elapsed_ms(), std::memory_order_relaxed);
+	}
+
+	// complete - the client has the whole file, on_file_cancel otherwise
+	void EndFile(std::vector<file_transfer>::iterator it, const bool complete) noexcept {
+		const i16 to = it->to;
+		const u32 id = it->id;
+
+		m_transfers.erase(it);
+
+		if (complete) {
+			return;
+		}
+
+		if constexpr (requires { access_hoster().on_file_cancel(to, id); }) {
+			access_hoster().on_file_cancel(to, id);
+		}
+	}
+
+	// The transfers to a wire that closed are cancelled, posted from its close
+	void WireFilesClosed(const i16 id) noexcept {
+		asio::post(m_context,
+			[this, id]() {
+				auto it = std::ranges::find(m_transfers, id, &file_transfer::to);
+
+				while (it != m_transfers.end()) {
+					EndFile(it, false);
+					it = std::ranges::find(m_transfers, id, &file_transfer::to);
+				}
+			});
+	}
+
+	/// Introduces `from` and the registered wires to each other,
+	/// a wire's mesh endpoint is the address the host sees with the port the client reported.
+	/// Each pair gets a token of its own, in both announcements, the two peers' probes carry it.
+	void MeshRegister(WIRE& from, mesh_register const& reg) noexcept {
+		asio::error_code ec;
+
+		auto const& remote_endpoint = from.tcp_socket.socket.remote_endpoint(ec);
+
+		if (ec) {
+			return;
+		}
+
+		from.mesh_endpoint = udp::endpoint(remote_endpoint.address(), reg.port);
+		from.relay_capacity = std::min<u8>(reg.relay_capacity, relay_children_max);
+
+		auto welcome = std::make_shared<PacketTCP>(control_msg::mesh_welcome);
+		welcome->h.from_id = from.id();
+		welcome->priority = lane::critical;
+
+		from.tcp_socket.Send(std::move(welcome));
+
+		wires.shared_lock(
+			[&](auto& vec) {
+				for (gef::unique_ref<WIRE> const& wire : vec) {
+
+					if (&wire.get() == &from || not wire->mesh_registered) {
+						continue;
+					}
+
+					const u64 token = detail::mesh_token();
+
+					auto known = std::make_shared<PacketTCP>(
+						gef::unique_ref<msg<mesh_peer>>::make( detail::to_mesh_peer(wire->id(), wire->mesh_endpoint, token) ));
+					known->h.from_id = m_host_id;
+					known->priority = lane::critical;
+
+					auto announce = std::make_shared<PacketTCP>(
+						gef::unique_ref<msg<mesh_peer>>::make( detail::to_mesh_peer(from.id(), from.mesh_endpoint, token) ));
+					announce->h.from_id = m_host_id;
+					announce->priority = lane::critical;
+
+					from.tcp_socket.Send(std::move(known));
+					wire->tcp_socket.Send(std::move(announce));
+				}
+			});
+
+		from.mesh_registered = true;
+
+		ScheduleRelayRebuild();
+	}
+
+	void MeshPath(WIRE& from, mesh_path const& path) noexcept {
+		from.mesh_direct.lock(
+			[&](std::vector<mesh_path>& direct) {
+				std::erase_if(direct, [&](mesh_path const& p) { return p.peer == path.peer; });
+
+				if (path.up) {
+					direct.push_back(path);
+				}
+			});
+
+		ScheduleRelayRebuild();
+	}
+
+	// the others drop their path to `leaving`, and the host relays to no one on its behalf anymore
+	void MeshLeave(WIRE& leaving) noexcept {
+		leaving.mesh_registered = false;
+
+		Send(gef::unique_ref<PacketTCP>::make(control_msg::mesh_peer_left), leaving.id(), lane::critical);
+
+		wires.shared_lock(
+			[&](auto& vec) {
+				for (gef::unique_ref<WIRE> const& wire : vec) {
+					wire->mesh_direct.lock(
+						[&](std::vector<mesh_path>& direct) {
+							std::erase_if(direct, [&](mesh_path const& p) { return p.peer == leaving.id(); });
+						});
+				}
+			});
+
+		// its subtree would miss the broadcasts until the rebuild, so the host sends to everyone meanwhile
+		wires.shared_lock(
+			[&](auto&) {
+				m_relay.lock(
+					[&](relay_plan& plan) {
+						plan.roots.clear();
+						plan.covered.clear();
+
+						MarkRelay(plan);
+					});
+			});
+
+		ScheduleRelayRebuild();
+	}
+
+	void ScheduleRelayRebuild() noexcept {
+		if (m_config.mesh.relay_fanout == 0 || relay_rebuild_pending) {
+			return;
+		}
+
+		relay_rebuild_pending = true;
+
+		m_relay_timer.expires_after(std::chrono::milliseconds(m_config.mesh.relay_rebuild_ms));
+
+		m_relay_timer.async_wait(
+			[this](asio::error_code ec) {
+				relay_rebuild_pending = false;
+
+				if (not ec) {
+					RebuildRelayTree();
+				}
+			});
+	}
+
+	/// Places the registered wires in the tree of the host's UDP broadcasts.
+	/// The wires with the most direct paths, then the lowest RTT to their peers, are placed first:
+	/// the first `relay_fanout` under the host, every next one under the shallowest, then closest,
+	/// placed wire that has capacity left and a direct path to it. A wire no relay reaches goes under the host.
+	///
+	/// A changed tree gets a new version, the relays forward only the broadcasts sent for their own version,
+	/// so a broadcast may be lost while the assignments are on the way but it never arrives twice.
+	void RebuildRelayTree() noexcept {
+		struct node {
+			WIRE* wire;
+			std::vector<mesh_path> direct;
+			std::vector<i16> children{};
+			u8 depth = 0;
+		};
+
+		wires.shared_lock(
+			[&](auto& vec) {
+				std::vector<node> nodes;
+
+				for (gef::unique_ref<WIRE> const& wire : vec) {
+					if (wire->mesh_registered) {
+						nodes.push_back(node{ &wire.get(), MeshDirect(vec, wire->id()) });
+					}
+				}
+
+				auto mean_rtt = [](node const& n) -> u64 {
+					if (n.direct.empty()) {
+						return std::numeric_limits<u64>::max();
+					}
+
+					return std::ranges::fold_left(n.direct, u64{ 0 }, [](u64 sum, mesh_path const& p) { return sum + p.rtt_us; }) / n.direct.size();
+				};
+
+				std::ranges::sort(nodes,
+					[&](node const& a, node const& b) {
+						return a.direct.size() != b.direct.size()
+							? a.direct.size() > b.direct.size()
+							: mean_rtt(a) < mean_rtt(b);
+					});
+
+				relay_plan plan;
+
+				// a tree pays off only beyond the fanout
+				if (nodes.size() > m_config.mesh.relay_fanout) {
+					for (size_t i = 0; i < nodes.size(); i++) {
+						const i16 id = nodes[i].wire->id();
+
+						node* parent = nullptr;
+						u32 parent_rtt = 0;
+
+						if (plan.roots.size() >= m_config.mesh.relay_fanout) {
+							for (size_t j = 0; j < i; j++) {
+								node& candidate = nodes[j];
+
+								if (candidate.children.size() >= candidate.wire->relay_capacity) {
+									continue;
+								}
+
+								auto path = std::ranges::find(candidate.direct, id, &mesh_path::peer);
+
+								if (path == candidate.direct.end()) {
+									continue;
+								}
+
+								if (parent == nullptr || candidate.depth < parent->depth || (candidate.depth == parent->depth && path->rtt_us < parent_rtt)) {
+									parent = &candidate;
+									parent_rtt = path->rtt_us;
+								}
+							}
+						}
+
+						if (parent != nullptr) {
+							parent->children.push_back(id);
+							nodes[i].depth = parent->depth + 1;
+						}
+						else {
+							plan.roots.push_back(id);
+						}
+
+						plan.covered.push_back(id);
+					}
+				}
+
+				bool changed = std::ranges::any_of(nodes, [](node const& n) { return n.children != n.wire->relay_children; });
+				u16 version = 0;
+
+				m_relay.lock(
+					[&](relay_plan& current) {
+						changed = changed || current.roots != plan.roots || current.covered != plan.covered;
+
+						if (changed) {
+							plan.version = current.version + 1;
+							current = std::move(plan);
+
+							MarkRelay(current);
+						}
+
+						version = current.version;
+					});
+
+				if (not changed) {
+					return;
+				}
+
+				for (node& n : nodes) {
+					if (n.children.empty() && n.wire->relay_children.empty()) {
+						continue;
+					}
+
+					relay_assign assignment{ version, static_cast<u8>(n.children.size()), {} };
+					std::ranges::copy(n.children, assignment.children.begin());
+
+					auto p = std::make_shared<PacketTCP>(gef::unique_ref<msg<relay_assign>>::make( assignment ));
+					p->h.from_id = m_host_id;
+					p->priority = lane::critical;
+
+					n.wire->tcp_socket.Send(std::move(p));
+					n.wire->relay_children = std::move(n.children);
+				}
+			});
+	}
+
+	/// Opens the listening sockets. Stop() closes them, so a restart binds the port again,
+	/// a Start() while they're still open keeps them.
+	asio::error_code OpenAcceptors() noexcept {
+		asio::error_code ec;
+
+		if (not m_acceptors.empty()) {
+			return ec;
+		}
+
+		asio::io_context& ctx = m_config.accept.threads > 0 ? m_accept_context : m_context;
+
+		const u8 count = detail::reuse_port_supported ? std::max<u8>(m_config.accept.acceptors, 1) : 1;
+
+		for (u8 i = 0; i < count && not ec; i++) {
+			tcp::acceptor& acceptor = *m_acceptors.emplace_back(std::make_shared<tcp::acceptor>(ctx));
+
+			acceptor.open(tcp::v4(), ec);
+
+			if (not ec) {
+				acceptor.set_option(tcp::acceptor::reuse_address(true), ec);
+			}
+
+#ifdef SO_REUSEPORT
+			if (not ec && count > 1) {
+				acceptor.set_option(detail::reuse_port(true), ec);
+			}
+#endif
+
+			if (not ec) {
+				acceptor.bind(tcp::endpoint(tcp::v4(), m_port), ec);
+			}
+
+			if (not ec) {
+				acceptor.listen(m_config.accept.backlog, ec);
+			}
+		}
+
+		if (ec) {
+			CloseAcceptors();
+		}
+
+		return ec;
+	}
+
+	/// Closes the listening sockets. Their pending accepts are aborted, they run on a later Start() at the earliest
+	/// and keep their acceptor alive until then.
+	void CloseAcceptors() noexcept {
+		for (auto const& acceptor : m_acceptors) {
+			asio::error_code ec;
+			acceptor->close(ec);
+		}
+
+		m_acceptors.clear();
 	}
 
 	/// Start accepting new connections.
-	void AcceptConnections() noexcept {
+	void AcceptConnections(std::shared_ptr<tcp::acceptor> const& acceptor) noexcept {
+
+		acceptor->async_accept(
+			[this, acceptor](asio::error_code ec, tcp::socket temp_sock) {
+				if (ec == asio::error::operation_aborted || not acceptor->is_open()) {
+					return;
+				}
 
-		m_acceptor.async_accept(
-			[this](asio::error_code ec, tcp::socket temp_sock) {
 				if (ec) {
 					access_hoster().on_error({ net_error::failed_to_connect, ec });
 				}
@@ -415,7 +1888,7 @@ private:
 					WIRE::Init(m_context, std::move(temp_sock));
 				}
 
-				AcceptConnections();
+				AcceptConnections(acceptor);
 			});
 	}
 
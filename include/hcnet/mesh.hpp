@@ -0,0 +1,478 @@
+#pragma once
+
+#include "canyon.hpp"
+#include "control.hpp"
+#include <chrono>
+#include <cstring>
+#include <random>
+
+namespace net {
+
+	namespace detail {
+		inline i64 steady_ns() noexcept {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// a `mesh_peer::token`, from the OS' entropy, a peer can't guess the ones of the pairs it isn't part of
+		inline u64 mesh_token() noexcept {
+			std::random_device entropy;
+
+			return (static_cast<u64>(entropy()) << 32) | entropy();
+		}
+
+		inline mesh_peer to_mesh_peer(const i16 id, udp::endpoint const& endpoint, const u64 token) noexcept {
+			mesh_peer peer{ id, endpoint.port(), endpoint.address().is_v6(), {}, token };
+
+			if (peer.v6) {
+				auto bytes = endpoint.address().to_v6().to_bytes();
+				std::memcpy(peer.address.data(), bytes.data(), bytes.size());
+			}
+			else {
+				auto bytes = endpoint.address().to_v4().to_bytes();
+				std::memcpy(peer.address.data(), bytes.data(), bytes.size());
+			}
+
+			return peer;
+		}
+
+		// the payload of a `control_msg::mesh_probe`, echoed by its ack
+		struct mesh_probe_payload {
+			u64 token;
+			i64 sent_ns;
+		};
+
+		inline udp::endpoint from_mesh_peer(mesh_peer const& peer) noexcept {
+			if (peer.v6) {
+				asio::ip::address_v6::bytes_type bytes;
+				std::memcpy(bytes.data(), peer.address.data(), bytes.size());
+
+				return { asio::ip::address_v6(bytes), peer.port };
+			}
+			else {
+				asio::ip::address_v4::bytes_type bytes;
+				std::memcpy(bytes.data(), peer.address.data(), bytes.size());
+
+				return { asio::ip::address_v4(bytes), peer.port };
+			}
+		}
+	}
+
+	// The client's side of the mesh, an unconnected UDP socket that reaches the other clients directly.
+	// Peers are announced by the host, a path to a peer is used once one of its probes is answered,
+	// and is dropped after `mesh_config::probe_misses` unanswered probes.
+	// Every path change is reported to the host, which keeps relaying to the peers without a path.
+	//
+	// Both sides probe each other at once, which also opens the way through cone NATs,
+	// a peer's endpoint follows the source of its probes. A probe counts only with the token the host issued
+	// for the pair, so another peer can't take over a peer's endpoint by claiming its id.
+	//
+	// As a relay (see `mesh_config::relay_fanout`), it forwards the host's broadcasts to its assigned peers.
+	template <typename Manager>
+	class MeshSocket {
+	public:
+
+		using PacketIn = packet_udp<header_server_UDP>;
+		using PacketOut = packet_udp<header_client_UDP>;
+
+		struct peer {
+			i16 id;
+			udp::endpoint endpoint;
+			u64 token;
+			bool direct = false;
+			u8 unanswered = 0;
+			u32 rtt_us = 0;
+		};
+
+		MeshSocket(Manager& manager, asio::io_context& ctx, mesh_config const& config) noexcept :
+			manager(manager),
+			config(config),
+			probe_timer(ctx),
+			socket(ctx)
+		{}
+
+		// Binds an ephemeral port next to the TCP connection
+		asio::error_code Open(asio::ip::address const& local_address) noexcept {
+			asio::error_code ec;
+
+			socket.open(local_address.is_v6() ? udp::v6() : udp::v4(), ec);
+
+			if (ec) {
+				return ec;
+			}
+
+			socket.bind(udp::endpoint(local_address, 0), ec);
+
+			return ec;
+		}
+
+		u16 port() const noexcept {
+			asio::error_code ec;
+			return socket.local_endpoint(ec).port();
+		}
+
+		// self - this client's id, the host sends it once it registered the mesh socket
+		void Start(const i16 self) noexcept {
+			self_id = self;
+			running = true;
+
+			Read();
+			Probe();
+		}
+
+		void Stop() noexcept {
+			running = false;
+
+			probe_timer.cancel();
+
+			// SendDirect() sends from the application's threads under the shared lock, not while it's closed
+			peers.lock(
+				[&](auto& vec) {
+					asio::error_code ec;
+					socket.close(ec);
+
+					vec.clear();
+				});
+
+			relay_children.clear();
+		}
+
+		constexpr bool is_running() const noexcept {
+			return running;
+		}
+
+		void AddPeer(mesh_peer const& announced) noexcept {
+			peers.lock(
+				[&](auto& vec) {
+					std::erase_if(vec, [&](peer const& p) { return p.id == announced.id; });
+
+					vec.push_back(peer{ announced.id, detail::from_mesh_peer(announced), announced.token });
+				});
+		}
+
+		// the host already knows the peer left, nothing to report
+		void RemovePeer(const i16 id) noexcept {
+			peers.lock(
+				[&](auto& vec) {
+					std::erase_if(vec, [&](peer const& p) { return p.id == id; });
+				});
+		}
+
+		size_t direct_peers() noexcept {
+			size_t count = 0;
+
+			peers.shared_lock(
+				[&](auto const& vec) {
+					count = std::ranges::count_if(vec, &peer::direct);
+				});
+
+			return count;
+		}
+
+		// runs on the io thread, like `Relay()`
+		void Assign(relay_assign const& assignment) noexcept {
+			relay_version = assignment.version;
+			relay_children.assign(assignment.children.begin(), assignment.children.begin() + std::min<size_t>(assignment.count, relay_children_max));
+		}
+
+		// Forwards a `control_msg::relay` datagram down the tree, then delivers the broadcast it carries
+		void Relay(const_buf datagram) noexcept {
+			if (datagram.size() < detail::relay_prefix_size + header_server_UDP::header_size) {
+				return;
+			}
+
+			const u8* data = static_cast<const u8*>(datagram.data());
+
+			u16 version;
+			std::memcpy(&version, data + header_server_UDP::header_size, sizeof(version));
+
+			if (version == relay_version && not relay_children.empty()) { // a stale tree could reach a peer twice
+				peers.shared_lock(
+					[&](auto const& vec) {
+						for (peer const& to : vec) {
+							if (std::ranges::find(relay_children, to.id) != relay_children.end()) {
+								asio::error_code ec;
+								socket.send_to(datagram, to.endpoint, 0, ec);
+							}
+						}
+					});
+			}
+
+			header_server_UDP inner;
+			std::memcpy(&inner, data + detail::relay_prefix_size, header_server_UDP::header_size);
+
+			if (inner.msg_type < 0 || inner.from_id == self_id) {
+				return;
+			}
+
+			const size_t size = datagram.size() - detail::relay_prefix_size;
+
+			auto p = gef::unique_ref<PacketIn>::make( std::move(manager.builder_UDP(size)) );
+
+			asio::buffer_copy(p->mut_buf_seq(), const_buf{ data + detail::relay_prefix_size, size });
+
+			manager.NewPacketUDP(std::move(p));
+		}
+
+		// Sends `p` straight to every peer with a direct path, as if the host relayed it
+		void SendDirect(PacketOut& p) noexcept {
+			header_server_UDP h{};
+
+			auto bufs = p.m->const_buf_seq(h.msg_type);
+
+			h.from_id = self_id;
+			bufs[0] = header_to<const_buf>(h);
+
+			peers.shared_lock(
+				[&](auto const& vec) {
+					for (peer const& to : vec) {
+						if (to.direct) {
+							asio::error_code ec;
+							socket.send_to(bufs, to.endpoint, 0, ec); // a lost path shows up in the probes
+						}
+					}
+				});
+		}
+
+	private:
+
+		void Read() noexcept {
+			socket.async_receive_from(mut_buf{ scratch.data(), scratch.size() }, sender,
+				[this](asio::error_code ec, size_t size) {
+					if (ec == asio::error::connection_refused || ec == asio::error::connection_reset) { // ICMP of an earlier send
+						Read();
+						return;
+					}
+
+					if (ec) {
+						if (running) {
+							Fail();
+						}
+						return;
+					}
+
+					Receive(size);
+					Read();
+				});
+		}
+
+		void Receive(const size_t size) noexcept {
+			if (size < header_server_UDP::header_size) {
+				return;
+			}
+
+			header_server_UDP h;
+			std::memcpy(&h, scratch.data(), header_server_UDP::header_size);
+
+			switch (h.msg_type) {
+			case control_msg::mesh_probe:
+				Answer(h.from_id, size);
+				return;
+			case control_msg::mesh_probe_ack:
+				Answered(h.from_id, size);
+				return;
+			case control_msg::relay:
+				if (FromAnyPeer()) {
+					Relay(const_buf{ scratch.data(), size });
+				}
+				return;
+			}
+
+			if (h.msg_type < 0 || not FromPeer(h.from_id)) {
+				return;
+			}
+
+			auto p = gef::unique_ref<PacketIn>::make( std::move(manager.builder_UDP(size)) );
+
+			asio::buffer_copy(p->mut_buf_seq(), const_buf{ scratch.data(), size });
+
+			// an unknown type from a peer is dropped, only the host's connection is closed for one
+			manager.NewPacketUDP(std::move(p));
+		}
+
+		// the probe's payload is the pair's token and the sender's timestamp, the ack echoes it
+		void Answer(const i16 from_id, const size_t size) noexcept {
+			if (size != header_server_UDP::header_size + sizeof(detail::mesh_probe_payload)) {
+				return;
+			}
+
+			detail::mesh_probe_payload probe;
+			std::memcpy(&probe, scratch.data() + header_server_UDP::header_size, sizeof(probe));
+
+			bool known = false;
+
+			peers.lock(
+				[&](auto& vec) {
+					for (peer& p : vec) {
+						if (p.id == from_id && p.token == probe.token) {
+							p.endpoint = sender; // the NAT's mapping may differ from what the host sees
+							known = true;
+						}
+					}
+				});
+
+			if (not known) {
+				return;
+			}
+
+			header_server_UDP h{ control_msg::mesh_probe_ack, self_id };
+
+			std::array<const_buf, 2> bufs{
+				header_to<const_buf>(h),
+				const_buf{ &probe, sizeof(probe) }
+			};
+
+			asio::error_code ec;
+			socket.send_to(bufs, sender, 0, ec);
+		}
+
+		void Answered(const i16 from_id, const size_t size) noexcept {
+			if (size != header_server_UDP::header_size + sizeof(detail::mesh_probe_payload)) {
+				return;
+			}
+
+			detail::mesh_probe_payload ack;
+			std::memcpy(&ack, scratch.data() + header_server_UDP::header_size, sizeof(ack));
+
+			bool went_up = false;
+			u32 rtt_us = 0;
+
+			peers.lock(
+				[&](auto& vec) {
+					for (peer& p : vec) {
+						if (p.id == from_id && p.token == ack.token && p.endpoint == sender) {
+							p.rtt_us = static_cast<u32>((detail::steady_ns() - ack.sent_ns) / 1000);
+							p.unanswered = 0;
+
+							went_up = not p.direct;
+							p.direct = true;
+							rtt_us = p.rtt_us;
+						}
+					}
+				});
+
+			if (went_up) {
+				manager.MeshPathChanged(from_id, true, rtt_us);
+			}
+		}
+
+		// whether the last datagram came from the endpoint of the peer `from_id`, a peer's own datagrams
+		bool FromPeer(const i16 from_id) noexcept {
+			bool is_peer = false;
+
+			peers.shared_lock(
+				[&](auto const& vec) {
+					is_peer = std::ranges::any_of(vec,
+						[&](peer const& p) {
+							return p.id == from_id && p.endpoint == sender;
+						});
+				});
+
+			return is_peer;
+		}
+
+		// whether the last datagram came from any peer, a `control_msg::relay` carries someone else's datagram
+		bool FromAnyPeer() noexcept {
+			bool is_peer = false;
+
+			peers.shared_lock(
+				[&](auto const& vec) {
+					is_peer = std::ranges::any_of(vec,
+						[&](peer const& p) {
+							return p.endpoint == sender;
+						});
+				});
+
+			return is_peer;
+		}
+
+		void Probe() noexcept {
+			probe_timer.expires_after(std::chrono::milliseconds(config.probe_interval_ms));
+
+			probe_timer.async_wait(
+				[this](asio::error_code ec) {
+					if (ec || not running) {
+						return;
+					}
+
+					ProbePeers();
+					Probe();
+				});
+		}
+
+		void ProbePeers() noexcept {
+			header_server_UDP h{ control_msg::mesh_probe, self_id };
+			detail::mesh_probe_payload probe{ 0, detail::steady_ns() };
+
+			std::array<const_buf, 2> bufs{
+				header_to<const_buf>(h),
+				const_buf{ &probe, sizeof(probe) }
+			};
+
+			std::vector<i16> went_down;
+
+			peers.lock(
+				[&](auto& vec) {
+					for (peer& p : vec) {
+						if (p.direct && p.unanswered >= config.probe_misses) {
+							p.direct = false;
+							went_down.push_back(p.id);
+						}
+
+						p.unanswered = static_cast<u8>(std::min<int>(p.unanswered + 1, 0xFF));
+
+						probe.token = p.token;
+
+						asio::error_code ec;
+						socket.send_to(bufs, p.endpoint, 0, ec);
+					}
+				});
+
+			for (i16 id : went_down) {
+				manager.MeshPathChanged(id, false, 0);
+			}
+		}
+
+		// the socket is gone, everything goes through the host again
+		void Fail() noexcept {
+			running = false;
+
+			std::vector<i16> went_down;
+
+			peers.lock(
+				[&](auto& vec) {
+					for (peer& p : vec) {
+						if (p.direct) {
+							went_down.push_back(p.id);
+						}
+					}
+
+					vec.clear();
+				});
+
+			for (i16 id : went_down) {
+				manager.MeshPathChanged(id, false, 0);
+			}
+		}
+
+	private:
+		Manager& manager;
+		mesh_config config;
+
+		asio::steady_timer probe_timer;
+
+		gef::mutex<std::vector<peer>> peers;
+
+		std::vector<u8> scratch = std::vector<u8>(64 * 1024);
+		udp::endpoint sender;
+
+		i16 self_id{ -1 };
+		std::atomic<bool> running{ false };
+
+		// io thread only
+		u16 relay_version = 0;
+		std::vector<i16> relay_children;
+
+	public:
+		udp::socket socket;
+	};
+}
\ No newline at end of file
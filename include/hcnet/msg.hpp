@@ -56,4 +56,17 @@ namespace net {
 	public:
 		T inner;
 	};
+
+	/// The message a body of `body_size` bytes is received into, for the builders.
+	/// A derived message (see `derive_vectorize`) gets its trailing member sized from it
+	template <typename T>
+	gef::unique_ref<msg<T>> build_msg(const size_t body_size) noexcept {
+		auto m = gef::unique_ref<msg<T>>::make();
+
+		if constexpr (requires { vectorize_msg<T>::resize(m->inner, body_size); }) {
+			vectorize_msg<T>::resize(m->inner, body_size);
+		}
+
+		return m;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "canyon.hpp"
+#include "capture.hpp"
+#include <thread>
+
+namespace net {
+
+	struct replay_stats {
+		u64 packets = 0;   // handed to the handlers
+		u64 skipped = 0;   // out-going, control messages, or types the builders don't know
+		i64 elapsed_ns = 0;
+	};
+
+	// Feeds the in-coming packets of a trace to the handlers of `manager`, a Hoster or a Clienter, with no network in between.
+	// The manager doesn't need to be started, what its handlers send is queued and never written.
+	//
+	// speed - 1 keeps the trace's pacing, 4 replays it 4 times faster, 0 as fast as possible
+	template <typename Manager>
+	replay_stats Replay(Manager& manager, CaptureReader const& trace, const double speed = 1.0) noexcept {
+		constexpr bool is_host = requires { typename Manager::WIRE; };
+
+		using PacketTCPin = std::conditional_t<is_host, packet_tcp<header_client_TCP>, packet_tcp<header_server_TCP>>;
+		using PacketUDPin = std::conditional_t<is_host, packet_udp<header_client_UDP>, packet_udp<header_server_UDP>>;
+
+		using HeaderTCP = decltype(PacketTCPin::h);
+		using HeaderUDP = decltype(PacketUDPin::h);
+
+		replay_stats stats;
+
+		const auto start = std::chrono::steady_clock::now();
+		i64 first_ns = -1;
+
+		trace.for_each(
+			[&](capture_record const& r, const_buf packet) {
+				if (r.direction != capture_direction::in) {
+					stats.skipped++;
+					return;
+				}
+
+				if (first_ns < 0) {
+					first_ns = r.time_ns;
+				}
+
+				if (speed > 0) {
+					std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<i64>((r.time_ns - first_ns) / speed)));
+				}
+
+				const u8* data = static_cast<const u8*>(packet.data());
+
+				if (r.proto == protocol::tcp) {
+					if (packet.size() < HeaderTCP::header_size) {
+						stats.skipped++;
+						return;
+					}
+
+					auto p = gef::unique_ref<PacketTCPin>::make();
+					std::memcpy(&p->h, data, HeaderTCP::header_size);
+
+					const const_buf body{ data + HeaderTCP::header_size, packet.size() - HeaderTCP::header_size };
+
+					if (p->h.msg_type < 0) {
+						stats.skipped++;
+						return;
+					}
+
+					if (body.size() != 0) {
+						bool built = false;
+
+						p->m.replace(manager.builder_TCP(p->h))
+							.map_or_else(
+								[&](gef::unique_ref<any_msg>& m) {
+									asio::buffer_copy(m->mut_buf_seq(), body);
+									built = true;
+								},
+								[]() {});
+
+						if (not built) {
+							stats.skipped++;
+							return;
+						}
+					}
+
+					if constexpr (is_host) {
+						manager.new_packet_TCP(std::move(p), r.wire);
+					}
+					else {
+						manager.new_packet_TCP(std::move(p));
+					}
+				}
+				else {
+					if (packet.size() < HeaderUDP::header_size) {
+						stats.skipped++;
+						return;
+					}
+
+					HeaderUDP h;
+					std::memcpy(&h, data, HeaderUDP::header_size);
+
+					if (h.msg_type < 0) {
+						stats.skipped++;
+						return;
+					}
+
+					auto p = gef::unique_ref<PacketUDPin>::make( std::move(manager.builder_UDP(packet.size())) );
+
+					asio::buffer_copy(p->mut_buf_seq(), packet);
+
+					if constexpr (is_host) {
+						manager.new_packet_UDP(std::move(p), r.wire);
+					}
+					else {
+						manager.new_packet_UDP(std::move(p));
+					}
+				}
+
+				stats.packets++;
+			});
+
+		stats.elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+		return stats;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "canyon.hpp"
+#include "concurrentqueue/lightweightsemaphore.h"
+
+namespace net {
+
+	// Out-going packets of a single socket, bounded by `send_queue_limits`.
+	// * multiple producers (the application and the library's control messages), single consumer (the socket's writer thread, or its io thread)
+	// * FIFO per producer
+	// * one FIFO per `lane`, Pop() always takes from the highest non-empty lane
+	// * the buffer sequence is built once when queued, the writer only sends it
+	template <typename Holder>
+	class SendQueue {
+	public:
+
+		struct entry {
+			Holder p{ nullptr };
+			std::vector<const_buf> bufs;
+			size_t bytes = 0;
+			lane priority = lane::critical;
+		};
+
+		enum class push_result : i8 {
+			queued,
+			queued_congested, // queued, and the queue just crossed its high-water mark
+			dropped,
+			overflow          // `overflow_policy::disconnect`, the owner should close the connection
+		};
+
+		// reliable - a reliable stream can't drop packets that are already queued
+		SendQueue(send_queue_limits const& limits, bool reliable) noexcept :
+			limits(limits),
+			reliable(reliable)
+		{}
+
+		// `alive` is checked while blocking, so a closed connection never holds the producer.
+		// may_block - false on the thread that drains the queue, `overflow_policy::block` drops the packet instead of waiting for itself
+		push_result Push(Holder p, std::atomic<bool> const& alive, const bool may_block = true) noexcept {
+
+			if (not alive) {
+				dropped_packets.fetch_add(1, std::memory_order_relaxed);
+				return push_result::dropped;
+			}
+
+			auto bufs = p->const_buf_seq();
+			const size_t bytes = asio::buffer_size(bufs);
+
+			if (Exceeds(bytes)) {
+				switch (limits.policy) {
+				case overflow_policy::drop_oldest_unreliable:
+					// the writer drops the oldest one of the lowest lane on its next dequeue,
+					// until it catches up the queue may hold twice its limit
+					if (not reliable && not Exceeds(bytes, 2)) {
+						pending_drops.fetch_add(1, std::memory_order_relaxed);
+						break;
+					}
+
+					[[fallthrough]];
+				case overflow_policy::drop_newest:
+					dropped_packets.fetch_add(1, std::memory_order_relaxed);
+					return push_result::dropped;
+
+				case overflow_policy::block:
+					if (not may_block) {
+						dropped_packets.fetch_add(1, std::memory_order_relaxed);
+						return push_result::dropped;
+					}
+
+					while (Exceeds(bytes)) {
+						if (not alive) {
+							dropped_packets.fetch_add(1, std::memory_order_relaxed);
+							return push_result::dropped;
+						}
+
+						queued_bytes.wait(queued_bytes.load());
+					}
+					break;
+
+				case overflow_policy::disconnect:
+					dropped_packets.fetch_add(1, std::memory_order_relaxed);
+					return push_result::overflow;
+				}
+			}
+
+			const size_t total = queued_bytes.fetch_add(bytes) + bytes;
+			queued_packets.fetch_add(1);
+
+			const lane priority = p->priority;
+
+			lanes[static_cast<size_t>(priority)].enqueue(entry{ std::move(p), std::move(bufs), bytes, priority });
+			items.signal();
+
+			if (limits.high_water_bytes != 0 && total >= limits.high_water_bytes && not congested.exchange(true)) {
+				return push_result::queued_congested;
+			}
+
+			return push_result::queued;
+		}
+
+		// Blocks until an entry is available.
+		// - Returns false when woken up by Stop()
+		// - relieved - an entry dropped on the way drained the queue below half of its high-water mark, see Release()
+		bool Pop(entry& e, bool& relieved) noexcept {
+			relieved = false;
+
+			for (;;) {
+				items.wait();
+
+				if (pending_drops.load(std::memory_order_relaxed) == 0) {
+					TakeFrom(e, lanes.begin(), lanes.end());
+
+					return not e.bufs.empty(); // empty - Stop() sentinel
+				}
+
+				// drop the oldest of the lowest lane
+				TakeFrom(e, lanes.rbegin(), lanes.rend());
+
+				if (e.bufs.empty()) {
+					return false;
+				}
+
+				pending_drops.fetch_sub(1, std::memory_order_relaxed);
+				dropped_packets.fetch_add(1, std::memory_order_relaxed);
+
+				relieved |= Release(e.bytes);
+			}
+		}
+
+		// Non-blocking Pop()
+		bool TryPop(entry& e, bool& relieved) noexcept {
+			relieved = false;
+
+			while (items.tryWait()) {
+
+				if (pending_drops.load(std::memory_order_relaxed) == 0) {
+					TakeFrom(e, lanes.begin(), lanes.end());
+
+					return not e.bufs.empty();
+				}
+
+				TakeFrom(e, lanes.rbegin(), lanes.rend());
+
+				if (e.bufs.empty()) {
+					return false;
+				}
+
+				pending_drops.fetch_sub(1, std::memory_order_relaxed);
+				dropped_packets.fetch_add(1, std::memory_order_relaxed);
+
+				relieved |= Release(e.bytes);
+			}
+
+			return false;
+		}
+
+		// Non-blocking Pop() of lanes higher than `below`.
+		// - A popped entry with no buffers is the Stop() sentinel
+		bool TryPopAbove(const lane below, entry& e) noexcept {
+			if (not items.tryWait()) {
+				return false;
+			}
+
+			for (size_t i = 0; i < static_cast<size_t>(below); i++) {
+				if (lanes[i].try_dequeue(e)) {
+					return true;
+				}
+			}
+
+			items.signal(); // the item belongs to a lower lane, give it back
+			return false;
+		}
+
+		// Called by the writer once a popped entry has been sent.
+		// - Returns true when the queue drained below half of its high-water mark
+		bool Release(const size_t bytes) noexcept {
+			const size_t total = queued_bytes.fetch_sub(bytes) - bytes;
+			queued_packets.fetch_sub(1);
+
+			if (limits.policy == overflow_policy::block) {
+				queued_bytes.notify_all();
+			}
+
+			return congested.load(std::memory_order_relaxed)
+				&& total < limits.high_water_bytes / 2
+				&& congested.exchange(false);
+		}
+
+		// 'Wake up' the writer's Pop() and any blocked producer
+		void Stop() noexcept {
+			lanes[static_cast<size_t>(lane::critical)].enqueue(entry{});
+			items.signal();
+			Wake();
+		}
+
+		void Wake() noexcept {
+			queued_bytes.notify_all();
+		}
+
+		size_t bytes() const noexcept {
+			return queued_bytes.load(std::memory_order_relaxed);
+		}
+
+		size_t packets() const noexcept {
+			return queued_packets.load(std::memory_order_relaxed);
+		}
+
+		size_t dropped() const noexcept {
+			return dropped_packets.load(std::memory_order_relaxed);
+		}
+
+	private:
+
+		// an item was already taken from `items`, so one of the lanes holds an entry,
+		// it may take another round until a concurrent enqueue becomes visible
+		template <typename It>
+		static void TakeFrom(entry& e, It first, It last) noexcept {
+			for (;;) {
+				for (It it = first; it != last; ++it) {
+					if (it->try_dequeue(e)) {
+						return;
+					}
+				}
+			}
+		}
+
+		constexpr bool Exceeds(const size_t bytes, const size_t factor = 1) const noexcept {
+			return (limits.max_bytes != 0 && queued_bytes.load() + bytes > limits.max_bytes * factor)
+				|| (limits.max_packets != 0 && queued_packets.load() + 1 > limits.max_packets * factor);
+		}
+
+	private:
+		send_queue_limits limits;
+		bool reliable;
+
+		std::array<moodycamel::ConcurrentQueue<entry>, lane_count> lanes;
+		moodycamel::LightweightSemaphore items;
+
+		std::atomic<size_t> queued_bytes{ 0 };
+		std::atomic<size_t> queued_packets{ 0 };
+		std::atomic<size_t> pending_drops{ 0 };
+		std::atomic<size_t> dropped_packets{ 0 };
+
+		std::atomic<bool> congested{ false };
+	};
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <atomic>
+#include <algorithm>
+#include <limits>
+
+namespace net {
+
+	// The per-wire state a broadcast's fan-out reads, in parallel arrays indexed by the wire's slot,
+	// so skipping a wire reads a couple of bytes instead of the wire (its sockets, queues and handshake state).
+	// A slot is the wire's from Insert() to Erase(), freed slots are reused.
+	//
+	// * Insert() / Erase() under the owner's exclusive lock, the rest under its shared lock
+	// * flags may be set / cleared from any thread under the shared lock
+	template <typename Wire>
+	class SessionTable {
+	public:
+
+		enum flag : u8 {
+			live = 1 << 0,          // the slot holds a wire
+			open = 1 << 1,          // its connection wasn't closed
+			relay_covered = 1 << 2, // the host's UDP broadcasts reach it through the relay tree
+			relay_root = 1 << 3     // it gets them from the host, to forward down the tree
+		};
+
+		inline static constexpr u32 no_slot = std::numeric_limits<u32>::max();
+
+		u32 Insert(Wire* wire, const i16 id, const u8 shard) noexcept {
+			u32 slot;
+
+			if (not free_slots.empty()) {
+				slot = free_slots.back();
+				free_slots.pop_back();
+			}
+			else {
+				slot = static_cast<u32>(ids.size());
+
+				ids.push_back(-1);
+				flag_bits.push_back(0);
+				shards.push_back(0);
+				wires.push_back(nullptr);
+			}
+
+			ids[slot] = id;
+			shards[slot] = shard;
+			wires[slot] = wire;
+			std::atomic_ref<u8>(flag_bits[slot]).store(live | open, std::memory_order_release);
+
+			live_count++;
+
+			return slot;
+		}
+
+		void Erase(const u32 slot) noexcept {
+			std::atomic_ref<u8>(flag_bits[slot]).store(0, std::memory_order_release);
+			ids[slot] = -1;
+			wires[slot] = nullptr;
+
+			free_slots.push_back(slot);
+
+			live_count--;
+		}
+
+		void Set(const u32 slot, const u8 bits) noexcept {
+			std::atomic_ref<u8>(flag_bits[slot]).fetch_or(bits, std::memory_order_acq_rel);
+		}
+
+		void Clear(const u32 slot, const u8 bits) noexcept {
+			std::atomic_ref<u8>(flag_bits[slot]).fetch_and(static_cast<u8>(~bits), std::memory_order_acq_rel);
+		}
+
+		// every slot, live or not, the end of a scan
+		constexpr u32 slot_count() const noexcept {
+			return static_cast<u32>(ids.size());
+		}
+
+		constexpr size_t size() const noexcept {
+			return live_count;
+		}
+
+		u8 flags(const u32 slot) const noexcept {
+			return std::atomic_ref<u8>(flag_bits[slot]).load(std::memory_order_acquire);
+		}
+
+		constexpr i16 id(const u32 slot) const noexcept {
+			return ids[slot];
+		}
+
+		constexpr u8 shard(const u32 slot) const noexcept {
+			return shards[slot];
+		}
+
+		constexpr Wire* wire(const u32 slot) const noexcept {
+			return wires[slot];
+		}
+
+		// the shard of the fewest wires among `shard_count`
+		u8 LightestShard(const size_t shard_count) const noexcept {
+			if (shard_count < 2) {
+				return 0;
+			}
+
+			std::vector<u32> counts(shard_count, 0);
+
+			for (u32 slot = 0; slot < slot_count(); slot++) {
+				if (flags(slot) & live) {
+					counts[shards[slot]]++;
+				}
+			}
+
+			return static_cast<u8>(std::ranges::min_element(counts) - counts.begin());
+		}
+
+	private:
+		// hot, read for every wire of every broadcast
+		std::vector<i16> ids;
+		mutable std::vector<u8> flag_bits; // accessed through atomic_ref, the fan-out threads read it while Close() clears `open`
+		std::vector<u8> shards;
+
+		// cold, read only for the wires a broadcast is sent to
+		std::vector<Wire*> wires;
+
+		std::vector<u32> free_slots;
+		size_t live_count = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,566 @@
+#pragma once
+
+#include "canyon.hpp"
+#include "capture.hpp"
+#include "control.hpp"
+#include "thread.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <ctime>
+#endif
+
+namespace net {
+
+	// POSIX shared memory, see `shm_config`
+#ifdef _WIN32
+	inline constexpr bool shm_supported = false;
+#else
+	inline constexpr bool shm_supported = true;
+#endif
+
+	namespace detail {
+
+		static_assert(std::atomic<u64>::is_always_lock_free && std::atomic<u32>::is_always_lock_free,
+			"the rings' indices are shared between processes");
+
+		struct shm_segment_header {
+			inline static constexpr std::array<char, 8> expected_magic{ 'h', 'c', 'n', 'e', 't', 's', 'h', 'm' };
+			inline static constexpr u32 current_version = 1;
+
+			std::array<char, 8> magic;
+			u32 version;
+			u32 reserved;
+			u64 ring_bytes; // of each ring
+		};
+
+		// The indices of a ring, the writer's and the reader's on cache lines of their own
+		struct shm_ring_header {
+			alignas(cache_line) std::atomic<u64> head; // written up to, the writer's
+			alignas(cache_line) std::atomic<u64> tail; // read up to, the reader's
+			alignas(cache_line) std::atomic<u32> wake; // a futex word, bumped to wake the reader
+			std::atomic<u32> sleeping;                  // the reader waits on `wake`, or is about to
+		};
+
+		// Precedes every record, records start 8 byte aligned
+		struct shm_record {
+			inline static constexpr u32 wrap = 0xFFFFFFFF; // filler up to the end of the ring, the next record is at its start
+
+			u32 size; // of the bytes following this
+			protocol proto;
+			u8 more;  // a piece of a packet larger than half the ring, the next record of its protocol continues it
+			u16 reserved;
+		};
+
+		// [segment header][ring header, client -> host][ring header, host -> client][ring bytes][ring bytes]
+		inline constexpr size_t shm_rings_offset = cache_line + 2 * sizeof(shm_ring_header);
+
+		constexpr size_t shm_record_bytes(const size_t size) noexcept {
+			return (sizeof(shm_record) + size + 7) & ~size_t{ 7 };
+		}
+
+		// Copies the `len` bytes of `bufs` that start at `offset` to `out`
+		inline void copy_buf_range(std::vector<const_buf> const& bufs, size_t offset, size_t len, u8* out) noexcept {
+			for (const_buf const& b : bufs) {
+				if (len == 0) {
+					break;
+				}
+
+				if (offset >= b.size()) {
+					offset -= b.size();
+					continue;
+				}
+
+				const size_t take = std::min<size_t>(b.size() - offset, len);
+
+				std::memcpy(out, static_cast<const u8*>(b.data()) + offset, take);
+
+				out += take;
+				offset = 0;
+				len -= take;
+			}
+		}
+
+		// The peer of `s` is on this machine, at a loopback address or at the socket's own
+		inline bool is_local_peer(tcp::socket const& s) noexcept {
+			asio::error_code ec;
+
+			const tcp::endpoint local = s.local_endpoint(ec);
+
+			if (ec) {
+				return false;
+			}
+
+			const tcp::endpoint remote = s.remote_endpoint(ec);
+
+			return not ec && (remote.address().is_loopback() || remote.address() == local.address());
+		}
+
+		// Waits until `word` no longer holds `observed`, a wake-up, or `timeout_ms`, whichever is first.
+		// The word is in memory shared between processes, the futex isn't private
+		inline void futex_wait(std::atomic<u32>& word, const u32 observed, const u32 timeout_ms) noexcept {
+#ifdef __linux__
+			timespec timeout{ static_cast<time_t>(timeout_ms / 1000), static_cast<long>(timeout_ms % 1000) * 1'000'000L };
+
+			::syscall(SYS_futex, reinterpret_cast<u32*>(&word), FUTEX_WAIT, observed, &timeout, nullptr, 0);
+#else
+			if (word.load(std::memory_order_acquire) == observed) { // no cross-process wait, a short sleep instead
+				std::this_thread::sleep_for(std::chrono::microseconds(std::min<u32>(timeout_ms * 1000, 50)));
+			}
+#endif
+		}
+
+		inline void futex_wake(std::atomic<u32>& word) noexcept {
+#ifdef __linux__
+			::syscall(SYS_futex, reinterpret_cast<u32*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+			(void)word;
+#endif
+		}
+
+		// One direction of a link, a single producer single consumer byte ring in the shared segment
+		class shm_ring {
+		public:
+			using clock = std::chrono::steady_clock;
+
+			shm_ring() noexcept {}
+
+			shm_ring(shm_ring_header* header, u8* data, const u64 capacity) noexcept :
+				header(header), data(data), capacity(capacity)
+			{}
+
+			// Copies a packet's buffers in, as one record or as pieces of at most half the ring, and wakes the reader.
+			// One writer at a time, the pieces of a packet may be interleaved with records of the other protocol.
+			// offset - the bytes of the packet written so far, a call that returns false leaves it at the next piece
+			// - Returns false if the reader made no room until `deadline`, or `stop` was set meanwhile
+			bool Write(const protocol proto, std::vector<const_buf> const& bufs, size_t& offset, const clock::time_point deadline, std::atomic<bool> const& stop) noexcept {
+				const size_t total = asio::buffer_size(bufs);
+				const size_t piece_max = capacity / 2 - sizeof(shm_record);
+
+				const size_t first = offset;
+
+				do {
+					const size_t len = std::min<size_t>(piece_max, total - offset);
+					const u64 need = shm_record_bytes(len);
+
+					u64 head = header->head.load(std::memory_order_relaxed);
+					u64 pos = head % capacity;
+
+					const u64 skip = capacity - pos < need ? capacity - pos : 0; // a record never wraps
+
+					for (u32 spins = 0; head + skip + need - header->tail.load(std::memory_order_acquire) > capacity; spins++) {
+						if (stop.load(std::memory_order_relaxed) || clock::now() >= deadline) {
+							if (offset != first) {
+								Wake();
+							}
+
+							return false;
+						}
+
+						if (spins < 1024) {
+							std::this_thread::yield();
+						}
+						else {
+							std::this_thread::sleep_for(std::chrono::microseconds(50));
+						}
+					}
+
+					if (skip != 0) {
+						const shm_record filler{ shm_record::wrap, proto, 0, 0 };
+						std::memcpy(data + pos, &filler, sizeof(filler));
+
+						head += skip;
+						pos = 0;
+					}
+
+					const shm_record record{ static_cast<u32>(len), proto, static_cast<u8>(offset + len < total), 0 };
+
+					std::memcpy(data + pos, &record, sizeof(record));
+					copy_buf_range(bufs, offset, len, data + pos + sizeof(record));
+
+					header->head.store(head + need, std::memory_order_release);
+
+					offset += len;
+				} while (offset < total);
+
+				Wake();
+
+				return true;
+			}
+
+			// `deliver(protocol, const_buf packet)` for the packets written so far, up to `max_records`, a packet in one record
+			// straight from the ring, a packet in pieces once its protocol's `partial` holds all of them. One reader at a time.
+			// - Returns the number of records read, -1 if one was malformed or a packet in pieces grew past `max_bytes`
+			template <typename F>
+			i64 Drain(F&& deliver, std::array<std::vector<u8>, 2>& partials, const size_t max_bytes, const i64 max_records) noexcept {
+				i64 records = 0;
+
+				while (records < max_records) {
+					const u64 tail = header->tail.load(std::memory_order_relaxed);
+
+					if (tail == header->head.load(std::memory_order_acquire)) {
+						return records;
+					}
+
+					const u64 pos = tail % capacity;
+
+					shm_record record;
+					std::memcpy(&record, data + pos, sizeof(record));
+
+					if (record.size == shm_record::wrap) {
+						header->tail.store(tail + (capacity - pos), std::memory_order_release);
+						continue;
+					}
+
+					if (record.size > capacity - pos - sizeof(record) || static_cast<size_t>(record.proto) >= partials.size()) {
+						return -1;
+					}
+
+					const u8* bytes = data + pos + sizeof(record);
+
+					std::vector<u8>& partial = partials[static_cast<size_t>(record.proto)];
+
+					if (record.more || not partial.empty()) {
+						if (record.size > max_bytes - std::min(partial.size(), max_bytes)) {
+							return -1;
+						}
+
+						partial.insert(partial.end(), bytes, bytes + record.size);
+
+						if (not record.more) {
+							deliver(record.proto, const_buf{ partial.data(), partial.size() });
+							partial.clear();
+						}
+					}
+					else {
+						deliver(record.proto, const_buf{ bytes, record.size });
+					}
+
+					header->tail.store(tail + shm_record_bytes(record.size), std::memory_order_release);
+
+					records++;
+				}
+
+				return records;
+			}
+
+			bool empty() const noexcept {
+				return header->tail.load(std::memory_order_relaxed) == header->head.load(std::memory_order_acquire);
+			}
+
+			// The reader's, waits for the writer's next Wake(), at most `timeout_ms`
+			void Sleep(const u32 timeout_ms) noexcept {
+				const u32 observed = header->wake.load(std::memory_order_acquire);
+
+				header->sleeping.store(1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with Wake()'s, a record published before it is seen
+
+				if (empty()) {
+					futex_wait(header->wake, observed, timeout_ms);
+				}
+
+				header->sleeping.store(0, std::memory_order_relaxed);
+			}
+
+			// force - wakes the reader even if it doesn't sleep yet
+			void Wake(const bool force = false) noexcept {
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+
+				if (force || header->sleeping.load(std::memory_order_relaxed) != 0) {
+					header->wake.fetch_add(1, std::memory_order_release);
+					futex_wake(header->wake);
+				}
+			}
+
+		private:
+			shm_ring_header* header = nullptr;
+			u8* data = nullptr;
+			u64 capacity = 0;
+		};
+	}
+
+	// A connection between a host and a client on the same machine, in a shared memory segment of a ring per direction.
+	// The client creates it and offers its name over TCP, the host maps it and unlinks the name (see `shm_config`).
+	// A packet is a record of its fixed header and body, as the sockets would send it with `framing::fixed`.
+	//
+	// * Write() from a socket's writer thread, TryWrite() from its io thread, the writes are serialized.
+	//   The peer's packets are read on a thread of the link's own
+	// * Start() once, Stop() from any thread
+	class ShmLink {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		ShmLink() noexcept {}
+
+		ShmLink(ShmLink const&) = delete;
+		ShmLink& operator=(ShmLink const&) = delete;
+
+		~ShmLink() noexcept {
+			Stop();
+
+			if (reader.joinable()) { reader.detach(); } // destroyed by its own reader
+
+			Unlink(); // an offer the host never took
+			Unmap();
+		}
+
+		// Client side, creates the segment with two rings of at least `ring_bytes`
+		std::error_code Create(const size_t ring_bytes, const u32 full_timeout_ms) noexcept {
+#ifdef _WIN32
+			return std::make_error_code(std::errc::not_supported);
+#else
+			static std::atomic<u32> created{ 0 };
+
+			std::snprintf(segment_name.data(), segment_name.size(), "/hcnet-%ld-%u", static_cast<long>(::getpid()), created.fetch_add(1));
+
+			const size_t ring = std::max<size_t>((ring_bytes + detail::cache_line - 1) & ~(detail::cache_line - 1), 4096);
+			const size_t size = detail::shm_rings_offset + 2 * ring;
+
+			const int fd = ::shm_open(segment_name.data(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+			if (fd < 0) {
+				return detail::last_system_error();
+			}
+
+			named = true;
+
+			std::error_code ec;
+
+			if (::ftruncate(fd, static_cast<off_t>(size)) != 0) { // zero filled, every index starts at 0
+				ec = detail::last_system_error();
+			}
+			else {
+				ec = Map(fd, size);
+			}
+
+			::close(fd);
+
+			if (ec) {
+				Unlink();
+				return ec;
+			}
+
+			new (view) detail::shm_segment_header{ detail::shm_segment_header::expected_magic, detail::shm_segment_header::current_version, 0, ring };
+
+			Attach(true, ring, full_timeout_ms);
+
+			return {};
+#endif
+		}
+
+		// Host side, maps the segment a client offered and unlinks its name, no one else can open it anymore
+		std::error_code Open(std::string_view name, const u32 full_timeout_ms) noexcept {
+#ifdef _WIN32
+			return std::make_error_code(std::errc::not_supported);
+#else
+			if (name.empty() || name.size() >= segment_name.size() || name.find('/', 1) != std::string_view::npos) {
+				return std::make_error_code(std::errc::invalid_argument);
+			}
+
+			std::memcpy(segment_name.data(), name.data(), name.size());
+			segment_name[name.size()] = '\0';
+
+			const int fd = ::shm_open(segment_name.data(), O_RDWR, 0);
+
+			if (fd < 0) {
+				return detail::last_system_error();
+			}
+
+			named = true;
+
+			std::error_code ec;
+			struct stat st;
+
+			if (::fstat(fd, &st) != 0) {
+				ec = detail::last_system_error();
+			}
+			else if (static_cast<size_t>(st.st_size) < detail::shm_rings_offset) {
+				ec = std::make_error_code(std::errc::invalid_argument);
+			}
+			else {
+				ec = Map(fd, static_cast<size_t>(st.st_size));
+			}
+
+			::close(fd);
+
+			Unlink();
+
+			if (ec) {
+				return ec;
+			}
+
+			detail::shm_segment_header header;
+			std::memcpy(&header, view, sizeof(header));
+
+			if (header.magic != detail::shm_segment_header::expected_magic || header.version != detail::shm_segment_header::current_version
+				|| header.ring_bytes % detail::cache_line != 0 || detail::shm_rings_offset + 2 * header.ring_bytes != mapped_size) {
+				Unmap();
+				return std::make_error_code(std::errc::invalid_argument);
+			}
+
+			Attach(false, header.ring_bytes, full_timeout_ms);
+
+			return {};
+#endif
+		}
+
+		// Removes the segment's name, it lives on until both sides unmapped it
+		void Unlink() noexcept {
+#ifndef _WIN32
+			if (named) {
+				::shm_unlink(segment_name.data());
+				named = false;
+			}
+#endif
+		}
+
+		// Starts reading the peer's ring, `deliver(protocol, const_buf packet)` on the reader thread for every packet,
+		// the buffer is valid until it returns. `malformed()` on the reader thread if the peer wrote a malformed record,
+		// or a packet in pieces larger than `max_message_bytes`, the reader stops there.
+		// spin_us - how long the reader spins on an empty ring before it sleeps
+		template <typename F, typename G>
+		void Start(thread_config const& threads, const u32 spin_us, const size_t max_message_bytes, F&& deliver, G&& malformed) noexcept {
+			if (view == nullptr || reader.joinable()) {
+				return;
+			}
+
+			reader = spawn_thread(threads, thread_role::shm, "hcnet-shm",
+				[this, spin = std::chrono::microseconds(spin_us), max_message_bytes, deliver = std::forward<F>(deliver), malformed = std::forward<G>(malformed)]() mutable {
+					std::array<std::vector<u8>, 2> partials; // per protocol
+					clock::time_point last_read = clock::now();
+
+					while (not stopping.load(std::memory_order_acquire)) {
+						const i64 records = in.Drain(deliver, partials, max_message_bytes, 1024); // then checks `stopping`
+
+						if (records < 0) {
+							malformed();
+							break;
+						}
+
+						if (records != 0) {
+							last_read = clock::now();
+						}
+						else if (clock::now() - last_read < spin) {
+							std::this_thread::yield(); // the writer may share the core
+						}
+						else {
+							in.Sleep(100);
+						}
+					}
+				});
+		}
+
+		// Copies a packet's buffers into the peer's ring, waits for room.
+		// - Returns false if the ring stayed full for `shm_config::full_timeout_ms`, or the link stopped
+		bool Write(const protocol proto, std::vector<const_buf> const& bufs) noexcept {
+			std::lock_guard lock{ write_mutex };
+
+			size_t offset = 0;
+
+			return out.Write(proto, bufs, offset, clock::now() + full_timeout, stopping);
+		}
+
+		// Write() without waiting, a packet of one record is written whole or not at all, one in pieces as far as the
+		// ring has room. Call again with the same packet and `offset` until it returns true, before any other of `proto`.
+		// - Returns true once the packet is written whole
+		bool TryWrite(const protocol proto, std::vector<const_buf> const& bufs, size_t& offset) noexcept {
+			std::lock_guard lock{ write_mutex };
+
+			return out.Write(proto, bufs, offset, clock::time_point::min(), stopping);
+		}
+
+		// how long a writer may find the ring full, see `shm_config::full_timeout_ms`
+		constexpr clock::duration write_timeout() const noexcept {
+			return full_timeout;
+		}
+
+		// Stops reading and writing, a blocked writer gives up. Joins the reader unless it's the caller,
+		// it delivers nothing after this
+		void Stop() noexcept {
+			if (not stopping.exchange(true) && view != nullptr) {
+				in.Wake(true);
+			}
+
+			if (reader.joinable() && reader.get_id() != std::this_thread::get_id()) {
+				reader.join();
+			}
+		}
+
+		constexpr std::string_view name() const noexcept {
+			return segment_name.data();
+		}
+
+	private:
+#ifndef _WIN32
+		std::error_code Map(const int fd, const size_t size) noexcept {
+			void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+			if (addr == MAP_FAILED) {
+				return detail::last_system_error();
+			}
+
+			view = addr;
+			mapped_size = size;
+
+			return {};
+		}
+#endif
+
+		void Unmap() noexcept {
+#ifndef _WIN32
+			if (view != nullptr) { ::munmap(view, mapped_size); }
+#endif
+			view = nullptr;
+			mapped_size = 0;
+		}
+
+		// the client writes the first ring and reads the second, the host the other way around
+		void Attach(const bool client, const u64 ring, const u32 full_timeout_ms) noexcept {
+			u8* base = static_cast<u8*>(view);
+
+			auto* client_to_host = reinterpret_cast<detail::shm_ring_header*>(base + detail::cache_line);
+			auto* host_to_client = client_to_host + 1;
+
+			detail::shm_ring up(client_to_host, base + detail::shm_rings_offset, ring);
+			detail::shm_ring down(host_to_client, base + detail::shm_rings_offset + ring, ring);
+
+			out = client ? up : down;
+			in = client ? down : up;
+
+			full_timeout = std::chrono::milliseconds(full_timeout_ms);
+		}
+
+	private:
+		std::array<char, shm_name_max> segment_name{};
+		bool named = false; // the name is ours to unlink
+
+		void* view = nullptr;
+		size_t mapped_size = 0;
+
+		detail::shm_ring out;
+		detail::shm_ring in;
+
+		std::mutex write_mutex;
+		clock::duration full_timeout{};
+
+		std::atomic<bool> stopping{ false };
+
+		std::thread reader;
+	};
+}
\ No newline at end of file
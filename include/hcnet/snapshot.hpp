@@ -0,0 +1,162 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+namespace net {
+
+	// An immutable version of a `JoinSnapshot`, shared by every packet that sends it
+	struct snapshot_blob {
+		u64 version = 0;
+		std::vector<u8> bytes;
+	};
+
+	// Sends a `snapshot_blob` by reference, the receiving side reads it as its own message type
+	template <auto Identifier>
+	struct snapshot_ref {
+		snapshot_ref(std::shared_ptr<const snapshot_blob> blob) noexcept : blob(std::move(blob)) {}
+
+		std::shared_ptr<const snapshot_blob> blob;
+	};
+
+	template <auto Identifier>
+	struct vectorize_msg<snapshot_ref<Identifier>> {
+
+		static constexpr auto identifier = Identifier;
+
+		template <bool IncludeHeaderBuf, typename Buf>
+		static std::vector<Buf> vectorize(snapshot_ref<Identifier> const& obj) noexcept {
+			return build_custom_buf_seq<IncludeHeaderBuf, Buf>(
+				Buf((void*)obj.blob->bytes.data(), obj.blob->bytes.size())
+			);
+		}
+	};
+
+	// Serialized session state for joining wires (`Wire::allowed::hinfo`), patched on join / leave
+	// instead of being re-serialized for every joiner.
+	//
+	// The blob is a `Preamble` followed by the entries, in the order they were inserted.
+	// An entry is whatever the application serialized for an id (a client's info).
+	//
+	// * thread safe
+	// * `current()` hands out the blob by reference, a patch copies it only while an older version is still being sent
+	template <typename Preamble>
+		requires std::is_trivially_copyable_v<Preamble>
+	class JoinSnapshot {
+	public:
+
+		JoinSnapshot(Preamble const& preamble = {}) noexcept :
+			blob(std::make_shared<snapshot_blob>())
+		{
+			blob->bytes.resize(sizeof(Preamble));
+			std::memcpy(blob->bytes.data(), &preamble, sizeof(Preamble));
+		}
+
+		void set_preamble(Preamble const& preamble) noexcept {
+			std::scoped_lock lock{ mutex };
+
+			std::memcpy(Mutable().bytes.data(), &preamble, sizeof(Preamble));
+		}
+
+		Preamble preamble() const noexcept {
+			std::scoped_lock lock{ mutex };
+
+			Preamble p;
+			std::memcpy(&p, blob->bytes.data(), sizeof(Preamble));
+
+			return p;
+		}
+
+		// Inserts or replaces the entry of `id`, `parts` are concatenated
+		void upsert(const i16 id, std::initializer_list<const_buf> parts) noexcept {
+			std::scoped_lock lock{ mutex };
+
+			snapshot_blob& b = Mutable();
+
+			Erase(b, id);
+
+			const size_t offset = b.bytes.size();
+			const size_t size = asio::buffer_size(parts);
+
+			b.bytes.resize(offset + size);
+			asio::buffer_copy(mut_buf{ b.bytes.data() + offset, size }, parts);
+
+			index.push_back({ id, static_cast<u32>(offset), static_cast<u32>(size) });
+		}
+
+		void erase(const i16 id) noexcept {
+			std::scoped_lock lock{ mutex };
+
+			if (std::ranges::find(index, id, &entry::id) != index.end()) {
+				Erase(Mutable(), id);
+			}
+		}
+
+		std::shared_ptr<const snapshot_blob> current() const noexcept {
+			std::scoped_lock lock{ mutex };
+			return blob;
+		}
+
+		u64 version() const noexcept {
+			std::scoped_lock lock{ mutex };
+			return blob->version;
+		}
+
+		size_t entries() const noexcept {
+			std::scoped_lock lock{ mutex };
+			return index.size();
+		}
+
+		// The current version as a message, ready to be sent as hinfo
+		template <auto Identifier>
+		gef::unique_ref<msg<snapshot_ref<Identifier>>> make_msg() const noexcept {
+			return gef::unique_ref<msg<snapshot_ref<Identifier>>>::make( current() );
+		}
+
+	private:
+
+		struct entry {
+			i16 id;
+			u32 offset;
+			u32 size;
+		};
+
+		// the blob to patch, copied if any packet still holds the current version
+		snapshot_blob& Mutable() noexcept {
+			if (blob.use_count() > 1) {
+				blob = std::make_shared<snapshot_blob>(*blob);
+			}
+
+			blob->version++;
+
+			return *blob;
+		}
+
+		void Erase(snapshot_blob& b, const i16 id) noexcept {
+			auto it = std::ranges::find(index, id, &entry::id);
+
+			if (it == index.end()) {
+				return;
+			}
+
+			const entry removed = *it;
+
+			b.bytes.erase(b.bytes.begin() + removed.offset, b.bytes.begin() + removed.offset + removed.size);
+
+			it = index.erase(it);
+
+			for (; it != index.end(); ++it) {
+				it->offset -= removed.size;
+			}
+		}
+
+	private:
+		mutable std::mutex mutex;
+
+		std::shared_ptr<snapshot_blob> blob;
+		std::vector<entry> index;
+	};
+}
\ No newline at end of file
@@ -1,10 +1,172 @@
 #pragma once
 
 #include "canyon.hpp"
-#include "readerwriterqueue/readerwriterqueue.h"
+#include "send_queue.hpp"
+#include "capture.hpp"
+#include "framing.hpp"
+#include "thread.hpp"
+#include "shm.hpp"
+#include "file_stream.hpp"
+#include <array>
+#include <cstring>
 
 namespace net {
 
+	namespace detail {
+		// The `len` bytes of `bufs` that start at `offset`
+		inline std::vector<const_buf> slice_buf_seq(std::vector<const_buf> const& bufs, size_t offset, size_t len) noexcept {
+			std::vector<const_buf> slice;
+
+			for (const_buf const& b : bufs) {
+				if (len == 0) {
+					break;
+				}
+
+				if (offset >= b.size()) {
+					offset -= b.size();
+					continue;
+				}
+
+				const size_t take = std::min(b.size() - offset, len);
+
+				slice.emplace_back(static_cast<const u8*>(b.data()) + offset, take);
+
+				offset = 0;
+				len -= take;
+			}
+
+			return slice;
+		}
+
+		// The largest UDP datagram, a socket's receive buffer grows up to it
+		inline constexpr size_t datagram_max = 64 * 1024;
+
+		// Linux reports a datagram's whole size when it didn't fit the receive buffer, elsewhere it's cut to the buffer
+#ifdef __linux__
+		inline constexpr asio::socket_base::message_flags receive_truncated = MSG_TRUNC;
+#else
+		inline constexpr asio::socket_base::message_flags receive_truncated = 0;
+#endif
+
+		// The most `send_queue_limits::linearize_bytes` can be, the size of every socket's inline buffer
+		inline constexpr size_t linearize_bytes_max = 2048;
+
+		using linear_buf = std::array<u8, linearize_bytes_max>;
+
+		// Copies a framed packet of a few buffers, and at most `threshold` bytes, into `out`,
+		// so it's written as one buffer instead of gathered
+		inline void linearize(std::vector<const_buf>& bufs, linear_buf& out, const size_t threshold) noexcept {
+			if (bufs.size() < 2) {
+				return;
+			}
+
+			const size_t size = asio::buffer_size(bufs);
+
+			if (size > threshold) {
+				return;
+			}
+
+			asio::buffer_copy(asio::buffer(out), bufs);
+
+			bufs.resize(1);
+			bufs[0] = const_buf{ out.data(), size };
+		}
+
+		// The next entry for a socket that writes from its io threads, `scheduled` is owned by whoever holds it set.
+		// - Returns false, and clears `scheduled`, when there's nothing to write
+		// - relieved - see `SendQueue::Pop`, set either way
+		template <typename Queue, typename Entry>
+		bool try_pop_scheduled(Queue& queue, Entry& e, std::atomic<bool>& scheduled, std::atomic<bool> const& alive, bool& relieved) noexcept {
+			relieved = false;
+
+			for (;;) {
+				if (not alive) {
+					scheduled = false;
+					return false;
+				}
+
+				bool dropped_relief = false;
+				const bool popped = queue.TryPop(e, dropped_relief);
+
+				relieved |= dropped_relief;
+
+				if (popped) {
+					return true;
+				}
+
+				scheduled = false;
+
+				// a packet queued before the flag was cleared didn't schedule a write, take it back
+				if (queue.packets() == 0 || scheduled.exchange(true)) {
+					return false;
+				}
+			}
+		}
+
+		// A socket's writes into its shared memory link from the io thread (`io_writes`), which never waits for the reader.
+		// A packet the full ring doesn't take is retried from a timer, from where the ring stopped taking it
+		class shm_io_writer {
+		public:
+			using clock = std::chrono::steady_clock;
+
+			enum class result : i8 {
+				written,
+				full,     // `retry()` runs on the io thread in a moment, to write the same packet again
+				timed_out // full for longer than `shm_config::full_timeout_ms`
+			};
+
+			explicit shm_io_writer(asio::io_context& ctx) noexcept :
+				retry_timer(ctx)
+			{}
+
+			template <typename F>
+			result Write(ShmLink& link, const protocol proto, std::vector<const_buf> const& bufs, F&& retry) noexcept {
+				if (link.TryWrite(proto, bufs, offset)) {
+					Reset();
+					return result::written;
+				}
+
+				const clock::time_point now = clock::now();
+
+				if (not full) {
+					full = true;
+					full_since = now;
+				}
+				else if (now - full_since >= link.write_timeout()) {
+					Reset();
+					return result::timed_out;
+				}
+
+				retry_timer.expires_after(std::chrono::microseconds(50));
+				retry_timer.async_wait(
+					[retry = std::forward<F>(retry)](asio::error_code ec) mutable {
+						if (not ec) {
+							retry();
+						}
+					});
+
+				return result::full;
+			}
+
+			// a packet waits for room in the ring
+			constexpr bool waiting() const noexcept {
+				return full;
+			}
+
+			void Reset() noexcept {
+				offset = 0;
+				full = false;
+			}
+
+		private:
+			asio::steady_timer retry_timer;
+
+			size_t offset = 0; // of the packet, what the ring took
+			bool full = false;
+			clock::time_point full_since{};
+		};
+	}
+
 	// Manager      - class that owns (and manages) the socket
 	// PacketHolder - the class that manages out-going packets lifetime
 	template <typename Manager, template<typename T> class PacketHolder, typename HeaderOut, typename HeaderIn>
@@ -14,68 +176,246 @@ namespace net {
 		using PacketOut = packet_tcp<HeaderOut>;
 		using PacketIn = packet_tcp<HeaderIn>;
 
+		using push_result = SendQueue<PacketHolder<PacketOut>>::push_result;
+		using entry = SendQueue<PacketHolder<PacketOut>>::entry;
+
 		// unbound socket, needs to be bounded
-		SocketTCP(Manager& manager, asio::io_context& ctx) noexcept :
+		// io_writes - writes from `ctx`'s threads, instead of a writer thread of its own
+		SocketTCP(Manager& manager, asio::io_context& ctx, send_queue_limits const& limits, const bool io_writes = false) noexcept :
 			manager(manager),
 			global_ctx(ctx),
+			out_queue(limits, true),
+			bulk_slice_bytes(limits.bulk_slice_bytes),
+			linearize_bytes(std::min<size_t>(limits.linearize_bytes, detail::linearize_bytes_max)),
+			io_writes(io_writes),
+			shm_io(ctx),
 			socket(ctx)
 		{}
 
 		// bind the socket to a specific port and address, that is specified in the moved asio socket
-		SocketTCP(Manager& manager, asio::io_context& ctx, tcp::socket&& s) noexcept :
+		SocketTCP(Manager& manager, asio::io_context& ctx, tcp::socket&& s, send_queue_limits const& limits, const bool io_writes = false) noexcept :
 			manager(manager),
 			global_ctx(ctx),
+			out_queue(limits, true),
+			bulk_slice_bytes(limits.bulk_slice_bytes),
+			linearize_bytes(std::min<size_t>(limits.linearize_bytes, detail::linearize_bytes_max)),
+			io_writes(io_writes),
+			shm_io(ctx),
 			socket(std::move(s))
 		{}
 
 		~SocketTCP() noexcept {
-			out_queue.emplace(PacketHolder<PacketOut>{ nullptr }); // 'Wake up' the wait_dequeue()
+			out_queue.Stop(); // 'Wake up' the writer
+		}
+
+		// Moves the socket to the context it was created with, so its handlers run there.
+		// A socket that was accepted on another context (see `accept_config::threads`) is rehomed once its handshake is done
+		asio::error_code Rehome() noexcept {
+			asio::error_code ec;
+
+			if (&asio::query(socket.get_executor(), asio::execution::context) == &global_ctx) {
+				return ec;
+			}
+
+			const tcp protocol = socket.local_endpoint(ec).protocol();
+
+			if (ec) {
+				return ec;
+			}
+
+			const auto handle = socket.release(ec);
+
+			if (ec) {
+				return ec;
+			}
+
+			tcp::socket rehomed(global_ctx);
+
+			rehomed.assign(protocol, handle, ec);
+
+			socket = std::move(rehomed);
+
+			return ec;
+		}
+
+		// Call before Start(), the handshake is always `framing::fixed`.
+		// implied_from - the `from_id` a compact header leaves out, the host's id
+		constexpr void UseFraming(const framing f, const i16 implied_from) noexcept {
+			header_framing = f;
+			this->implied_from = implied_from;
 		}
 
 		constexpr void Start() noexcept {
 			ReadHeader();
 
-			std::thread{ &SocketTCP::Write, this }.detach();
+			if (not io_writes) {
+				spawn_thread(manager.threads(), thread_role::writer, "hcnet-wr-tcp", [this]() { Write(); }).detach();
+			}
 		}
 
-		constexpr void Send(PacketHolder<PacketOut> p) noexcept {
-			out_queue.emplace(std::move(p));
+		void Send(PacketHolder<PacketOut> p) noexcept {
+			// only the writer thread sends a file chunk from the file, the other paths take its data from memory
+			const bool file_chunk = p->h.msg_type == control_msg::file_chunk;
+
+			if (file_chunk && (io_writes || not sendfile_supported) && not LoadChunk(*p)) {
+				return;
+			}
+
+			switch (out_queue.Push(std::move(p), manager.connected, MayBlock())) {
+			case push_result::queued:
+				ScheduleWrite();
+				break;
+			case push_result::queued_congested:
+				manager.QueuePressure(protocol::tcp, true);
+				ScheduleWrite();
+				break;
+			case push_result::overflow:
+				asio::post(global_ctx,
+					[this]() {
+						manager.Close({ net_error::slow_consumer, gef::nullopt });
+					});
+				break;
+			default:
+				break;
+			}
+		}
+
+		constexpr SendQueue<PacketHolder<PacketOut>> const& queue() const noexcept {
+			return out_queue;
+		}
+
+		// The writer writes into `link` from now on instead of the socket, the packets still queued included,
+		// nullptr goes back to the socket (see `shm_config`). A `control_msg::shm_switch` always goes through the socket,
+		// the peer reads the link once it got it
+		void UseShm(ShmLink* link) noexcept {
+			shm.store(link, std::memory_order_release);
+		}
+
+		// A packet the peer wrote into the shared memory link, its fixed header and body, on the link's reader thread.
+		// It's handed over on the io thread, as if read from the socket
+		void DeliverShm(const const_buf packet) noexcept {
+			if (packet.size() < HeaderIn::header_size) {
+				return;
+			}
+
+			auto p = gef::unique_ref<PacketIn>::make();
+
+			std::memcpy(&p->h, packet.data(), HeaderIn::header_size);
+
+			const const_buf body = packet + HeaderIn::header_size;
+
+			if (body.size() != p->h.size) {
+				asio::post(global_ctx, [this]() { manager.Close({ net_error::unknown_msg_type, gef::nullopt }); });
+				return;
+			}
+
+			if (p->h.size != 0) {
+				const bool built = p->m.replace(manager.builder_TCP(p->h))
+					.map_or_else(
+						[&](gef::unique_ref<any_msg>& m) {
+							asio::buffer_copy(m->mut_buf_seq(), body);
+							return true;
+						},
+						[&]() {
+							return false;
+						});
+
+				if (not built) {
+					asio::post(global_ctx, [this]() { manager.Close({ net_error::unknown_msg_type, gef::nullopt }); });
+					return;
+				}
+			}
+
+			if (auto capture = manager.capture()) {
+				CaptureIn(*capture, *p);
+			}
+
+			asio::post(global_ctx, [this, p = std::move(p)]() mutable { manager.NewPacketTCP(std::move(p)); });
 		}
 
 	private:
 
 		void ReadHeader() noexcept {
 
+			if (header_framing == framing::compact) {
+				ReadCompactHeader();
+				return;
+			}
+
 			auto p = gef::unique_ref<PacketIn>::make();
 
 			auto buf = header_to<mut_buf>(p->h);
 
-			socket.async_receive(buf,
+			asio::async_read(socket, buf,
 				[this, p = std::move(p)](asio::error_code ec, size_t) mutable {
 					if (ec) {
 						manager.Close({ net_error::failed_to_read, ec });
 						return;
 					}
 
-					if (p->h.size == 0) {
-						ContinueAndNotify(std::move(p));
+					HeaderRead(std::move(p));
+				});
+		}
+
+		// The shortest header first, its first byte tells whether there's more of it
+		void ReadCompactHeader() noexcept {
+
+			asio::async_read(socket, mut_buf{ compact_in.data(), detail::compact_tcp_header_min },
+				[this](asio::error_code ec, size_t) {
+					if (ec) {
+						manager.Close({ net_error::failed_to_read, ec });
+						return;
 					}
-					else {
-						p->m.replace(manager.builder_TCP(p->h))
-							.map_or_else(
-								[&](gef::unique_ref<any_msg>& m) {
-									ReadBody(std::move(p), m.get());
-								},
-								[&]() {
-									manager.Close({ net_error::unknown_msg_type, gef::nullopt });
-								});
+
+					const size_t rest = detail::compact_tcp_header_size(compact_in[0]) - detail::compact_tcp_header_min;
+
+					if (rest == 0) {
+						CompactHeaderRead();
+						return;
 					}
+
+					asio::async_read(socket, mut_buf{ compact_in.data() + detail::compact_tcp_header_min, rest },
+						[this](asio::error_code ec, size_t) {
+							if (ec) {
+								manager.Close({ net_error::failed_to_read, ec });
+								return;
+							}
+
+							CompactHeaderRead();
+						});
 				});
 		}
 
+		void CompactHeaderRead() noexcept {
+			auto p = gef::unique_ref<PacketIn>::make();
+
+			detail::decode_compact_tcp(compact_in.data(), p->h, implied_from);
+
+			HeaderRead(std::move(p));
+		}
+
+		void HeaderRead(gef::unique_ref<PacketIn>&& p) noexcept {
+			if (p->h.msg_type == control_msg::fragment) {
+				ReadFragment(p->h.size);
+			}
+			else if (p->h.size == 0) {
+				ContinueAndNotify(std::move(p));
+			}
+			else {
+				p->m.replace(manager.builder_TCP(p->h))
+					.map_or_else(
+						[&](gef::unique_ref<any_msg>& m) {
+							ReadBody(std::move(p), m.get());
+						},
+						[&]() {
+							manager.Close({ net_error::unknown_msg_type, gef::nullopt });
+						});
+			}
+		}
+
 		void ReadBody(gef::unique_ref<PacketIn> p, any_msg& m) noexcept {
 
-			socket.async_receive(m.mut_buf_seq(),
+			asio::async_read(socket, m.mut_buf_seq(),
 				[this, p = std::move(p)](asio::error_code ec, size_t) mutable {
 					if (ec) {
 						manager.Close({ net_error::failed_to_read, ec });
@@ -86,38 +426,477 @@ namespace net {
 				});
 		}
 
+		// Appends a slice of a bulk packet, the packet is built and notified once its last slice arrives.
+		// The peer decides how many slices there are, the packet can't grow past `max_message_bytes`
+		void ReadFragment(const u32 size) noexcept {
+			const size_t offset = fragments.size();
+
+			if (offset + size > manager.max_message_bytes()) {
+				manager.Close({ net_error::message_too_large, gef::nullopt });
+				return;
+			}
+
+			fragments.resize(offset + size);
+
+			asio::async_read(socket, mut_buf{ fragments.data() + offset, size },
+				[this](asio::error_code ec, size_t) {
+					if (ec) {
+						manager.Close({ net_error::failed_to_read, ec });
+						return;
+					}
+
+					if (fragments.size() < HeaderIn::header_size) {
+						ReadHeader();
+						return;
+					}
+
+					auto p = gef::unique_ref<PacketIn>::make();
+
+					asio::buffer_copy(header_to<mut_buf>(p->h), const_buf{ fragments.data(), HeaderIn::header_size });
+
+					const size_t body_size = fragments.size() - HeaderIn::header_size;
+
+					if (body_size < p->h.size) {
+						ReadHeader();
+						return;
+					}
+
+					p->m.replace(manager.builder_TCP(p->h))
+						.map_or_else(
+							[&](gef::unique_ref<any_msg>& m) {
+								asio::buffer_copy(m->mut_buf_seq(), const_buf{ fragments.data() + HeaderIn::header_size, body_size });
+
+								fragments.clear();
+
+								ContinueAndNotify(std::move(p));
+							},
+							[&]() {
+								manager.Close({ net_error::unknown_msg_type, gef::nullopt });
+							});
+				});
+		}
+
+		// Sends one packet at a time, a packet leaves the queue only when it's fully written,
+		// so the queue limits account for everything that wasn't sent yet
 		void Write() noexcept {
-			PacketHolder<PacketOut> p{ nullptr };
+			entry e;
+			bool relieved = false; // a reliable queue drops nothing, see `SendQueue::Pop`
+
+			while (not writer_stopped && out_queue.Pop(e, relieved)) {
+
+				if (not manager.connected) {
+					break;
+				}
 
-			out_queue.wait_dequeue(p);
+				const bool file_chunk = e.p->h.msg_type == control_msg::file_chunk;
 
-			if (not manager.connected) {
+				if (auto capture = manager.capture(); capture && not file_chunk) {
+					capture->Record(manager.capture_id(), protocol::tcp, capture_direction::out, e.bufs);
+				}
+
+				if (ShmLink* link = shm.load(std::memory_order_acquire); link && e.p->h.msg_type != control_msg::shm_switch) {
+					WriteShm(*link, e);
+					continue;
+				}
+
+				asio::error_code ec =
+					file_chunk ? WriteFileChunk(e)
+					: e.priority == lane::bulk && bulk_slice_bytes != 0 && e.bytes > bulk_slice_bytes
+					? WriteSliced(e)
+					: WriteWhole(e);
+
+				if (ec) {
+					asio::post(global_ctx,
+						[this, ec]() mutable {
+							manager.Close({ net_error::failed_to_write, ec });
+						});
+					break;
+				}
+			}
+
+			out_queue.Wake();
+		}
+
+		void ScheduleWrite() noexcept {
+			if (io_writes && not write_scheduled.exchange(true)) {
+				asio::post(global_ctx, [this]() { WriteNext(); });
+			}
+		}
+
+		// io_writes - one asynchronous write at a time. A bulk packet goes out in slices as from the writer thread,
+		// with the higher lanes' packets in between
+		void WriteNext() noexcept {
+			if (io_offset != 0) { // between two slices of `io_entry`
+				if (out_queue.TryPopAbove(lane::bulk, io_urgent)) {
+					if (not io_urgent.bufs.empty()) { // else the Stop() sentinel
+						WriteAsync(io_urgent);
+					}
+
+					return;
+				}
+
+				WriteSliceAsync();
 				return;
 			}
 
-			auto bufs = p->const_buf_seq();
+			if (shm_io.waiting() && not WriteShmAsync()) {
+				return;
+			}
 
-			socket.async_send(bufs,
-				[this, p = std::move(p)](asio::error_code ec, size_t) {
-					if (ec) {
-						manager.Close({ net_error::failed_to_write, ec });
+			for (;;) {
+				bool relieved = false;
+				const bool popped = detail::try_pop_scheduled(out_queue, io_entry, write_scheduled, manager.connected, relieved);
+
+				if (relieved) {
+					manager.QueuePressure(protocol::tcp, false);
+				}
+
+				if (not popped) {
+					return;
+				}
+
+				if (auto capture = manager.capture()) {
+					capture->Record(manager.capture_id(), protocol::tcp, capture_direction::out, io_entry.bufs);
+				}
+
+				if (shm.load(std::memory_order_acquire) != nullptr && io_entry.p->h.msg_type != control_msg::shm_switch) {
+					if (not WriteShmAsync()) {
 						return;
 					}
+
+					continue;
+				}
+
+				if (io_entry.priority == lane::bulk && bulk_slice_bytes != 0 && io_entry.bytes > bulk_slice_bytes
+					&& io_entry.p->h.msg_type != control_msg::file_chunk)
+				{
+					WriteSliceAsync();
+					return;
+				}
+
+				WriteAsync(io_entry);
+				return;
+			}
+		}
+
+		// io_writes, `io_entry` into the shared memory ring, see `detail::shm_io_writer`.
+		// - Returns false while the ring is full, WriteNext() runs again from the retry
+		bool WriteShmAsync() noexcept {
+			using result = detail::shm_io_writer::result;
+
+			ShmLink* link = shm.load(std::memory_order_acquire);
+
+			const result written = link != nullptr && manager.connected
+				? shm_io.Write(*link, protocol::tcp, io_entry.bufs, [this]() { WriteNext(); })
+				: result::timed_out; // the connection closed, what's left of the packet is dropped
+
+			if (written == result::full) {
+				return false;
+			}
+
+			if (out_queue.Release(io_entry.bytes)) {
+				manager.QueuePressure(protocol::tcp, false);
+			}
+
+			io_entry = entry{};
+
+			if (written == result::timed_out) {
+				shm_io.Reset();
+				write_scheduled = false;
+
+				if (manager.connected) {
+					manager.Close({ net_error::slow_consumer, gef::nullopt });
+				}
+
+				return false;
+			}
+
+			return true;
+		}
+
+		// io_writes, a whole packet
+		void WriteAsync(entry& e) noexcept {
+			e.bufs[0] = FrameHeader(e.p->h);
+			detail::linearize(e.bufs, linear, linearize_bytes);
+
+			asio::async_write(socket, e.bufs,
+				[this, &e](asio::error_code ec, size_t) {
+					if (out_queue.Release(e.bytes)) {
+						manager.QueuePressure(protocol::tcp, false);
+					}
+
+					e = entry{};
+
+					WrittenAsync(ec);
 				});
+		}
+
+		// io_writes, the next slice of the bulk packet in `io_entry`, see WriteSliced()
+		void WriteSliceAsync() noexcept {
+			const size_t len = std::min(bulk_slice_bytes, io_entry.bytes - io_offset);
+
+			io_slice_header.msg_type = control_msg::fragment;
+			io_slice_header.size = static_cast<u32>(len);
+
+			io_slice = detail::slice_buf_seq(io_entry.bufs, io_offset, len);
+			io_slice.insert(io_slice.begin(), FrameHeader(io_slice_header));
+
+			io_offset += len;
 
-			Write();
+			asio::async_write(socket, io_slice,
+				[this](asio::error_code ec, size_t) {
+					if (ec || io_offset == io_entry.bytes) {
+						if (out_queue.Release(io_entry.bytes)) {
+							manager.QueuePressure(protocol::tcp, false);
+						}
+
+						io_entry = entry{};
+						io_offset = 0;
+					}
+
+					WrittenAsync(ec);
+				});
+		}
+
+		void WrittenAsync(asio::error_code ec) noexcept {
+			if (ec) {
+				write_scheduled = false;
+				manager.Close({ net_error::failed_to_write, ec });
+				return;
+			}
+
+			WriteNext();
+		}
+
+		// With io_writes the io thread drains the queue, a send from it can't wait for room
+		bool MayBlock() const noexcept {
+			return not io_writes || not global_ctx.get_executor().running_in_this_thread();
+		}
+
+		asio::error_code WriteWhole(entry& e) noexcept {
+			asio::error_code ec;
+
+			e.bufs[0] = FrameHeader(e.p->h);
+			detail::linearize(e.bufs, linear, linearize_bytes);
+
+			asio::write(socket, e.bufs, ec);
+
+			if (out_queue.Release(e.bytes)) {
+				manager.QueuePressure(protocol::tcp, false);
+			}
+
+			return ec;
+		}
+
+		// Sends a bulk packet as `control_msg::fragment` slices, and whatever the higher lanes hold in between them
+		asio::error_code WriteSliced(entry& bulk) noexcept {
+			asio::error_code ec;
+
+			HeaderOut slice_header{};
+			slice_header.msg_type = control_msg::fragment;
+
+			entry urgent;
+
+			for (size_t offset = 0; offset < bulk.bytes && not ec; offset += bulk_slice_bytes) {
+
+				while (out_queue.TryPopAbove(lane::bulk, urgent)) {
+					if (urgent.bufs.empty()) { // Stop() sentinel
+						writer_stopped = true;
+						return ec;
+					}
+
+					ec = WriteWhole(urgent);
+
+					if (ec) {
+						break;
+					}
+				}
+
+				if (ec) {
+					break;
+				}
+
+				const size_t len = std::min(bulk_slice_bytes, bulk.bytes - offset);
+
+				slice_header.size = static_cast<u32>(len);
+
+				auto bufs = detail::slice_buf_seq(bulk.bufs, offset, len);
+				bufs.insert(bufs.begin(), FrameHeader(slice_header));
+
+				asio::write(socket, bufs, ec);
+			}
+
+			if (out_queue.Release(bulk.bytes)) {
+				manager.QueuePressure(protocol::tcp, false);
+			}
+
+			return ec;
+		}
+
+		// A file chunk is a packet of its own, never sliced: its header and prefix, then its data from the file.
+		// Read into memory first when the capture records it, or the data can't be sent from the file.
+		// A file that got shorter cancels its transfer alone, see FileShrunk()
+		asio::error_code WriteFileChunk(entry& e) noexcept {
+			detail::file_chunk_out& chunk = detail::file_chunk_of(*e.p);
+			const bool captured = static_cast<bool>(manager.capture());
+
+			asio::error_code ec;
+
+			if (chunk.source().has_shrunk()) {
+				ec = asio::error::eof;
+			}
+			else if (captured || not sendfile_supported) {
+				ec = chunk.Load();
+			}
+
+			if (not ec && chunk.loaded()) {
+				e.bufs = e.p->const_buf_seq(); // queued before its data was in memory
+
+				if (auto capture = manager.capture()) {
+					capture->Record(manager.capture_id(), protocol::tcp, capture_direction::out, e.bufs);
+				}
+
+				return WriteWhole(e);
+			}
+
+			if (not ec) {
+				ec = chunk.SendFromFile(socket, FrameHeader(e.p->h));
+			}
+
+			if (out_queue.Release(e.bytes)) {
+				manager.QueuePressure(protocol::tcp, false);
+			}
+
+			if (ec == asio::error::eof) { // what was written of the chunk is framed whole
+				FileShrunk(chunk);
+				return {};
+			}
+
+			return ec;
+		}
+
+		// The receiver can't tell a chunk's data is missing, a file that can't be read closes the connection.
+		// One that got shorter cancels its transfer alone, the chunk is dropped
+		bool LoadChunk(PacketOut& p) noexcept {
+			detail::file_chunk_out& chunk = detail::file_chunk_of(p);
+
+			std::error_code ec = chunk.source().has_shrunk() ? std::error_code(asio::error::eof) : chunk.Load();
+
+			if (ec == asio::error::eof) {
+				FileShrunk(chunk);
+				return false;
+			}
+
+			if (ec) {
+				asio::post(global_ctx,
+					[this, ec]() mutable {
+						manager.Close({ net_error::failed_to_write, ec });
+					});
+				return false;
+			}
+
+			return true;
+		}
+
+		// The host cancels the transfer once, both sides report it, the connection stays up
+		void FileShrunk(detail::file_chunk_out& chunk) noexcept {
+			if (not chunk.source().MarkShrunk()) {
+				return;
+			}
+
+			if constexpr (requires { manager.FileShrunk(chunk.transfer()); }) {
+				manager.FileShrunk(chunk.transfer());
+			}
+		}
+
+		// Writer thread. The ring takes a packet whole, in pieces of at most half of it, so a bulk one isn't sliced.
+		// A full ring holds the writer, never the producers, their packets wait in the queue meanwhile under its
+		// limits and overflow policy. Full past `shm_config::full_timeout_ms`, the connection is closed
+		void WriteShm(ShmLink& link, entry& e) noexcept {
+			bool loaded = true;
+
+			if (e.p->h.msg_type == control_msg::file_chunk) {
+				loaded = LoadChunk(*e.p);
+
+				if (loaded) {
+					e.bufs = e.p->const_buf_seq(); // queued before its data was in memory
+
+					if (auto capture = manager.capture()) {
+						capture->Record(manager.capture_id(), protocol::tcp, capture_direction::out, e.bufs);
+					}
+				}
+			}
+
+			if (loaded && not link.Write(protocol::tcp, e.bufs) && manager.connected) {
+				asio::post(global_ctx, [this]() { manager.Close({ net_error::slow_consumer, gef::nullopt }); });
+			}
+
+			if (out_queue.Release(e.bytes)) {
+				manager.QueuePressure(protocol::tcp, false);
+			}
+		}
+
+		// The buffer `h` goes on the wire as, the capture records the fixed header whatever the framing.
+		// One header is framed at a time, the compact one lives in `compact_out` until the next
+		const_buf FrameHeader(HeaderOut& h) noexcept {
+			if (header_framing == framing::fixed) {
+				return header_to<const_buf>(h);
+			}
+
+			return { compact_out.data(), detail::encode_compact_tcp(h, implied_from, compact_out.data()) };
 		}
 
 		constexpr void ContinueAndNotify(gef::unique_ref<PacketIn>&& p) noexcept {
+			if (auto capture = manager.capture()) {
+				CaptureIn(*capture, *p);
+			}
+
 			ReadHeader();
 			manager.NewPacketTCP(std::forward<decltype(p)>(p));
 		}
 
+		// a rebuilt bulk packet is recorded whole, not as its slices
+		void CaptureIn(CaptureFile& capture, PacketIn& p) noexcept {
+			p.m.map_or_else(
+				[&](gef::unique_ref<any_msg>& m) {
+					capture.Record(manager.capture_id(), protocol::tcp, capture_direction::in, header_to<const_buf>(p.h), m->mut_buf_seq());
+				},
+				[&]() {
+					capture.Record(manager.capture_id(), protocol::tcp, capture_direction::in, header_to<const_buf>(p.h));
+				});
+		}
+
 	private:
 		Manager& manager;
 		asio::io_context& global_ctx;
 
-		moodycamel::BlockingReaderWriterQueue<PacketHolder<PacketOut>> out_queue;
+		SendQueue<PacketHolder<PacketOut>> out_queue;
+		const size_t bulk_slice_bytes;
+		bool writer_stopped = false;
+
+		// a small packet is copied here, header and body, and written as one buffer. One write at a time uses it
+		const size_t linearize_bytes;
+		alignas(detail::cache_line) detail::linear_buf linear{};
+
+		const bool io_writes;
+		std::atomic<bool> write_scheduled{ false };
+		entry io_entry; // being written, io_writes only
+
+		// io_writes, `io_entry` is a bulk packet sent in slices up to here, a higher lane's `io_urgent` goes between two
+		size_t io_offset = 0;
+		HeaderOut io_slice_header{};
+		std::vector<const_buf> io_slice;
+		entry io_urgent;
+
+		framing header_framing = framing::fixed;
+		i16 implied_from = -1;
+		detail::compact_header compact_in{};
+		detail::compact_header compact_out{};
+
+		std::vector<u8> fragments; // the bulk packet being rebuilt
+
+		std::atomic<ShmLink*> shm{ nullptr }; // see UseShm(), owned by the manager
+		detail::shm_io_writer shm_io;          // io_writes, `io_entry` waits for room in the ring
 	public:
 		tcp::socket socket;
 	};
@@ -131,15 +910,23 @@ namespace net {
 		using PacketOut = packet_udp<HeaderOut>;
 		using PacketIn = packet_udp<HeaderIn>;
 
+		using push_result = SendQueue<PacketHolder<PacketOut>>::push_result;
+		using entry = SendQueue<PacketHolder<PacketOut>>::entry;
+
 		// unbound socket, needs to be bounded
-		SocketUDP(Manager& manager, asio::io_context& ctx) noexcept :
+		// io_writes - writes from `ctx`'s threads, instead of a writer thread of its own
+		SocketUDP(Manager& manager, asio::io_context& ctx, send_queue_limits const& limits, const bool io_writes = false) noexcept :
 			manager(manager),
 			global_ctx(ctx),
+			out_queue(limits, false),
+			linearize_bytes(std::min<size_t>(limits.linearize_bytes, detail::linearize_bytes_max)),
+			io_writes(io_writes),
+			shm_io(ctx),
 			socket(ctx)
 		{}
 
 		~SocketUDP() noexcept {
-			out_queue.emplace(PacketHolder<PacketOut>{ nullptr }); // 'Wake up' the wait_dequeue()
+			out_queue.Stop(); // 'Wake up' the writer
 		}
 
 		constexpr asio::error_code OpenBindConnect(udp::endpoint&& local_endpoint, udp::endpoint&& remote_endpoint) noexcept {
@@ -151,6 +938,15 @@ namespace net {
 				return ec;
 			}
 
+#ifndef _WIN32
+			// on a host, every wire's socket binds the same (listening) port, the connected one gets the datagrams
+			socket.set_option(udp::socket::reuse_address(true), ec);
+
+			if (ec) {
+				return ec;
+			}
+#endif
+
 			socket.bind(local_endpoint, ec);
 
 			if (ec) {
@@ -162,40 +958,140 @@ namespace net {
 			return ec;
 		}
 
+		// Call before Start(), see SocketTCP::UseFraming()
+		constexpr void UseFraming(const framing f, const i16 implied_from) noexcept {
+			header_framing = f;
+			this->implied_from = implied_from;
+		}
+
 		constexpr void Start() noexcept {
 			Read();
 
-			std::thread{ &SocketUDP::Write, this }.detach();
+			if (not io_writes) {
+				spawn_thread(manager.threads(), thread_role::writer, "hcnet-wr-udp", [this]() { Write(); }).detach();
+			}
+		}
+
+		void Send(PacketHolder<PacketOut> p) noexcept {
+			switch (out_queue.Push(std::move(p), manager.connected, MayBlock())) {
+			case push_result::queued:
+				ScheduleWrite();
+				break;
+			case push_result::queued_congested:
+				manager.QueuePressure(protocol::udp, true);
+				ScheduleWrite();
+				break;
+			case push_result::overflow:
+				asio::post(global_ctx,
+					[this]() {
+						manager.Close({ net_error::slow_consumer, gef::nullopt });
+					});
+				break;
+			default:
+				break;
+			}
 		}
 
-		constexpr void Send(PacketHolder<PacketOut> p) noexcept {
-			out_queue.emplace(std::move(p));
+		constexpr SendQueue<PacketHolder<PacketOut>> const& queue() const noexcept {
+			return out_queue;
+		}
+
+		// see SocketTCP::UseShm()
+		void UseShm(ShmLink* link) noexcept {
+			shm.store(link, std::memory_order_release);
+		}
+
+		// A datagram the peer wrote into the shared memory link, on the link's reader thread, see SocketTCP::DeliverShm()
+		void DeliverShm(const const_buf datagram) noexcept {
+			if (datagram.size() < HeaderIn::header_size) {
+				return;
+			}
+
+			if (auto capture = manager.capture()) {
+				capture->Record(manager.capture_id(), protocol::udp, capture_direction::in, datagram);
+			}
+
+			HeaderIn h;
+			std::memcpy(&h, datagram.data(), HeaderIn::header_size);
+
+			if (h.msg_type < 0) {
+				const u8* bytes = static_cast<const u8*>(datagram.data());
+
+				asio::post(global_ctx,
+					[this, copy = std::vector<u8>(bytes, bytes + datagram.size())]() {
+						manager.ControlUDP(const_buf{ copy.data(), copy.size() });
+					});
+				return;
+			}
+
+			auto p = gef::unique_ref<PacketIn>::make( std::move(manager.builder_UDP(datagram.size())) );
+
+			asio::buffer_copy(p->mut_buf_seq(), datagram);
+
+			asio::post(global_ctx,
+				[this, p = std::move(p)]() mutable {
+					if (not manager.NewPacketUDP(std::move(p))) {
+						manager.Close({ net_error::unknown_msg_type, gef::nullopt });
+					}
+				});
 		}
 
 	private:
 
+		// A datagram is received whole into `receive_buf`, a single async_receive, so a control message (negative type)
+		// is seen before the application builds a message for it. It's received past room for a fixed header,
+		// which replaces a compact one.
+		// The buffer grows to the largest datagram received, one that didn't fit is dropped
 		void Read() noexcept {
 
-			socket.async_wait(udp::socket::wait_read,
-				[this](asio::error_code ec) {
+			socket.async_receive(mut_buf{ receive_buf.data() + HeaderIn::header_size, receive_buf.size() - HeaderIn::header_size }, detail::receive_truncated,
+				[this](asio::error_code ec, size_t size) {
+					const size_t room = receive_buf.size() - HeaderIn::header_size;
+
+					// without MSG_TRUNC, a datagram that fills the buffer may have been cut
+					const bool truncated = ec == asio::error::message_size
+						|| (not ec && (size > room || (detail::receive_truncated == 0 && size == room)));
+
+					if (truncated) {
+						if (room < detail::datagram_max) {
+							receive_buf.resize(HeaderIn::header_size + std::min(std::max(size + 1, room * 2), detail::datagram_max));
+						}
+
+						Read();
+						return;
+					}
+
 					if (ec) {
 						manager.Close({ net_error::failed_to_read, ec });
 						return;
 					}
 
-					size_t size = socket.available();
+					const const_buf datagram = header_framing == framing::compact
+						? Unframe(receive_buf.data() + HeaderIn::header_size, size)
+						: const_buf{ receive_buf.data() + HeaderIn::header_size, size };
 
-					auto p = gef::unique_ref<PacketIn>::make( std::move(manager.builder_UDP(size)) );
+					if (datagram.size() < HeaderIn::header_size) {
+						Read();
+						return;
+					}
 
-					auto bufs = p->mut_buf_seq();
+					if (auto capture = manager.capture()) {
+						capture->Record(manager.capture_id(), protocol::udp, capture_direction::in, datagram);
+					}
 
-					socket.receive(bufs, 0, ec);
+					HeaderIn h;
+					std::memcpy(&h, datagram.data(), HeaderIn::header_size);
 
-					if (ec) {
-						manager.Close({ net_error::failed_to_read, ec });
+					if (h.msg_type < 0) {
+						manager.ControlUDP(datagram);
+						Read();
 						return;
 					}
 
+					auto p = gef::unique_ref<PacketIn>::make( std::move(manager.builder_UDP(datagram.size())) );
+
+					asio::buffer_copy(p->mut_buf_seq(), datagram);
+
 					if (not ContinueAndNotify(std::move(p))) {
 						manager.Close({ net_error::unknown_msg_type, gef::nullopt });
 					}
@@ -203,25 +1099,183 @@ namespace net {
 		}
 
 		void Write() noexcept {
-			PacketHolder<PacketOut> p{ nullptr };
+			entry e;
+
+			for (;;) {
+				bool relieved = false;
+				const bool popped = out_queue.Pop(e, relieved);
+
+				if (relieved) { // the oldest datagrams it dropped drained the queue, as a write would have
+					manager.QueuePressure(protocol::udp, false);
+				}
+
+				if (not popped || not manager.connected) {
+					break;
+				}
+
+				if (auto capture = manager.capture()) {
+					capture->Record(manager.capture_id(), protocol::udp, capture_direction::out, e.bufs);
+				}
+
+				if (ShmLink* link = shm.load(std::memory_order_acquire)) {
+					WriteShm(*link, e);
+					continue;
+				}
+
+				e.bufs[0] = FrameHeader(e.p->h);
+				detail::linearize(e.bufs, linear, linearize_bytes);
+
+				asio::error_code ec;
+
+				socket.send(e.bufs, 0, ec);
+
+				if (out_queue.Release(e.bytes)) {
+					manager.QueuePressure(protocol::udp, false);
+				}
+
+				if (ec) {
+					asio::post(global_ctx,
+						[this, ec]() mutable {
+							manager.Close({ net_error::failed_to_write, ec });
+						});
+					break;
+				}
+			}
+
+			out_queue.Wake();
+		}
 
-			out_queue.wait_dequeue(p);
+		void ScheduleWrite() noexcept {
+			if (io_writes && not write_scheduled.exchange(true)) {
+				asio::post(global_ctx, [this]() { WriteNext(); });
+			}
+		}
 
-			if (not manager.connected) {
+		// see SocketTCP::MayBlock()
+		bool MayBlock() const noexcept {
+			return not io_writes || not global_ctx.get_executor().running_in_this_thread();
+		}
+
+		void WriteNext() noexcept {
+			if (shm_io.waiting() && not WriteShmAsync()) {
 				return;
 			}
 
-			auto bufs = p->const_buf_seq();
+			for (;;) {
+				bool relieved = false;
+				const bool popped = detail::try_pop_scheduled(out_queue, io_entry, write_scheduled, manager.connected, relieved);
+
+				if (relieved) {
+					manager.QueuePressure(protocol::udp, false);
+				}
+
+				if (not popped) {
+					return;
+				}
+
+				if (auto capture = manager.capture()) {
+					capture->Record(manager.capture_id(), protocol::udp, capture_direction::out, io_entry.bufs);
+				}
+
+				if (shm.load(std::memory_order_acquire) == nullptr) {
+					break;
+				}
+
+				if (not WriteShmAsync()) {
+					return;
+				}
+			}
+
+			io_entry.bufs[0] = FrameHeader(io_entry.p->h);
+			detail::linearize(io_entry.bufs, linear, linearize_bytes);
+
+			socket.async_send(io_entry.bufs,
+				[this](asio::error_code ec, size_t) {
+					if (out_queue.Release(io_entry.bytes)) {
+						manager.QueuePressure(protocol::udp, false);
+					}
+
+					io_entry = entry{};
 
-			socket.async_send(bufs,
-				[this, p = std::move(p)](asio::error_code ec, size_t) {
 					if (ec) {
+						write_scheduled = false;
 						manager.Close({ net_error::failed_to_write, ec });
 						return;
 					}
+
+					WriteNext();
 				});
+		}
+
+		// see SocketTCP::WriteShmAsync()
+		bool WriteShmAsync() noexcept {
+			using result = detail::shm_io_writer::result;
+
+			ShmLink* link = shm.load(std::memory_order_acquire);
+
+			const result written = link != nullptr && manager.connected
+				? shm_io.Write(*link, protocol::udp, io_entry.bufs, [this]() { WriteNext(); })
+				: result::timed_out;
+
+			if (written == result::full) {
+				return false;
+			}
+
+			if (out_queue.Release(io_entry.bytes)) {
+				manager.QueuePressure(protocol::udp, false);
+			}
+
+			io_entry = entry{};
+
+			if (written == result::timed_out) {
+				shm_io.Reset();
+				write_scheduled = false;
 
-			Write();
+				if (manager.connected) {
+					manager.Close({ net_error::slow_consumer, gef::nullopt });
+				}
+
+				return false;
+			}
+
+			return true;
+		}
+
+		// see SocketTCP::WriteShm()
+		void WriteShm(ShmLink& link, entry& e) noexcept {
+			if (not link.Write(protocol::udp, e.bufs) && manager.connected) {
+				asio::post(global_ctx, [this]() { manager.Close({ net_error::slow_consumer, gef::nullopt }); });
+			}
+
+			if (out_queue.Release(e.bytes)) {
+				manager.QueuePressure(protocol::udp, false);
+			}
+		}
+
+		// Rewrites the compact header of the datagram at `data` as the fixed one, in place right before its body.
+		// - Returns the datagram with the fixed header, empty if it was malformed
+		const_buf Unframe(u8* data, const size_t size) noexcept {
+			HeaderIn h{};
+
+			const size_t compact_size = detail::decode_compact_udp(data, size, h, implied_from);
+
+			if (compact_size == 0) {
+				return {};
+			}
+
+			u8* fixed = data + compact_size - HeaderIn::header_size; // within `receive_buf`, `data` is past room for it
+
+			std::memcpy(fixed, &h, HeaderIn::header_size);
+
+			return { fixed, HeaderIn::header_size + size - compact_size };
+		}
+
+		const_buf FrameHeader(HeaderOut& h) noexcept {
+			if (header_framing == framing::fixed) {
+				return header_to<const_buf>(h);
+			}
+
+			return { compact_out.data(), detail::encode_compact_udp(h, implied_from, compact_out.data()) };
 		}
 
 		constexpr bool ContinueAndNotify(gef::unique_ref<PacketIn>&& p) noexcept {
@@ -233,7 +1287,23 @@ namespace net {
 		Manager& manager;
 		asio::io_context& global_ctx;
 
-		moodycamel::BlockingReaderWriterQueue<PacketHolder<PacketOut>> out_queue;
+		SendQueue<PacketHolder<PacketOut>> out_queue;
+
+		const size_t linearize_bytes;
+		alignas(detail::cache_line) detail::linear_buf linear{};
+
+		const bool io_writes;
+		std::atomic<bool> write_scheduled{ false };
+		entry io_entry; // being written, io_writes only
+
+		framing header_framing = framing::fixed;
+		i16 implied_from = -1;
+		detail::compact_header compact_out{};
+
+		std::vector<u8> receive_buf = std::vector<u8>(HeaderIn::header_size + 2048); // room for a fixed header, a datagram
+
+		std::atomic<ShmLink*> shm{ nullptr }; // see UseShm(), owned by the manager
+		detail::shm_io_writer shm_io;          // io_writes, `io_entry` waits for room in the ring
 	public:
 		udp::socket socket;
 	};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <thread>
+#include <cstring>
+
+#ifdef _WIN32
+#include "win32.hpp"
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace net {
+
+	enum class thread_role : u8 {
+		io,
+		accept,
+		dequeue,
+		fanout,
+		handler,
+		writer,
+		shm
+	};
+
+	constexpr thread_placement const& placement_of(thread_config const& config, const thread_role role) noexcept {
+		switch (role) {
+		case thread_role::accept:  return config.accept;
+		case thread_role::dequeue: return config.dequeue;
+		case thread_role::fanout:  return config.fanout;
+		case thread_role::handler: return config.handler;
+		case thread_role::writer:  return config.writer;
+		case thread_role::shm:     return config.shm;
+		default:                   return config.io;
+		}
+	}
+
+	// Names, pins and prioritizes the calling thread, returns the first setting the OS refused (the rest are still applied).
+	// name - at most 15 characters are kept on Linux, nullptr leaves it
+	inline std::error_code place_this_thread(thread_placement const& placement, const char* name) noexcept {
+		std::error_code first{};
+
+		const auto refused = [&](std::error_code ec) {
+			if (ec && not first) {
+				first = ec;
+			}
+		};
+
+#ifdef _WIN32
+		const HANDLE self = ::GetCurrentThread();
+
+		if (name != nullptr) {
+			wchar_t wide[64]{};
+
+			for (size_t i = 0; i < std::size(wide) - 1 && name[i] != '\0'; i++) {
+				wide[i] = static_cast<wchar_t>(name[i]);
+			}
+
+			const HRESULT hr = ::SetThreadDescription(self, wide);
+			refused(FAILED(hr) ? std::error_code(hr, std::system_category()) : std::error_code{});
+		}
+
+		if (not placement.cpus.empty()) {
+			DWORD_PTR mask = 0;
+
+			for (const u16 cpu : placement.cpus) {
+				if (cpu < sizeof(DWORD_PTR) * 8) {
+					mask |= DWORD_PTR{ 1 } << cpu;
+				}
+			}
+
+			if (::SetThreadAffinityMask(self, mask) == 0) {
+				refused({ static_cast<int>(::GetLastError()), std::system_category() });
+			}
+		}
+
+		if (placement.realtime_priority != 0 && not ::SetThreadPriority(self, THREAD_PRIORITY_HIGHEST)) {
+			refused({ static_cast<int>(::GetLastError()), std::system_category() });
+		}
+#else
+		const pthread_t self = ::pthread_self();
+
+		if (name != nullptr) {
+			char truncated[16]{};
+			std::strncpy(truncated, name, sizeof(truncated) - 1);
+
+#ifdef __APPLE__
+			refused({ ::pthread_setname_np(truncated), std::system_category() });
+#else
+			refused({ ::pthread_setname_np(self, truncated), std::system_category() });
+#endif
+		}
+
+		if (not placement.cpus.empty()) {
+#ifdef __linux__
+			cpu_set_t set;
+			CPU_ZERO(&set);
+
+			for (const u16 cpu : placement.cpus) {
+				if (cpu < CPU_SETSIZE) {
+					CPU_SET(cpu, &set);
+				}
+			}
+
+			refused({ ::pthread_setaffinity_np(self, sizeof(set), &set), std::system_category() });
+#else
+			refused(std::make_error_code(std::errc::not_supported)); // macOS has affinity hints only
+#endif
+		}
+
+		if (placement.realtime_priority != 0) {
+			sched_param param{};
+			param.sched_priority = std::min<int>(placement.realtime_priority, ::sched_get_priority_max(SCHED_FIFO));
+
+			refused({ ::pthread_setschedparam(self, SCHED_FIFO, &param), std::system_category() });
+		}
+#endif
+
+		return first;
+	}
+
+	// Every thread the library starts is started here, placed as `config` says for its `role` before `body()` runs.
+	// name - see place_this_thread(), the name sticks only if `thread_config::names`
+	template <typename F>
+	std::thread spawn_thread(thread_config const& config, const thread_role role, const char* name, F&& body) noexcept {
+		return std::thread(
+			[placement = placement_of(config, role), name = config.names ? name : nullptr, body = std::forward<F>(body)]() mutable {
+				place_this_thread(placement, name);
+
+				body();
+			});
+	}
+}
\ No newline at end of file
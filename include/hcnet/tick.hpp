@@ -0,0 +1,98 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <chrono>
+
+namespace net {
+
+	// Fixed rate ticks on an io_context, calls `manager.Tick(tick_no, dt)` on it.
+	//
+	// * drift-free, tick n is due `n` periods after the first whatever the ones before it took
+	// * ticks that came due while one ran (or while the context was busy) are skipped, not run back to back,
+	//   `manager.TickOverrun(tick_no, skipped)` reports them and `tick_no` jumps past them
+	// * Start() / Stop() from the context's thread, or before it runs. A wait of an earlier Start() that still
+	//   completes after them does nothing, it belongs to an older generation
+	template <class Manager>
+	class TickScheduler {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		TickScheduler(Manager& manager, asio::io_context& ctx) noexcept :
+			manager(manager),
+			timer(ctx)
+		{}
+
+		void Start(const u32 rate_hz) noexcept {
+			period = std::chrono::nanoseconds(1'000'000'000 / std::max<u32>(rate_hz, 1));
+
+			epoch = clock::now();
+			last = epoch;
+			tick_no = 0;
+
+			running = true;
+			generation++;
+
+			Arm();
+		}
+
+		void Stop() noexcept {
+			running = false;
+			generation++;
+			timer.cancel();
+		}
+
+		constexpr bool is_running() const noexcept {
+			return running;
+		}
+
+		constexpr std::chrono::nanoseconds tick_period() const noexcept {
+			return period;
+		}
+
+	private:
+		// tick n is due at epoch + (n + 1) * period
+		void Arm() noexcept {
+			timer.expires_at(epoch + period * (tick_no + 1));
+
+			timer.async_wait(
+				[this, armed = generation](asio::error_code ec) {
+					if (ec || not running || armed != generation) { // already due when it was cancelled
+						return;
+					}
+
+					const clock::time_point now = clock::now();
+
+					const u64 latest_due = static_cast<u64>((now - epoch) / period) - 1;
+
+					if (latest_due > tick_no) {
+						manager.TickOverrun(tick_no, latest_due - tick_no);
+						tick_no = latest_due;
+					}
+
+					const double dt = std::chrono::duration<double>(now - last).count();
+					last = now;
+
+					manager.Tick(tick_no, dt);
+
+					if (not running || armed != generation) { // stopped, or restarted, from the tick
+						return;
+					}
+
+					tick_no++;
+
+					Arm();
+				});
+		}
+
+		Manager& manager;
+		asio::steady_timer timer;
+
+		std::chrono::nanoseconds period{ 0 };
+		clock::time_point epoch;
+		clock::time_point last;
+		u64 tick_no = 0;
+
+		bool running = false;
+		u64 generation = 0; // of Start() / Stop(), a wait armed before the last one is stale
+	};
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "canyon.hpp"
+#include <algorithm>
+
+namespace net {
+
+	// Hashed timing wheel, every slot covers `resolution_ms`, so a deadline expires up to `resolution_ms` late.
+	// A slot holds every entry due in a tick congruent to it, the ones of later laps stay until their tick comes.
+	//
+	// * Schedule() and Advance() are O(1) per entry, whatever the number of entries
+	// * nothing is cancelled, an entry the owner no longer wants is told apart on expiry (e.g. by its `due_ms`)
+	// * one thread
+	template <typename Key>
+	class TimerWheel {
+	public:
+
+		TimerWheel(const u32 resolution_ms, const size_t slot_count = 512) noexcept :
+			resolution(std::max<u32>(resolution_ms, 1)),
+			slots(std::max<size_t>(slot_count, 1))
+		{}
+
+		// due_ms - the same clock Advance() is given, a deadline in the past expires on the next Advance()
+		void Schedule(const Key key, const i64 due_ms) noexcept {
+			const u64 due_tick = std::max<u64>(TickOf(due_ms), next_tick);
+
+			slots[due_tick % slots.size()].push_back({ key, due_ms, due_tick });
+		}
+
+		// Expires every entry due by `now_ms`, `expired(key, due_ms)` for each once the wheel is consistent again,
+		// so it may Schedule()
+		template <typename F>
+		void Advance(const i64 now_ms, F&& expired) noexcept {
+			const u64 now_tick = static_cast<u64>(std::max<i64>(now_ms, 0)) / resolution;
+
+			if (now_tick < next_tick) {
+				return;
+			}
+
+			// a wheel that fell behind by a lap or more visits every slot once
+			const u64 visits = std::min<u64>(now_tick - next_tick + 1, slots.size());
+
+			for (u64 i = 0; i < visits; i++) {
+				std::vector<entry>& slot = slots[(next_tick + i) % slots.size()];
+
+				auto later = std::partition(slot.begin(), slot.end(), [&](entry const& e) { return e.due_tick > now_tick; });
+
+				due.insert(due.end(), later, slot.end());
+				slot.erase(later, slot.end());
+			}
+
+			next_tick = now_tick + 1;
+
+			for (entry const& e : due) {
+				expired(e.key, e.due_ms);
+			}
+
+			due.clear();
+		}
+
+		size_t size() const noexcept {
+			size_t count = 0;
+
+			for (auto const& slot : slots) {
+				count += slot.size();
+			}
+
+			return count;
+		}
+
+	private:
+		struct entry {
+			Key key;
+			i64 due_ms;
+			u64 due_tick;
+		};
+
+		// the first tick at or after `due_ms`, expiring on it is never early
+		constexpr u64 TickOf(const i64 due_ms) const noexcept {
+			return (static_cast<u64>(std::max<i64>(due_ms, 0)) + resolution - 1) / resolution;
+		}
+
+		const u32 resolution;
+
+		std::vector<std::vector<entry>> slots;
+		u64 next_tick = 0;
+
+		std::vector<entry> due; // Advance() only, kept for its capacity
+	};
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+// The Windows API the library's headers use, without the min / max macros and the parts it doesn't need.
+// The macros are defined only around the include, an application that wants the whole API includes <windows.h> first
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#define HCNET_DEFINED_WIN32_LEAN_AND_MEAN
+#endif
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#define HCNET_DEFINED_NOMINMAX
+#endif
+
+#include <windows.h>
+
+#ifdef HCNET_DEFINED_WIN32_LEAN_AND_MEAN
+#undef WIN32_LEAN_AND_MEAN
+#undef HCNET_DEFINED_WIN32_LEAN_AND_MEAN
+#endif
+
+#ifdef HCNET_DEFINED_NOMINMAX
+#undef NOMINMAX
+#undef HCNET_DEFINED_NOMINMAX
+#endif
+
+#endif
\ No newline at end of file